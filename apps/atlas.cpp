@@ -0,0 +1,300 @@
+#include "atlas.h"
+#include "jobs.h"
+
+#include <chrono>
+#include <iostream>
+
+#include <stb_image.h>
+
+
+AtlasImage::AtlasImage()
+	: index(none)
+{}
+
+AtlasImage::AtlasImage(uint32_t index)
+	: index(index)
+{}
+
+bool AtlasImage::valid() const {
+	return index != none;
+}
+
+bool AtlasImage::operator==(AtlasImage const& other) const {
+	return index == other.index;
+}
+
+bool AtlasImage::operator!=(AtlasImage const& other) const {
+	return index != other.index;
+}
+
+
+bool TextureAtlas::place(Layer& layer, glm::ivec2 size, glm::ivec2& corner) {
+	for (Shelf& shelf : layer.shelves) {
+		if ((size.y <= shelf.height) && (shelf.x + size.x <= layer_size)) {
+			corner = glm::ivec2(shelf.x, shelf.y);
+			shelf.x += size.x;
+			return true;
+		}
+	}
+	if (layer.top + size.y > layer_size) {
+		return false;
+	}
+	layer.shelves.push_back({ layer.top, size.y, size.x });
+	corner = glm::ivec2(0, layer.top);
+	layer.top += size.y;
+	return true;
+}
+
+void TextureAtlas::configure(int layer_size) {
+	if (!regions.empty()) {
+		throw std::runtime_error("The texture atlas cannot be resized once images are added.");
+	}
+	TextureAtlas::layer_size = layer_size;
+}
+
+// The first image is a single clear pixel, which every image shows until
+// its own pixels are on the GPU. It is queued like any other image, and
+// only counts as resident once it has been sent.
+AtlasImage TextureAtlas::placeholder() {
+	if (regions.empty()) {
+		Texture::RGBA8 clear = { 0, 0, 0, 0 };
+		regions.push_back(AtlasRegion());
+		resident.push_back(false);
+		waiting++;
+		pack(AtlasImage(0), "placeholder", &clear, { 1, 1 });
+	}
+	return AtlasImage(0);
+}
+
+AtlasImage TextureAtlas::reserve(AssetId name) {
+	placeholder();
+	AtlasImage image((uint32_t) regions.size());
+	regions.push_back(AtlasRegion());
+	resident.push_back(false);
+	if (name >= images.size()) {
+		images.resize((size_t) name + 1, AtlasImage());
+	}
+	images[name] = image;
+	return image;
+}
+
+// Headless builds have no GL context, so images are never loaded
+AtlasImage TextureAtlas::load(std::string_view file_path) {
+#ifdef GLAZY_HEADLESS
+	return AtlasImage();
+#else
+	AssetId id = AssetIds::intern(file_path);
+	if ((id < images.size()) && images[id].valid()) {
+		return images[id];
+	}
+	AtlasImage image = reserve(id);
+	waiting++;
+	// Interned names live until exit, so the job can use this one in place
+	std::string const& path = AssetIds::name(id);
+	JobPool::submit([image, &path]() {
+		Decoded result;
+		result.image = image;
+		result.path  = path;
+		int width, height, channels;
+		unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, 4);
+		if (data == nullptr) {
+			result.error = "Failed to load texture '" + path + "'.";
+		}
+		else {
+			result.pixels = std::shared_ptr<unsigned char>(data, stbi_image_free);
+			result.size   = { width, height };
+		}
+		std::lock_guard<std::mutex> lock(decoded_mutex);
+		decoded.push_back(std::move(result));
+	});
+	return image;
+#endif
+}
+
+AtlasImage TextureAtlas::add(std::string_view name, Texture::RGBA8 const* pixels, glm::ivec2 size) {
+	AtlasImage image = reserve(AssetIds::intern(name));
+	waiting++;
+	pack(image, name, pixels, size);
+	return image;
+}
+
+// Copies an image into the CPU side of the atlas and queues it for upload
+void TextureAtlas::pack(AtlasImage image, std::string_view name, Texture::RGBA8 const* pixels, glm::ivec2 size) {
+	if ((size.x > layer_size) || (size.y > layer_size) || (size.x <= 0) || (size.y <= 0)) {
+		std::string message = "Image '" + std::string(name) + "' does not fit in a ";
+		message += std::to_string(layer_size) + " pixel atlas layer.";
+		throw std::runtime_error(message);
+	}
+	glm::ivec2 corner;
+	size_t layer_index = 0;
+	while ((layer_index < layers.size()) && !place(layers[layer_index], size, corner)) {
+		layer_index++;
+	}
+	if (layer_index == layers.size()) {
+		layers.push_back(Layer());
+		Layer& layer = layers.back();
+		layer.pixels.assign((size_t) layer_size * layer_size, Texture::RGBA8{ 0, 0, 0, 0 });
+		layer.top = 0;
+		place(layer, size, corner);
+	}
+	Layer& layer = layers[layer_index];
+	for (int row = 0; row < size.y; row++) {
+		Texture::RGBA8 const* source = pixels + (size_t) row * size.x;
+		Texture::RGBA8* target = layer.pixels.data() + (size_t) (corner.y + row) * layer_size + corner.x;
+		std::copy(source, source + size.x, target);
+	}
+
+	Upload upload;
+	upload.image          = image;
+	upload.corner         = corner;
+	upload.region.layer   = (uint32_t) layer_index;
+	upload.region.uv_rect = glm::vec4(corner.x, corner.y, size.x, size.y) / (float) layer_size;
+	upload.region.size    = size;
+	uploads.push_back(upload);
+}
+
+AtlasRegion const& TextureAtlas::region(AtlasImage image) {
+	return resident[image.index] ? regions[image.index] : regions[0];
+}
+
+// Storage grows by doubling, so a level that loads many images only
+// reallocates a few times. Reallocating loses the old contents, so every
+// layer is sent again straight away, whatever the budget.
+void TextureAtlas::reallocate() {
+	size_t capacity = std::max<size_t>(allocated_layers, 1);
+	while (capacity < layers.size()) {
+		capacity *= 2;
+	}
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, layer_size, layer_size, (GLsizei) capacity, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	allocated_layers = capacity;
+
+	// The queued areas are covered by the whole layers
+	for (Upload const& upload : uploads) {
+		regions[upload.image.index]  = upload.region;
+		resident[upload.image.index] = true;
+		waiting--;
+	}
+	uploads.clear();
+	for (size_t i = 0; i < layers.size(); i++) {
+		Upload upload;
+		upload.corner         = glm::ivec2(0, 0);
+		upload.region.layer   = (uint32_t) i;
+		upload.region.uv_rect = glm::vec4(0, 0, 1, 1);
+		upload.region.size    = glm::ivec2(layer_size, layer_size);
+		send(upload);
+	}
+}
+
+// Sends one area through the pixel buffer. Orphaning the buffer first lets
+// the driver hand out fresh memory instead of waiting for the last transfer.
+void TextureAtlas::send(Upload const& upload) {
+	glm::ivec2 size  = upload.region.size;
+	size_t     bytes = (size_t) size.x * size.y * sizeof(Texture::RGBA8);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr) bytes, nullptr, GL_STREAM_DRAW);
+	void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr) bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (mapped == nullptr) {
+		throw std::runtime_error("Failed to map the atlas pixel buffer.");
+	}
+	Layer const& layer = layers[upload.region.layer];
+	Texture::RGBA8* target = static_cast<Texture::RGBA8*>(mapped);
+	for (int row = 0; row < size.y; row++) {
+		Texture::RGBA8 const* source = layer.pixels.data() + (size_t) (upload.corner.y + row) * layer_size + upload.corner.x;
+		std::copy(source, source + size.x, target + (size_t) row * size.x);
+	}
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, upload.corner.x, upload.corner.y, (GLint) upload.region.layer, size.x, size.y, 1, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+}
+
+void TextureAtlas::update(double budget_seconds) {
+#ifndef GLAZY_HEADLESS
+	auto start = std::chrono::steady_clock::now();
+	auto spent = [start]() {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	};
+	{
+		std::lock_guard<std::mutex> lock(decoded_mutex);
+		for (Decoded& image : decoded) {
+			arrived.push_back(std::move(image));
+		}
+		decoded.clear();
+	}
+	size_t packed = 0;
+	while (!arrived.empty() && ((packed == 0) || (spent() < budget_seconds))) {
+		Decoded image = std::move(arrived.front());
+		arrived.pop_front();
+		// An image that cannot be read keeps showing the placeholder
+		if (!image.error.empty()) {
+			std::cerr << image.error << std::endl;
+			waiting--;
+			continue;
+		}
+		pack(image.image, image.path, reinterpret_cast<Texture::RGBA8 const*>(image.pixels.get()), image.size);
+		packed++;
+	}
+	if (layers.empty()) {
+		return;
+	}
+
+	safety::entry_guard("TextureAtlas::update");
+	if (texture == 0) {
+		glGenTextures(1, &texture);
+		glGenBuffers(1, &pixel_buffer);
+		if ((texture == 0) || (pixel_buffer == 0)) {
+			throw std::runtime_error("Failed to allocate the texture atlas.");
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (allocated_layers < layers.size()) {
+		reallocate();
+	}
+	size_t sent = 0;
+	while (!uploads.empty() && ((sent == 0) || (spent() < budget_seconds))) {
+		Upload const& upload = uploads.front();
+		send(upload);
+		regions[upload.image.index]  = upload.region;
+		resident[upload.image.index] = true;
+		waiting--;
+		uploads.pop_front();
+		sent++;
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	safety::exit_guard("TextureAtlas::update");
+#endif
+}
+
+size_t TextureAtlas::pending() {
+	return waiting;
+}
+
+GLuint TextureAtlas::texture_id() {
+	return texture;
+}
+
+size_t TextureAtlas::layer_count() {
+	return layers.size();
+}
+
+
+uint32_t const AtlasImage::none;
+
+int                      TextureAtlas::layer_size       = 256;
+std::vector<TextureAtlas::Layer> TextureAtlas::layers   = std::vector<TextureAtlas::Layer>();
+std::vector<AtlasRegion> TextureAtlas::regions          = std::vector<AtlasRegion>();
+std::vector<bool>        TextureAtlas::resident         = std::vector<bool>();
+std::vector<AtlasImage>  TextureAtlas::images           = std::vector<AtlasImage>();
+std::deque<TextureAtlas::Decoded> TextureAtlas::arrived = std::deque<TextureAtlas::Decoded>();
+std::deque<TextureAtlas::Upload>  TextureAtlas::uploads = std::deque<TextureAtlas::Upload>();
+size_t                   TextureAtlas::waiting          = 0;
+GLuint                   TextureAtlas::texture          = 0;
+GLuint                   TextureAtlas::pixel_buffer     = 0;
+size_t                   TextureAtlas::allocated_layers = 0;
+
+std::mutex                         TextureAtlas::decoded_mutex;
+std::vector<TextureAtlas::Decoded> TextureAtlas::decoded = std::vector<TextureAtlas::Decoded>();
@@ -0,0 +1,134 @@
+#ifndef ATLAS
+#define ATLAS
+
+#include "common.h"
+
+#include <deque>
+#include <mutex>
+
+
+// A lightweight handle to an image in the texture atlas. Changing which image
+// a sprite shows is a change of handle, not of bound texture.
+struct AtlasImage {
+	static uint32_t const none = 0xFFFFFFFFu;
+
+	uint32_t index;
+
+	AtlasImage();
+	explicit AtlasImage(uint32_t index);
+	bool valid() const;
+	bool operator==(AtlasImage const& other) const;
+	bool operator!=(AtlasImage const& other) const;
+};
+
+
+// Where an image was packed
+struct AtlasRegion {
+	uint32_t   layer;
+	// The minimum corner of the image on its layer, then its size, in
+	// texture coordinates
+	glm::vec4  uv_rect;
+	glm::ivec2 size;
+};
+
+
+// Packs sprite images into the square layers of one GL_TEXTURE_2D_ARRAY, so
+// every sprite drawn from the atlas shares one texture binding.
+//
+// An image the size of a layer gets a layer to itself. Smaller images are
+// packed into shared layers on shelves: each shelf is a row as tall as the
+// first image placed on it, and later images go on the first shelf they fit.
+// The atlas is sampled without filtering or mipmaps, so images can be packed
+// edge to edge without picking up their neighbours.
+// Images larger than a layer cannot be packed, and should be loaded through
+// TextureCache instead.
+//
+// Files are decoded by background jobs on the JobPool, so load() returns at
+// once. Until an image has reached the GPU, its handle shows a transparent
+// placeholder. update() runs on the GL thread once a frame: it packs the
+// images that finished decoding and streams them to the texture through a
+// pixel buffer, stopping once the frame's time budget is spent. A file that
+// cannot be read is reported on stderr, and its handle keeps showing the
+// placeholder.
+class TextureAtlas {
+
+	struct Shelf {
+		int y;
+		int height;
+		int x;
+	};
+
+	struct Layer {
+		std::vector<Texture::RGBA8> pixels;
+		std::vector<Shelf>          shelves;
+		int  top;
+	};
+
+	// An image a background job has finished with. Empty pixels and a
+	// non-empty error mean the file could not be read.
+	struct Decoded {
+		AtlasImage  image;
+		std::string path;
+		std::shared_ptr<unsigned char> pixels;
+		glm::ivec2  size;
+		std::string error;
+	};
+
+	// A packed area that still has to be sent to the GPU. Whole layers are
+	// sent with an invalid image.
+	struct Upload {
+		AtlasImage  image;
+		AtlasRegion region;
+		glm::ivec2  corner;
+	};
+
+	static int                      layer_size;
+	static std::vector<Layer>       layers;
+	static std::vector<AtlasRegion> regions;
+	// Whether each image's region has reached the GPU. Images that have not
+	// show the placeholder.
+	static std::vector<bool>        resident;
+	// Indexed by the AssetId of the image's name
+	static std::vector<AtlasImage>  images;
+	static std::deque<Decoded>      arrived;
+	static std::deque<Upload>       uploads;
+	static size_t                   waiting;
+	static GLuint                   texture;
+	static GLuint                   pixel_buffer;
+	static size_t                   allocated_layers;
+
+	// Filled by background jobs, and emptied into 'arrived' by update()
+	static std::mutex               decoded_mutex;
+	static std::vector<Decoded>     decoded;
+
+	static bool place(Layer& layer, glm::ivec2 size, glm::ivec2& corner);
+	static AtlasImage placeholder();
+	static AtlasImage reserve(AssetId name);
+	static void pack(AtlasImage image, std::string_view name, Texture::RGBA8 const* pixels, glm::ivec2 size);
+	static void reallocate();
+	static void send(Upload const& upload);
+
+public:
+
+	// Sets the width and height of each layer. Only allowed before the first
+	// image is added.
+	static void configure(int layer_size);
+
+	// Returns the image already requested from this path, if there is one
+	static AtlasImage load(std::string_view file_path);
+	static AtlasImage add(std::string_view name, Texture::RGBA8 const* pixels, glm::ivec2 size);
+	static AtlasRegion const& region(AtlasImage image);
+
+	// Must be called from the thread that owns the GL context. At least one
+	// image is packed and sent each call, however small the budget. Throws
+	// if a decoded image is larger than a layer.
+	static void update(double budget_seconds);
+	// The number of images that have not reached the GPU yet
+	static size_t pending();
+	static GLuint texture_id();
+	static size_t layer_count();
+
+};
+
+
+#endif
@@ -0,0 +1,261 @@
+#include "batch.h"
+
+
+namespace {
+
+	// Attribute locations of the per-instance data, after the quad's
+	// position and texture coordinates
+	enum InstanceAttribute : GLuint {
+		offset_attrib  = 2,
+		scale_attrib   = 3,
+		uv_rect_attrib = 4,
+		depth_attrib   = 5,
+		layer_attrib   = 6,
+	};
+
+	// The texture a sprite binds for itself, which is none for sprites drawn
+	// from the atlas
+	Texture* own_texture(Sprite const& sprite) {
+		return sprite.image.valid() ? nullptr : sprite.tex.get();
+	}
+
+	std::shared_ptr<Texture> const& own_texture_ptr(Sprite const& sprite) {
+		static std::shared_ptr<Texture> const none;
+		return sprite.image.valid() ? none : sprite.tex;
+	}
+
+	// Whether a sprite's quad reaches into the view, which spans [-1,1]
+	// around the camera on both axes
+	bool in_view(glm::vec2 offset, glm::vec2 scale, glm::vec2 camera) {
+		glm::vec2 reach = glm::abs(offset - camera) - glm::abs(scale);
+		return (reach.x <= 1.f) && (reach.y <= 1.f);
+	}
+
+}
+
+
+void SpriteBatch::setup() {
+	if (is_setup) {
+		return;
+	}
+	is_setup = true;
+	Sprite::setup();
+	instance_buffer = new Buffer<SpriteInstance>;
+
+	VAO::BindGuard guard(Sprite::get_vao());
+	for (GLuint attrib = offset_attrib; attrib <= layer_attrib; attrib++) {
+		glEnableVertexAttribArray(attrib);
+		glVertexAttribDivisor(attrib, 1);
+	}
+}
+
+// Programs and textures share one table, since two live objects never share
+// an address. Slot 0 stands for no texture. Objects are looked up by address,
+// and the weak pointer is only made when an object is first seen, so sorting
+// a frame copies no shared pointers.
+template<typename T>
+uint64_t SpriteBatch::slot(std::shared_ptr<T> const& object) {
+	if (!object) {
+		return 0;
+	}
+	auto found = slots.find((void const*) object.get());
+	if (found == slots.end()) {
+		return insert_slot(object);
+	}
+	return found->second.index;
+}
+
+uint64_t SpriteBatch::insert_slot(std::shared_ptr<void const> object) {
+	uint64_t index = slots.size() + 1;
+	if (!free_slots.empty()) {
+		index = free_slots.back();
+		free_slots.pop_back();
+	}
+	void const* address = object.get();
+	slots.emplace(address, Slot{ std::move(object), index });
+	return index;
+}
+
+void SpriteBatch::release_slots() {
+	for (auto it = slots.begin(); it != slots.end();) {
+		if (it->second.object.expired()) {
+			uniforms.erase((GPUProgram*) it->first);
+			free_slots.push_back(it->second.index);
+			it = slots.erase(it);
+		}
+		else {
+			it++;
+		}
+	}
+}
+
+SpriteBatch::ProgramUniforms& SpriteBatch::uniforms_of(GPUProgram* program) {
+	auto found = uniforms.find(program);
+	if (found == uniforms.end()) {
+		UniformTable& table = UniformTable::of(*program);
+		found = uniforms.emplace(program, ProgramUniforms{ { table, "tex" }, { table, "atlas" }, { table, "cam_pos" } }).first;
+	}
+	return found->second;
+}
+
+uint64_t SpriteBatch::sort_key(Sprite const& sprite) {
+	// Depth runs from -1 at the front to 1 at the back
+	float    depth     = glm::clamp((sprite.depth + 1.f) * 0.5f, 0.f, 1.f);
+	uint64_t quantized = (uint64_t) (depth * (float) 0xFFFFFFu);
+	uint64_t key = 0;
+	key |= (uint64_t) (sprite.screenlock ? 1 : 0)       << 63;
+	key |= (slot(sprite.program)           & 0x7FF)      << 52;
+	key |= (slot(own_texture_ptr(sprite))  & 0xFFFF)     << 36;
+	key |= (uint64_t) (sprite.uniform_callback ? 1 : 0) << 32;
+	key |= quantized;
+	return key;
+}
+
+void SpriteBatch::gather(float alpha) {
+	queue.clear();
+	gathered.clear();
+	sprites.clear();
+	stats = RenderStats();
+	release_slots();
+
+	glm::vec2 camera = glm::mix(Sprite::cam_previous, Sprite::cam_pos, alpha);
+	ecs::ComponentSet<Sprite>::for_each([camera, alpha](Sprite& sprite) {
+		if (!sprite.program || (!sprite.image.valid() && !sprite.tex)) {
+			return;
+		}
+		stats.sprites++;
+		glm::vec2 offset = ecs::get<Position>(sprite.get_id()).interpolated(alpha);
+		if (!in_view(offset, sprite.scale, sprite.screenlock ? glm::vec2(0, 0) : camera)) {
+			stats.culled++;
+			return;
+		}
+		SpriteInstance instance;
+		instance.offset  = offset;
+		instance.scale   = sprite.scale;
+		instance.depth   = sprite.depth;
+		if (sprite.image.valid()) {
+			AtlasRegion const& region = TextureAtlas::region(sprite.image);
+			instance.uv_rect = region.uv_rect;
+			instance.layer   = (float) region.layer;
+		}
+		else {
+			instance.uv_rect = glm::vec4(0, 0, 1, 1);
+			instance.layer   = -1.f;
+		}
+		queue.push_back({ sort_key(sprite), (uint32_t) gathered.size() });
+		gathered.push_back(instance);
+		sprites.push_back(&sprite);
+	});
+
+	// Ties are broken by gathering order, so a frame always draws the same way
+	std::sort(queue.begin(), queue.end(), [](Queued const& lhs, Queued const& rhs) {
+		return (lhs.key < rhs.key) || ((lhs.key == rhs.key) && (lhs.index < rhs.index));
+	});
+}
+
+void SpriteBatch::build_buckets() {
+	uploaded.clear();
+	buckets.clear();
+	for (Queued const& queued : queue) {
+		Sprite& sprite = *sprites[queued.index];
+		Sprite* owner  = sprite.uniform_callback ? &sprite : nullptr;
+		bool same = !buckets.empty()
+			&& (owner == nullptr)
+			&& (buckets.back().owner      == nullptr)
+			&& (buckets.back().program    == sprite.program.get())
+			&& (buckets.back().texture    == own_texture(sprite))
+			&& (buckets.back().screenlock == sprite.screenlock);
+		if (!same) {
+			buckets.push_back({ sprite.program.get(), own_texture(sprite), sprite.screenlock, owner, uploaded.size(), 0 });
+		}
+		buckets.back().count++;
+		uploaded.push_back(gathered[queued.index]);
+	}
+	stats.buckets = buckets.size();
+}
+
+void SpriteBatch::point_instances(size_t first) {
+	GLsizei const stride = sizeof(SpriteInstance);
+	char const* base = reinterpret_cast<char const*>(first * sizeof(SpriteInstance));
+	glVertexAttribPointer(offset_attrib,  2, GL_FLOAT, GL_FALSE, stride, base + offsetof(SpriteInstance, offset));
+	glVertexAttribPointer(scale_attrib,   2, GL_FLOAT, GL_FALSE, stride, base + offsetof(SpriteInstance, scale));
+	glVertexAttribPointer(uv_rect_attrib, 4, GL_FLOAT, GL_FALSE, stride, base + offsetof(SpriteInstance, uv_rect));
+	glVertexAttribPointer(depth_attrib,   1, GL_FLOAT, GL_FALSE, stride, base + offsetof(SpriteInstance, depth));
+	glVertexAttribPointer(layer_attrib,   1, GL_FLOAT, GL_FALSE, stride, base + offsetof(SpriteInstance, layer));
+}
+
+void SpriteBatch::draw(float alpha) {
+#ifndef GLAZY_HEADLESS
+	safety::entry_guard("SpriteBatch::draw");
+	setup();
+	gather(alpha);
+	build_buckets();
+	if (uploaded.empty()) {
+		safety::exit_guard("SpriteBatch::draw");
+		return;
+	}
+	instance_buffer->set_data(uploaded, GL_STREAM_DRAW);
+
+	glm::vec2 camera = glm::mix(Sprite::cam_previous, Sprite::cam_pos, alpha);
+	VAO::BindGuard guard(Sprite::get_vao());
+	// The atlas stays on its own unit for the whole frame, so sprites drawn
+	// from it never cause a texture bind
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, TextureAtlas::texture_id());
+	glActiveTexture(GL_TEXTURE0);
+	glBindBuffer(GL_ARRAY_BUFFER, *instance_buffer);
+
+	// Nothing is assumed to be bound when drawing starts. Uniform values are
+	// kept by their programs, so the handles skip any that are unchanged.
+	size_t uploads_before = UniformTable::uploads();
+	GPUProgram*      program = nullptr;
+	ProgramUniforms* handles = nullptr;
+	Texture*         texture = nullptr;
+	for (Bucket const& bucket : buckets) {
+		if (bucket.program != program) {
+			program = bucket.program;
+			handles = &uniforms_of(program);
+			glUseProgram(*program);
+			handles->tex   = 0;
+			handles->atlas = 1;
+			stats.program_binds++;
+		}
+		if (bucket.texture && (bucket.texture != texture)) {
+			texture = bucket.texture;
+			glBindTexture(GL_TEXTURE_2D, *texture);
+			stats.texture_binds++;
+		}
+		handles->cam_pos = bucket.screenlock ? glm::vec2(0, 0) : camera;
+		if (bucket.owner) {
+			bucket.owner->uniform_callback(bucket.owner->program);
+			// The callback may have bound a buffer of its own
+			glBindBuffer(GL_ARRAY_BUFFER, *instance_buffer);
+		}
+		// GL 4.1 has no base instance for draw calls, so the attributes are
+		// pointed at the bucket's range instead
+		point_instances(bucket.first);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei) bucket.count);
+		stats.draw_calls++;
+	}
+	stats.uniform_uploads = UniformTable::uploads() - uploads_before;
+	safety::exit_guard("SpriteBatch::draw");
+#endif
+}
+
+RenderStats const& SpriteBatch::last_frame() {
+	return stats;
+}
+
+
+bool                             SpriteBatch::is_setup        = false;
+Buffer<SpriteInstance>*          SpriteBatch::instance_buffer = nullptr;
+std::vector<SpriteBatch::Queued> SpriteBatch::queue           = std::vector<SpriteBatch::Queued>();
+std::vector<SpriteInstance>      SpriteBatch::gathered        = std::vector<SpriteInstance>();
+std::vector<Sprite*>             SpriteBatch::sprites         = std::vector<Sprite*>();
+std::vector<SpriteInstance>      SpriteBatch::uploaded        = std::vector<SpriteInstance>();
+std::vector<SpriteBatch::Bucket> SpriteBatch::buckets         = std::vector<SpriteBatch::Bucket>();
+RenderStats                      SpriteBatch::stats           = RenderStats();
+
+std::unordered_map<void const*,SpriteBatch::Slot> SpriteBatch::slots = std::unordered_map<void const*,SpriteBatch::Slot>();
+std::vector<uint64_t>            SpriteBatch::free_slots      = std::vector<uint64_t>();
+std::unordered_map<GPUProgram*,SpriteBatch::ProgramUniforms> SpriteBatch::uniforms = std::unordered_map<GPUProgram*,SpriteBatch::ProgramUniforms>();
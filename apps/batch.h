@@ -0,0 +1,118 @@
+#ifndef BATCH
+#define BATCH
+
+#include "components.h"
+#include "glazy_uniform.h"
+
+
+// The per-instance data of one sprite, laid out to match the instance
+// attributes read by the sprite shaders
+struct SpriteInstance {
+	glm::vec2 offset;
+	glm::vec2 scale;
+	// The minimum corner of the sprite's region of its texture, then its size
+	glm::vec4 uv_rect;
+	float     depth;
+	// The sprite's atlas layer, or -1 for a sprite with its own texture
+	float     layer;
+};
+
+
+// Counts for the last frame drawn
+struct RenderStats {
+	size_t sprites;
+	size_t culled;
+	size_t buckets;
+	size_t draw_calls;
+	size_t program_binds;
+	size_t texture_binds;
+	size_t uniform_uploads;
+};
+
+
+// Draws every visible sprite with one instanced call per bucket, rather than
+// one call per sprite. Sprites share a bucket if they use the same program
+// and texture and are either all locked to the screen or all not. Sprites
+// drawn from the atlas count as having no texture of their own, since the
+// atlas stays bound on texture unit 1 for the whole frame. A sprite with a
+// uniform callback gets a bucket of its own, since the callback may set
+// uniforms that only apply to it.
+//
+// Sprites are queued under a 64 bit sort key, from the most significant bits
+// down: screen lock, program, texture, whether there is a uniform callback,
+// and depth. Sorting the queue puts each bucket in one run and walks state
+// changes in order of cost, so programs and textures are only bound when the
+// key changes, and sprites in a bucket are drawn front to back. Programs and
+// textures are given small slots in the key in the order they are first seen.
+// Two of them can only share a slot once there are more than the key has room
+// for, which costs extra binds but never draws with the wrong state, since
+// buckets are split on the actual program and texture. Slots are held by
+// address, along with a weak pointer to tell whether the object is still
+// alive. The slots and resolved uniforms of destroyed objects are released
+// at the start of each frame, so an object at a reused address never picks
+// up a stale slot, and the slot is handed out again.
+//
+// The instances of every bucket are uploaded in one buffer per frame, and
+// each bucket points the instance attributes at its own range of it.
+class SpriteBatch {
+
+	struct Queued {
+		uint64_t key;
+		uint32_t index;
+	};
+
+	// The uniforms the batch sets itself, resolved once per program
+	struct ProgramUniforms {
+		UniformHandle<GLint>     tex;
+		UniformHandle<GLint>     atlas;
+		UniformHandle<glm::vec2> cam_pos;
+	};
+
+	struct Slot {
+		std::weak_ptr<void const> object;
+		uint64_t                  index;
+	};
+
+	struct Bucket {
+		GPUProgram* program;
+		Texture*    texture;
+		bool        screenlock;
+		Sprite*     owner;
+		size_t      first;
+		size_t      count;
+	};
+
+	static bool is_setup;
+	static Buffer<SpriteInstance>*     instance_buffer;
+	static std::vector<Queued>         queue;
+	static std::vector<SpriteInstance> gathered;
+	static std::vector<Sprite*>        sprites;
+	static std::vector<SpriteInstance> uploaded;
+	static std::vector<Bucket>         buckets;
+	static std::unordered_map<void const*,Slot> slots;
+	static std::vector<uint64_t>       free_slots;
+	static std::unordered_map<GPUProgram*,ProgramUniforms> uniforms;
+	static RenderStats                 stats;
+
+	static void setup();
+	template<typename T>
+	static uint64_t slot(std::shared_ptr<T> const& object);
+	static uint64_t insert_slot(std::shared_ptr<void const> object);
+	static void release_slots();
+	static ProgramUniforms& uniforms_of(GPUProgram* program);
+	static uint64_t sort_key(Sprite const& sprite);
+	static void gather(float alpha);
+	static void build_buckets();
+	static void point_instances(size_t first);
+
+public:
+
+	// Draws every sprite, 'alpha' of the way between the last two
+	// simulation steps
+	static void draw(float alpha);
+	static RenderStats const& last_frame();
+
+};
+
+
+#endif
@@ -1,33 +1,188 @@
-
-
-#include "common.h"
-#include "glazy_program.h"
-
-std::shared_ptr<Texture> TextureCache::load(std::string file_path, bool mipmap) {
-	if (textures.find(file_path) == textures.end()) {
-		textures[file_path] = std::shared_ptr<Texture>(new Texture(file_path, mipmap));
-	}
-	return textures[file_path];
-}
-
-std::unordered_map<std::string, std::shared_ptr<Texture>> TextureCache::textures = std::unordered_map<std::string, std::shared_ptr<Texture>>();
-
-bool      mouse_on_screen;
-glm::vec2 mouse_position;
-std::unordered_map<size_t, std::function<void(glm::vec2)>> mouseclick_callbacks;
-
-
-std::shared_ptr<GPUProgram> ProgramCache::load(std::string vertex, std::string fragment) {
-	std::string key = vertex + '\n' + fragment;
-	if (programs.count(key) == 0) {
-		auto vertex_shader   = Shader<GL_VERTEX_SHADER>::from_file(vertex);
-		auto fragment_shader = Shader<GL_FRAGMENT_SHADER>::from_file(fragment);
-		programs[key] = std::shared_ptr<GPUProgram>(new GPUProgram(vertex_shader, {}, {}, {}, fragment_shader));
-	}
-	return programs[key];
-}
-
-std::unordered_map<std::string, std::shared_ptr<GPUProgram>> ProgramCache::programs = std::unordered_map<std::string, std::shared_ptr<GPUProgram>>();
-
-
-
+
+
+#include "common.h"
+#include "glazy_program.h"
+#include "glazy_uniform.h"
+
+// FNV-1a, as used for uniform names
+uint32_t AssetIds::hash(std::string_view name) {
+	uint32_t result = 2166136261u;
+	for (char c : name) {
+		result ^= static_cast<unsigned char>(c);
+		result *= 16777619u;
+	}
+	return result;
+}
+
+AssetId AssetIds::find_locked(std::string_view name, uint32_t code) {
+	if (slots.empty()) {
+		return none;
+	}
+	size_t mask = slots.size() - 1;
+	for (size_t slot = code & mask; slots[slot] != none; slot = (slot + 1) & mask) {
+		AssetId id = slots[slot];
+		if ((hashes[id] == code) && (names[id] == name)) {
+			return id;
+		}
+	}
+	return none;
+}
+
+AssetId AssetIds::find(std::string_view name) {
+	uint32_t code = hash(name);
+	std::shared_lock<std::shared_mutex> lock(mutex);
+	return find_locked(name, code);
+}
+
+AssetId AssetIds::intern(std::string_view name) {
+	uint32_t code = hash(name);
+	{
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		AssetId id = find_locked(name, code);
+		if (id != none) {
+			return id;
+		}
+	}
+	std::unique_lock<std::shared_mutex> lock(mutex);
+	// Another thread may have added the name while the lock was released
+	AssetId id = find_locked(name, code);
+	if (id != none) {
+		return id;
+	}
+	id = (AssetId) names.size();
+	names.emplace_back(name);
+	hashes.push_back(code);
+	// Keeping the table at most half full keeps probe runs short
+	if (slots.size() < names.size() * 2) {
+		slots.assign(std::max<size_t>(slots.size() * 2, 64), none);
+		for (AssetId existing = 0; existing < names.size(); existing++) {
+			size_t mask = slots.size() - 1;
+			size_t slot = hashes[existing] & mask;
+			while (slots[slot] != none) {
+				slot = (slot + 1) & mask;
+			}
+			slots[slot] = existing;
+		}
+	}
+	else {
+		size_t mask = slots.size() - 1;
+		size_t slot = code & mask;
+		while (slots[slot] != none) {
+			slot = (slot + 1) & mask;
+		}
+		slots[slot] = id;
+	}
+	return id;
+}
+
+// The deque never moves its strings, so the reference outlives the lock
+std::string const& AssetIds::name(AssetId id) {
+	std::shared_lock<std::shared_mutex> lock(mutex);
+	return names[id];
+}
+
+
+std::shared_ptr<Texture> TextureCache::load(std::string_view file_path, bool mipmap) {
+	return load(AssetIds::intern(file_path), mipmap);
+}
+
+// Headless builds have no GL context, so assets are never loaded and
+// sprites are left without textures or programs
+std::shared_ptr<Texture> TextureCache::load(AssetId file_path, bool mipmap) {
+	{
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		if ((file_path < textures.size()) && textures[file_path].loaded) {
+			return textures[file_path].texture;
+		}
+	}
+	std::unique_lock<std::shared_mutex> lock(mutex);
+	if (file_path >= textures.size()) {
+		textures.resize((size_t) file_path + 1, Entry{ false, nullptr });
+	}
+	Entry& entry = textures[file_path];
+	if (!entry.loaded) {
+#ifndef GLAZY_HEADLESS
+		entry.texture = std::shared_ptr<Texture>(new Texture(AssetIds::name(file_path), mipmap));
+#endif
+		entry.loaded = true;
+	}
+	return entry.texture;
+}
+
+std::shared_ptr<Texture> TextureCache::find(AssetId file_path) {
+	std::shared_lock<std::shared_mutex> lock(mutex);
+	if (file_path < textures.size()) {
+		return textures[file_path].texture;
+	}
+	return nullptr;
+}
+
+AssetId const AssetIds::none;
+
+std::shared_mutex       AssetIds::mutex;
+std::deque<std::string> AssetIds::names  = std::deque<std::string>();
+std::vector<uint32_t>   AssetIds::hashes = std::vector<uint32_t>();
+std::vector<AssetId>    AssetIds::slots  = std::vector<AssetId>();
+
+std::shared_mutex                 TextureCache::mutex;
+std::vector<TextureCache::Entry>  TextureCache::textures = std::vector<TextureCache::Entry>();
+
+bool      mouse_on_screen;
+glm::vec2 mouse_position;
+std::unordered_map<size_t, std::function<void(glm::vec2)>> mouseclick_callbacks;
+
+
+namespace {
+
+	// A program's uniform table goes with it, so a later program that is
+	// given the same id never finds a stale one
+	void delete_program(GPUProgram* program) {
+		UniformTable::release(*program);
+		delete program;
+	}
+
+}
+
+
+std::shared_ptr<GPUProgram> ProgramCache::load(std::string_view vertex, std::string_view fragment) {
+	return load(AssetIds::intern(vertex), AssetIds::intern(fragment));
+}
+
+std::shared_ptr<GPUProgram> ProgramCache::load(AssetId vertex, AssetId fragment) {
+	uint64_t key = ((uint64_t) vertex << 32) | fragment;
+	{
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		auto found = programs.find(key);
+		if (found != programs.end()) {
+			return found->second;
+		}
+	}
+	std::unique_lock<std::shared_mutex> lock(mutex);
+	auto found = programs.find(key);
+	if (found != programs.end()) {
+		return found->second;
+	}
+	// Only a program that compiled is cached, so a failed load throws again
+	// next time rather than handing out null
+	std::shared_ptr<GPUProgram> program;
+#ifndef GLAZY_HEADLESS
+	auto vertex_shader   = Shader<GL_VERTEX_SHADER>::from_file(AssetIds::name(vertex));
+	auto fragment_shader = Shader<GL_FRAGMENT_SHADER>::from_file(AssetIds::name(fragment));
+	program = std::shared_ptr<GPUProgram>(new GPUProgram(vertex_shader, {}, {}, {}, fragment_shader), delete_program);
+#endif
+	programs.emplace(key, program);
+	return program;
+}
+
+std::shared_ptr<GPUProgram> ProgramCache::find(AssetId vertex, AssetId fragment) {
+	uint64_t key = ((uint64_t) vertex << 32) | fragment;
+	std::shared_lock<std::shared_mutex> lock(mutex);
+	auto found = programs.find(key);
+	return (found != programs.end()) ? found->second : nullptr;
+}
+
+std::shared_mutex ProgramCache::mutex;
+std::unordered_map<uint64_t, std::shared_ptr<GPUProgram>> ProgramCache::programs = std::unordered_map<uint64_t, std::shared_ptr<GPUProgram>>();
+
+
+
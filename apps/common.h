@@ -1,57 +1,101 @@
-#ifndef COMMON
-#define COMMON
-
-#include <glm/ext/matrix_transform.hpp>
-#include <glm/ext/matrix_clip_space.hpp>
-#include <glad.h>
-#include <glfw3.h>
-
-#include <cmath>
-
-#include "glazy.h"
-#include "shape.h"
-#include <vector>
-#include <unordered_map>
-#include <unordered_set>
-#include <cstdint>
-#include <algorithm>
-#include <thread>
-#include <atomic>
-#include <limits>
-#include <sstream>
-
-
-
-using namespace glazy;
-
-
-template<typename T>
-std::string serialize(T obj);
-
-template<typename T>
-T* deserialize(std::string text) {
-	return nullptr;
-}
-
-extern std::unordered_map<size_t, std::function<void(glm::vec2)>> mouseclick_callbacks;
-
-class TextureCache {
-	static std::unordered_map<std::string, std::shared_ptr<Texture>> textures;
-public:
-	static std::shared_ptr<Texture> load(std::string file_path, bool mipmap);
-};
-
-
-
-class ProgramCache {
-	static std::unordered_map<std::string, std::shared_ptr<GPUProgram>> programs;
-public:
-
-	static std::shared_ptr<GPUProgram> load(std::string vertex, std::string fragment);
-};
-
-
-extern bool      mouse_on_screen;
-extern glm::vec2 mouse_position;
-
-#endif
+#ifndef COMMON
+#define COMMON
+
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glad.h>
+#include <glfw3.h>
+
+#include <cmath>
+
+#include "glazy.h"
+#include "shape.h"
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <limits>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <string_view>
+
+
+
+using namespace glazy;
+
+
+template<typename T>
+std::string serialize(T obj);
+
+template<typename T>
+T* deserialize(std::string text) {
+	return nullptr;
+}
+
+extern std::unordered_map<size_t, std::function<void(glm::vec2)>> mouseclick_callbacks;
+
+typedef uint32_t AssetId;
+
+// Gives every distinct asset name a small id the first time it is seen, so
+// caches can be indexed by id instead of hashing strings. Names are hashed
+// in place from a string_view, so a lookup never allocates. Lookups share a
+// lock and may run on any thread; only a new name takes it exclusively.
+class AssetIds {
+	static std::shared_mutex       mutex;
+	static std::deque<std::string> names;
+	static std::vector<uint32_t>   hashes;
+	static std::vector<AssetId>    slots;
+
+	static uint32_t hash(std::string_view name);
+	static AssetId find_locked(std::string_view name, uint32_t code);
+public:
+	static AssetId const none = 0xFFFFFFFFu;
+
+	static AssetId intern(std::string_view name);
+	// Returns 'none' for a name that was never interned
+	static AssetId find(std::string_view name);
+	static std::string const& name(AssetId id);
+};
+
+
+// Loading creates GL objects, so it must happen on the GL thread. find()
+// never loads, and can be called from any thread.
+class TextureCache {
+	struct Entry {
+		bool loaded;
+		std::shared_ptr<Texture> texture;
+	};
+	static std::shared_mutex   mutex;
+	static std::vector<Entry>  textures;
+public:
+	static std::shared_ptr<Texture> load(std::string_view file_path, bool mipmap);
+	static std::shared_ptr<Texture> load(AssetId file_path, bool mipmap);
+	// Returns null if the texture has not been loaded
+	static std::shared_ptr<Texture> find(AssetId file_path);
+};
+
+
+
+// Programs are keyed by the ids of both shader paths, so no key string is
+// built per call
+class ProgramCache {
+	static std::shared_mutex mutex;
+	static std::unordered_map<uint64_t, std::shared_ptr<GPUProgram>> programs;
+public:
+
+	static std::shared_ptr<GPUProgram> load(std::string_view vertex, std::string_view fragment);
+	static std::shared_ptr<GPUProgram> load(AssetId vertex, AssetId fragment);
+	// Returns null if the program has not been loaded
+	static std::shared_ptr<GPUProgram> find(AssetId vertex, AssetId fragment);
+};
+
+
+extern bool      mouse_on_screen;
+extern glm::vec2 mouse_position;
+
+#endif
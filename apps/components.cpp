@@ -1,367 +1,1282 @@
-
-#include "components.h"
-
-
-
-Position::operator glm::vec3& () {
-	return position;
-}
-	
-Position::Position(size_t id)
-	: Component(id)
-	, position(0.f,0.f,0.f)
-{}
-
-Position::Position(size_t id, glm::vec2 position)
-	: Component(id)
-	, position(position,0.f)
-{}
-
-Position::Position(size_t id, glm::vec3 position)
-	: Component(id)
-	, position(position)
-{}
-
-
-CollisionMap::CollisionMap()
-	: scale(1.f)
-	, dims(0,0)
-	, offset(0,0)
-	, buckets()
-{}
-
-void CollisionMap::clear() {
-	for (auto& bucket : buckets) {
-		bucket.resize(0);
-	}
-}
-
-std::vector<Physics*>* CollisionMap::bucket_at(glm::ivec2 position) {
-	int y_index = position.y - offset.y;
-	if ((y_index < 0) || (y_index >= dims.y)) {
-		return nullptr;
-	}
-	int x_index = position.x - offset.x;
-	if ((x_index < 0) || (x_index >= dims.x)) {
-		return nullptr;
-	}
-	return &buckets[y_index * dims.x + x_index];
-}
-
-void CollisionMap::mark(glm::ivec2 minima, glm::ivec2 maxima, Physics* marker) {
-	for (int y = minima.y; y <= maxima.y; y++) {
-		for (int x = minima.x; x <= maxima.x; x++) {
-			std::vector<Physics*> *bucket = bucket_at({ x,y });
-			if (bucket == nullptr) {
-				continue;
-			}
-			bucket->push_back(marker);
-		}
-	}
-}
-
-
-void CollisionMap::configure(float scale, glm::ivec2 dims, glm::ivec2 offset) {
-	this->scale = scale;
-	this->offset = offset;
-	this->dims = dims;
-	buckets.resize(dims.x * dims.y);
-	clear();
-}
-
-
-
-
-
-Physics::Physics(size_t id)
-	: Component(id)
-	, velocity(0.f,0.f)
-	, bbox_dims(0.f,0.f)
-	, fixed(false)
-	, solid(true)
-	, has_drag(true)
-{}
-
-
-bool Physics::collides(Physics& other, glm::vec2& normal) {
-
-	// Get relative offset
-	glm::vec3& pos = ecs::get<Position>(id);
-	glm::vec3& other_pos = ecs::get<Position>(other.id);
-	glm::vec2 offset = pos - other_pos;
-	glm::vec2 abs_offset = glm::abs(offset);
-
-	// Determine if a collision has occurred
-	glm::bvec2 collide = glm::lessThanEqual(abs_offset, (other.bbox_dims + bbox_dims));
-	if (!glm::all(collide)) {
-		return false;
-	}
-
-	normal = glm::vec2(0, 0);
-	if (abs(offset.y) < glm::max(bbox_dims.y,other.bbox_dims.y)) {
-		normal.x = (offset.x > 0) ? 1.f : -1.f;
-	}
-	if (abs(offset.x) < glm::max(bbox_dims.x,other.bbox_dims.x)) {
-		normal.y = (offset.y > 0) ? 1.f : -1.f;
-	}
-	return true;
-}
-
-void Physics::resolve_collision(Physics& other, glm::vec2 normal) {
-	glm::vec3& pos = ecs::get<Position>(id);
-	glm::vec3& other_pos = ecs::get<Position>(other.id);
-	glm::vec2 normal_mask = glm::abs(normal);
-	glm::vec2 tangent_mask = glm::vec2(1, 1) - normal_mask;
-	glm::vec2 relative_velocity = velocity - other.velocity;
-	glm::vec2 position_restitution = ((bbox_dims+other.bbox_dims) - glm::vec2(glm::abs(pos - other_pos))) * normal;
-	glm::vec2 velocity_restitution = (glm::abs(relative_velocity) * normal) * 2.f;
-	glm::vec2 friction_force = -relative_velocity * tangent_mask * 0.1f;
-	if (glm::dot(relative_velocity, normal) > 0 ) {
-		velocity_restitution = glm::vec2(0,0);
-	}
-	float weight       = 0.5;
-	float other_weight = 0.5;
-	if (other.fixed) {
-		other_weight = 0;
-		weight = 1;
-	}
-	else if (fixed) {
-		other_weight = 1;
-		weight = 0;
-	}
-	velocity += (velocity_restitution+friction_force) * weight;
-	pos      += glm::vec3(position_restitution * weight,0.f);
-	other.velocity -= (velocity_restitution+friction_force) * other_weight;
-	other_pos      -= glm::vec3(position_restitution * other_weight,0.f);
-}
-
-void Physics::delta_update(float delta) {
-
-	if (!fixed) {
-		velocity.y -= gravity;
-		
-		// update position based upon velocity
-		if (has_drag) {
-			velocity *= pow(drag,delta);
-		}
-		glm::vec3& pos = ecs::get<Position>(id);
-		pos += glm::vec3(velocity * delta,0.f);
-	}
-
-	std::vector<Physics*> collision_record;
-	collision_record.reserve(100);
-
-	glm::vec3& pos = ecs::get<Position>(id);
-	glm::ivec2 minima  = glm::floor( (glm::vec2(pos) - bbox_dims) / collision_map.scale);
-	glm::ivec2 maxima = glm::ceil( (glm::vec2(pos) + bbox_dims) / collision_map.scale);
-	for (int y = minima.y; y <= maxima.y; y++) {
-		for (int x = minima.x; x <= maxima.x; x++) {
-			glm::ivec2 const pos(x, y);
-			std::vector<Physics*>* bucket_ptr = collision_map.bucket_at(pos);
-			if (bucket_ptr == nullptr) {
-				continue;
-			}
-			for (Physics *other_ptr : *bucket_ptr) {
-				Physics& other = *other_ptr;
-				glm::vec2 normal;
-				bool visited = false;
-				if (other.id <= id) {
-					continue;
-				}
-				for (auto visit_id : collision_record) {
-					if (visit_id == &other) {
-						visited = true;
-					}
-				}
-				if (visited) {
-					continue;
-				}
-				else {
-					collision_record.push_back(&other);
-				}
-				if (collides(other, normal)) {
-					for (auto& fn : on_collide) {
-						fn(other.id);
-					}
-					for (auto& fn : other.on_collide) {
-						fn(id);
-					}
-					if (fixed && other.fixed) {
-						continue;
-					}
-					if ((!solid) || (!other.solid)) {
-						continue;
-					}
-					resolve_collision(other, normal);
-				}
-			}
-		}
-	}
-
-}
-
-void Physics::update_collision_map() {
-	collision_map.clear();
-	ecs::ComponentSet<Physics>::for_each(
-		[](Physics& phys) {
-			if ( (!phys.solid) && (phys.on_collide.empty()) ){
-				return;
-			}
-			glm::vec3& pos = ecs::get<Position>(phys.id);
-			glm::ivec2 minima = glm::floor( (glm::vec2(pos) - phys.bbox_dims) / collision_map.scale );
-			glm::ivec2 maxima = glm::ceil( (glm::vec2(pos) + phys.bbox_dims) / collision_map.scale );
-			collision_map.mark(minima, maxima, &phys);
-		}
-	);
-	//for (auto pair : collision_map) {
-	//	printf("(%d,%d) %d", pair.first.x, pair.first.y, pair.second.size());
-	//}
-}
-
-void Physics::set_drag(float new_drag) {
-	drag = new_drag;
-}
-
-void Physics::set_gravity(float new_gravity) {
-	gravity = new_gravity;
-}
-
-
-
-float Physics::drag    = 1;
-float Physics::gravity = 0;
-CollisionMap Physics::collision_map = CollisionMap();
-
-
-
-void Sprite::setup() {
-	if (is_setup) {
-		return;
-	}
-	vao     = new VAO;
-	pos     = new Buffer<glm::vec3>;
-	uv      = new Buffer<glm::vec2>;
-
-	std::vector<glm::vec3> const quad_pos_cpu = {
-		{-1.0,-1.0,0.0}, {1.0,1.0,0.0}, {1.0,-1.0,0.0},
-		{-1.0,-1.0,0.0}, {-1.0,1.0,0.0}, {1.0,1.0,0.0},
-	};
-
-	// The texture positions of the quad's vertexes
-	std::vector<glm::vec2> const quad_uv_cpu = {
-		{0.0,1.0}, {1.0,0.0}, {1.0,1.0},
-		{0.0,1.0}, {0.0,0.0}, {1.0,0.0},
-	};
-
-	VAO::BindGuard guard(*vao);
-
-	pos->set_data(quad_pos_cpu,GL_STATIC_DRAW);
-	uv ->set_data(quad_uv_cpu,GL_STATIC_DRAW);
-
-	(*vao)[0].enable();
-	(*vao)[0] = *pos;
-	(*vao)[1].enable();
-	(*vao)[1] = *uv;
-
-}
-
-
-
-Sprite::Sprite(size_t id,std::shared_ptr<Texture> tex, glm::vec2 scale)
-	: Component(id)
-	, tex(tex)
-	, scale(scale)
-	, program(ProgramCache::load("shaders/sprite.vert","shaders/sprite.frag"))
-	, screenlock(false)
-{
-	setup();
-}
-
-Sprite::Sprite(size_t id,std::shared_ptr<Texture> tex, glm::vec2 scale, std::shared_ptr<GPUProgram> program)
-	: Component(id)
-	, tex(tex)
-	, scale(scale)
-	, program(program)
-{
-	setup();
-}
-
-Sprite::Sprite(
-	size_t id,
-	std::shared_ptr<Texture> tex,
-	glm::vec2 scale,
-	std::shared_ptr<GPUProgram> program,
-	std::function<void(std::shared_ptr<GPUProgram>)> uniform_callback
-)
-	: Component(id)
-	, tex(tex)
-	, scale(scale)
-	, program(program)
-	, uniform_callback(uniform_callback)
-{
-	setup();
-}
-
-void Sprite::fixed_update() {
-	glm::vec2 pos = ecs::get<Position>(id).position;
-	glBindTexture(GL_TEXTURE_2D, *tex);
-	glUseProgram(*program);
-	(*program)["offset"] = pos;
-	(*program)["depth"]  = depth;
-	(*program)["scale"]  = scale;
-	(*program)["tex"]    = 0;
-	if (screenlock) {
-		(*program)["cam_pos"]= glm::vec2(0,0);
-	}
-	else {
-		(*program)["cam_pos"]= cam_pos;
-	}
-	if (uniform_callback) {
-		uniform_callback(program);
-	}
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-}
-
-GPUProgram &Sprite::get_program() {
-	return *program;
-}
-
-VAO &Sprite::get_vao() {
-	return *vao;
-}
-
-bool               Sprite::is_setup = false;
-VAO               *Sprite::vao      = nullptr;
-Buffer<glm::vec3> *Sprite::pos      = nullptr;
-Buffer<glm::vec2> *Sprite::uv       = nullptr;
-glm::vec2          Sprite::cam_pos  = glm::vec2(0, 0);
-
-
-AI::AI (size_t id, void(*d_update)(size_t,float,void*),void* data)
-	: Component(id)
-	, d_update(d_update)
-	, data(data)
-{}
-
-void AI::delta_update(float delta) {
-	d_update(id,delta,data);
-}
-
-
-
-Status::Status(int id, int health, int armor)
-	: Component(id)
-	, health(health)
-	, armor(armor)
-	, alignment(NEUTRAL)
-{}
-
-
-// Make the sets for our component types exist	
-template<> std::vector<ecs::ComponentSet<Position>::Entry> ecs::ComponentSet<Position> ::data = std::vector<ecs::ComponentSet<Position>::Entry>();
-template<> std::vector<ecs::ComponentSet<Physics>::Entry>  ecs::ComponentSet<Physics> ::data = std::vector<ecs::ComponentSet<Physics>::Entry>();
-template<> std::vector<ecs::ComponentSet<Sprite>::Entry>   ecs::ComponentSet<Sprite>  ::data = std::vector<ecs::ComponentSet<Sprite>::Entry>();
-template<> std::vector<ecs::ComponentSet<AI>::Entry>       ecs::ComponentSet<AI>      ::data = std::vector<ecs::ComponentSet<AI>::Entry>();
-template<> std::vector<ecs::ComponentSet<Status>::Entry>   ecs::ComponentSet<Status>  ::data = std::vector<ecs::ComponentSet<Status>::Entry>();
-
-
+
+#include "components.h"
+#include "jobs.h"
+#include "spatial.h"
+
+#include <chrono>
+
+
+
+Position::operator glm::vec3& () {
+	return position;
+}
+	
+Position::Position(size_t id)
+	: Component(id)
+	, position(0.f,0.f,0.f)
+	, previous(0.f,0.f,0.f)
+	, stamp(0)
+{}
+
+Position::Position(size_t id, glm::vec2 position)
+	: Component(id)
+	, position(position,0.f)
+	, previous(position,0.f)
+	, stamp(0)
+{}
+
+Position::Position(size_t id, glm::vec3 position)
+	: Component(id)
+	, position(position)
+	, previous(position)
+	, stamp(0)
+{}
+
+glm::vec3 Position::interpolated(float alpha) const {
+	if (stamp != step_count) {
+		return position;
+	}
+	return glm::mix(previous, position, alpha);
+}
+
+// Meant to be called at the start of every simulation step
+void Position::store_previous() {
+	step_count++;
+	ecs::ComponentSet<Position>::for_each(
+		[](Position& pos) {
+			pos.previous = pos.position;
+			pos.stamp    = step_count;
+		}
+	);
+}
+
+size_t Position::step_count = 0;
+
+
+uint32_t const* CellSpan::begin() const {
+	return first;
+}
+
+uint32_t const* CellSpan::end() const {
+	return last;
+}
+
+size_t CellSpan::size() const {
+	return last - first;
+}
+
+bool CellSpan::empty() const {
+	return first == last;
+}
+
+
+// Orders pairs by body index, which keeps pair lists independent of the
+// order in which a broad phase happened to find them
+static bool pair_order(BodyPair const& lhs, BodyPair const& rhs) {
+	return (lhs.a < rhs.a) || ((lhs.a == rhs.a) && (lhs.b < rhs.b));
+}
+
+// Bodies that can neither be pushed nor be told about a contact are left
+// out of the broad phase entirely
+static bool in_broad_phase(Physics const& phys) {
+	return phys.solid || (!phys.on_collide.empty());
+}
+
+
+CollisionMap::CollisionMap()
+	: scale(1.f)
+	, dims(0,0)
+	, offset(0,0)
+	, cell_starts(1, 0)
+	, entries()
+{}
+
+void CollisionMap::clear() {
+	std::fill(cell_starts.begin(), cell_starts.end(), 0);
+	entries.clear();
+}
+
+CellSpan CollisionMap::bucket_at(glm::ivec2 position) const {
+	int y_index = position.y - offset.y;
+	int x_index = position.x - offset.x;
+	if ((y_index < 0) || (y_index >= dims.y) || (x_index < 0) || (x_index >= dims.x)) {
+		return CellSpan{ nullptr, nullptr };
+	}
+	size_t cell = y_index * dims.x + x_index;
+	uint32_t const* base = entries.data();
+	return CellSpan{ base + cell_starts[cell], base + cell_starts[cell + 1] };
+}
+
+CellRect CollisionMap::cells_covered(glm::vec2 center, glm::vec2 half_dims) const {
+	glm::ivec2 minima = glm::floor( (center - half_dims) / scale );
+	glm::ivec2 maxima = glm::ceil( (center + half_dims) / scale );
+	return CellRect{ minima, maxima };
+}
+
+// Maps the bodies in [first,last)
+void CollisionMap::rebuild(std::vector<CellRect> const& rects, std::vector<uint8_t> const& included, size_t first, size_t last) {
+	std::fill(cell_starts.begin(), cell_starts.end(), 0);
+	size_t const cell_count = cell_starts.size() - 1;
+
+	// Clip a rect to the grid, returning false if nothing is left
+	auto clip = [this](CellRect rect, glm::ivec2& lo, glm::ivec2& hi) {
+		lo = glm::max(rect.minima - offset, glm::ivec2(0, 0));
+		hi = glm::min(rect.maxima - offset, dims - glm::ivec2(1, 1));
+		return (lo.x <= hi.x) && (lo.y <= hi.y);
+	};
+
+	// Pass one: count entries per cell
+	glm::ivec2 lo, hi;
+	for (size_t i = first; i < last; i++) {
+		if (!included[i] || !clip(rects[i], lo, hi)) {
+			continue;
+		}
+		for (int y = lo.y; y <= hi.y; y++) {
+			for (int x = lo.x; x <= hi.x; x++) {
+				cell_starts[y * dims.x + x]++;
+			}
+		}
+	}
+
+	// Inclusive prefix sum, so each cell holds the end of its range
+	for (size_t cell = 1; cell < cell_count; cell++) {
+		cell_starts[cell] += cell_starts[cell - 1];
+	}
+	cell_starts[cell_count] = (cell_count > 0) ? cell_starts[cell_count - 1] : 0;
+	entries.resize(cell_starts[cell_count]);
+
+	// Pass two: scatter back to front, decrementing each cell's end until it
+	// becomes the cell's start. Walking the rects in reverse keeps every cell's
+	// entries in ascending order.
+	for (size_t i = last; i-- > first; ) {
+		if (!included[i] || !clip(rects[i], lo, hi)) {
+			continue;
+		}
+		for (int y = lo.y; y <= hi.y; y++) {
+			for (int x = lo.x; x <= hi.x; x++) {
+				entries[--cell_starts[y * dims.x + x]] = (uint32_t) i;
+			}
+		}
+	}
+}
+
+
+void CollisionMap::configure(float scale, glm::ivec2 dims, glm::ivec2 offset) {
+	this->scale = scale;
+	this->offset = offset;
+	this->dims = dims;
+	cell_starts.resize(dims.x * dims.y + 1);
+	clear();
+}
+
+
+SweepAndPrune::SweepAndPrune()
+	: order()
+	, entries()
+	, slots()
+	, fixed_entries()
+	, fixed_reach(0.f)
+{}
+
+void SweepAndPrune::clear() {
+	order.clear();
+	entries.clear();
+	slots.clear();
+	fixed_entries.clear();
+	fixed_reach = 0.f;
+}
+
+void SweepAndPrune::set_fixed(std::vector<SweepEntry> const& bounds) {
+	fixed_entries = bounds;
+	std::stable_sort(fixed_entries.begin(), fixed_entries.end(), [](SweepEntry const& lhs, SweepEntry const& rhs) {
+		return lhs.minima.x < rhs.minima.x;
+	});
+	fixed_reach = 0.f;
+	for (SweepEntry const& entry : fixed_entries) {
+		fixed_reach = std::max(fixed_reach, entry.maxima.x - entry.minima.x);
+	}
+}
+
+void SweepAndPrune::find_pairs(std::vector<SweepEntry> const& bounds, std::vector<BodyPair>& pairs) {
+	// Carry over last step's order for bodies that still exist, then append
+	// the new ones. Each body is removed from 'slots' once placed, so
+	// whatever is left afterwards is new.
+	slots.clear();
+	for (size_t k = 0; k < bounds.size(); k++) {
+		slots.emplace(bounds[k].id, (uint32_t) k);
+	}
+	entries.clear();
+	for (size_t id : order) {
+		uint32_t const* slot = slots.find(id);
+		if (slot != nullptr) {
+			entries.push_back(bounds[*slot]);
+			slots.remove(id);
+		}
+	}
+	size_t const carried = entries.size();
+	for (SweepEntry const& entry : bounds) {
+		if (slots.has(entry.id)) {
+			entries.push_back(entry);
+		}
+	}
+
+	// Insertion sort the carried bodies, which are nearly in order already,
+	// and merge in the new ones, which may be in any order (such as every
+	// body on the first step)
+	auto left_edge = [](SweepEntry const& lhs, SweepEntry const& rhs) {
+		return lhs.minima.x < rhs.minima.x;
+	};
+	for (size_t i = 1; i < carried; i++) {
+		SweepEntry entry = entries[i];
+		size_t j = i;
+		while ((j > 0) && left_edge(entry, entries[j - 1])) {
+			entries[j] = entries[j - 1];
+			j--;
+		}
+		entries[j] = entry;
+	}
+	std::stable_sort(entries.begin() + carried, entries.end(), left_edge);
+	std::inplace_merge(entries.begin(), entries.begin() + carried, entries.end(), left_edge);
+	order.resize(entries.size());
+	for (size_t i = 0; i < entries.size(); i++) {
+		order[i] = entries[i].id;
+	}
+
+	// Sweep: only bodies starting before this one's right edge can overlap it.
+	// A fixed body overlapping it must also start no further left than its
+	// left edge minus the widest fixed body, which bounds the search there.
+	static std::vector<std::vector<BodyPair>> block_pairs;
+	size_t const block_size  = 256;
+	size_t const block_count = (entries.size() + block_size - 1) / block_size;
+	if (block_pairs.size() < block_count) {
+		block_pairs.resize(block_count);
+	}
+	JobPool::parallel_for(entries.size(), block_size, [this, block_size, left_edge](size_t begin, size_t end) {
+		std::vector<BodyPair>& found = block_pairs[begin / block_size];
+		found.clear();
+		for (size_t i = begin; i < end; i++) {
+			SweepEntry const& self = entries[i];
+			for (size_t j = i + 1; (j < entries.size()) && (entries[j].minima.x <= self.maxima.x); j++) {
+				SweepEntry const& other = entries[j];
+				if ((other.minima.y > self.maxima.y) || (other.maxima.y < self.minima.y)) {
+					continue;
+				}
+				if (self.id < other.id) {
+					found.push_back({ self.body, other.body });
+				}
+				else {
+					found.push_back({ other.body, self.body });
+				}
+			}
+			SweepEntry probe = self;
+			probe.minima.x = self.minima.x - fixed_reach;
+			auto fixed = std::lower_bound(fixed_entries.begin(), fixed_entries.end(), probe, left_edge);
+			for (; (fixed != fixed_entries.end()) && (fixed->minima.x <= self.maxima.x); fixed++) {
+				if ((fixed->maxima.x < self.minima.x) || (fixed->minima.y > self.maxima.y) || (fixed->maxima.y < self.minima.y)) {
+					continue;
+				}
+				if (self.id < fixed->id) {
+					found.push_back({ self.body, fixed->body });
+				}
+				else {
+					found.push_back({ fixed->body, self.body });
+				}
+			}
+		}
+	});
+	pairs.clear();
+	for (size_t block = 0; block < block_count; block++) {
+		pairs.insert(pairs.end(), block_pairs[block].begin(), block_pairs[block].end());
+	}
+	std::sort(pairs.begin(), pairs.end(), pair_order);
+}
+
+
+
+
+
+Physics::Physics(size_t id)
+	: Component(id)
+	, velocity(0.f,0.f)
+	, bbox_dims(0.f,0.f)
+	, fixed(false)
+	, solid(true)
+	, has_drag(true)
+	, continuous(false)
+	, swept_from(0.f,0.f)
+{}
+
+Physics::Physics(size_t id, glm::vec2 bbox_dims, bool fixed)
+	: Physics(id)
+{
+	this->bbox_dims = bbox_dims;
+	this->fixed     = fixed;
+}
+
+
+bool Physics::collides(Physics& other, glm::vec2& normal) {
+
+	// Get relative offset
+	glm::vec3& pos = ecs::get<Position>(id);
+	glm::vec3& other_pos = ecs::get<Position>(other.id);
+	glm::vec2 offset = pos - other_pos;
+	glm::vec2 abs_offset = glm::abs(offset);
+
+	// Determine if a collision has occurred
+	glm::bvec2 collide = glm::lessThanEqual(abs_offset, (other.bbox_dims + bbox_dims));
+	if (!glm::all(collide)) {
+		return false;
+	}
+
+	normal = glm::vec2(0, 0);
+	if (abs(offset.y) < glm::max(bbox_dims.y,other.bbox_dims.y)) {
+		normal.x = (offset.x > 0) ? 1.f : -1.f;
+	}
+	if (abs(offset.x) < glm::max(bbox_dims.x,other.bbox_dims.x)) {
+		normal.y = (offset.y > 0) ? 1.f : -1.f;
+	}
+	return true;
+}
+
+void Physics::resolve_collision(Physics& other, glm::vec2 normal) {
+	glm::vec3& pos = ecs::get<Position>(id);
+	glm::vec3& other_pos = ecs::get<Position>(other.id);
+	glm::vec2 normal_mask = glm::abs(normal);
+	glm::vec2 tangent_mask = glm::vec2(1, 1) - normal_mask;
+	glm::vec2 relative_velocity = velocity - other.velocity;
+	glm::vec2 position_restitution = ((bbox_dims+other.bbox_dims) - glm::vec2(glm::abs(pos - other_pos))) * normal;
+	glm::vec2 velocity_restitution = (glm::abs(relative_velocity) * normal) * 2.f;
+	glm::vec2 friction_force = -relative_velocity * tangent_mask * 0.1f;
+	if (glm::dot(relative_velocity, normal) > 0 ) {
+		velocity_restitution = glm::vec2(0,0);
+	}
+	float weight       = 0.5;
+	float other_weight = 0.5;
+	if (other.fixed) {
+		other_weight = 0;
+		weight = 1;
+	}
+	else if (fixed) {
+		other_weight = 1;
+		weight = 0;
+	}
+	// Fixed bodies are never written, which lets Physics::step share them
+	// between pairs that are resolved concurrently
+	if (weight > 0) {
+		velocity += (velocity_restitution+friction_force) * weight;
+		pos      += glm::vec3(position_restitution * weight,0.f);
+	}
+	if (other_weight > 0) {
+		other.velocity -= (velocity_restitution+friction_force) * other_weight;
+		other_pos      -= glm::vec3(position_restitution * other_weight,0.f);
+	}
+}
+
+// Returns the fraction of this step at which the two bodies first touch, or
+// 1 if they never touch or touched for the whole step.
+// Only continuous bodies are treated as moving; anything else is assumed to
+// have been at its current position for the whole step.
+float Physics::time_of_impact(Physics& other) {
+	glm::vec2 pos       = glm::vec2(ecs::get<Position>(id).position);
+	glm::vec2 other_pos = glm::vec2(ecs::get<Position>(other.id).position);
+	glm::vec2 start       = (continuous && !fixed) ? swept_from : pos;
+	glm::vec2 other_start = (other.continuous && !other.fixed) ? other.swept_from : other_pos;
+
+	// Sweep a point along the relative motion against the combined box
+	glm::vec2 extent = bbox_dims + other.bbox_dims;
+	glm::vec2 from   = start - other_start;
+	glm::vec2 to     = pos - other_pos;
+	glm::vec2 motion = to - from;
+	float enter = -std::numeric_limits<float>::infinity();
+	float leave =  std::numeric_limits<float>::infinity();
+	for (int axis = 0; axis < 2; axis++) {
+		if (motion[axis] == 0.f) {
+			if (std::abs(from[axis]) > extent[axis]) {
+				return 1.f;
+			}
+			continue;
+		}
+		float near_t = (-extent[axis] - from[axis]) / motion[axis];
+		float far_t  = ( extent[axis] - from[axis]) / motion[axis];
+		enter = std::max(enter, std::min(near_t, far_t));
+		leave = std::min(leave, std::max(near_t, far_t));
+	}
+	if ((enter > leave) || (leave < 0.f) || (enter >= 1.f)) {
+		return 1.f;
+	}
+	// Bodies that already touched at the start of the step (for instance
+	// after being pushed into each other) are left alone if they still touch
+	// at the end, and otherwise stopped at the start rather than let through
+	if (enter < 0.f) {
+		if (glm::all(glm::lessThanEqual(glm::abs(to), extent))) {
+			return 1.f;
+		}
+		enter = 0.f;
+	}
+
+	// Stop a hair past the contact, so that the bodies overlap and the usual
+	// collision test picks the contact up despite rounding
+	float const contact_slop = 1e-4f;
+	return std::min(1.f, enter + contact_slop / glm::length(motion));
+}
+
+// The box covered by this body during the current step
+void Physics::bounds(glm::vec2& minima, glm::vec2& maxima) {
+	glm::vec2 center = glm::vec2(ecs::get<Position>(id).position);
+	minima = center - bbox_dims;
+	maxima = center + bbox_dims;
+	if (continuous && !fixed) {
+		minima = glm::min(minima, swept_from - bbox_dims);
+		maxima = glm::max(maxima, swept_from + bbox_dims);
+	}
+}
+
+void Physics::delta_update(float delta) {
+	if (fixed) {
+		return;
+	}
+	velocity.y -= gravity;
+	
+	// update position based upon velocity
+	if (has_drag) {
+		velocity *= pow(drag,delta);
+	}
+	glm::vec3& pos = ecs::get<Position>(id);
+	swept_from = glm::vec2(pos);
+	pos += glm::vec3(velocity * delta,0.f);
+}
+
+
+// A physics step runs in phases so that each one can be spread over the
+// JobPool without changing the result: every body integrates on its own,
+// the broad phase produces candidate pairs sorted by body index, and pairs
+// are then split into batches in which no two pairs share a movable body.
+// Batches run one after another, and the pairs inside a batch touch
+// disjoint state, so the outcome is identical for any thread count.
+void Physics::step(float delta) {
+	gather_bodies();
+	JobPool::parallel_for(bodies.size(), 256, [delta](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			bodies[i]->delta_update(delta);
+		}
+	});
+	if (broad_phase == BroadPhase::sweep) {
+		sweep_pairs();
+	}
+	else {
+		update_collision_map();
+		find_pairs();
+	}
+	batch_pairs();
+	rewind_to_impacts();
+	resolve_pairs();
+
+	// Callbacks may touch arbitrary components, so they run serially, in
+	// pair order, once every contact has been resolved
+	for (size_t k = 0; k < pairs.size(); k++) {
+		if (!pair_hits[k]) {
+			continue;
+		}
+		Physics& self  = *bodies[pairs[k].a];
+		Physics& other = *bodies[pairs[k].b];
+		for (auto& fn : self.on_collide) {
+			fn(other.id);
+		}
+		for (auto& fn : other.on_collide) {
+			fn(self.id);
+		}
+	}
+}
+
+// Gathers fixed bodies first, then moving ones, each in id order. Pointers
+// are taken again every step since component storage may have moved, but
+// the static layer only needs rebuilding if the fixed ids changed.
+void Physics::gather_bodies() {
+	static std::vector<Physics*> moving;
+	static std::vector<size_t>   fixed_ids;
+	bodies.clear();
+	moving.clear();
+	fixed_ids.clear();
+	ecs::ComponentSet<Physics>::for_each(
+		[](Physics& phys) {
+			if (phys.fixed) {
+				bodies.push_back(&phys);
+				fixed_ids.push_back(phys.id);
+			}
+			else {
+				moving.push_back(&phys);
+			}
+		}
+	);
+	static_count = bodies.size();
+	bodies.insert(bodies.end(), moving.begin(), moving.end());
+	if (fixed_ids != static_ids) {
+		static_ids = fixed_ids;
+		static_valid = false;
+	}
+}
+
+void Physics::update_collision_map() {
+	body_cells.resize(bodies.size());
+	body_mapped.resize(bodies.size());
+	auto cover = [](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			Physics& phys = *bodies[i];
+			glm::vec2 minima, maxima;
+			phys.bounds(minima, maxima);
+			body_cells[i]  = collision_map.cells_covered((minima + maxima) * 0.5f, (maxima - minima) * 0.5f);
+			body_mapped[i] = in_broad_phase(phys);
+		}
+	};
+	bool const same_grid = (static_map.scale == collision_map.scale)
+		&& (static_map.dims == collision_map.dims)
+		&& (static_map.offset == collision_map.offset);
+	if (!same_grid) {
+		static_map.configure(collision_map.scale, collision_map.dims, collision_map.offset);
+		static_valid = false;
+	}
+	// Fixed bodies keep their cells in the front of body_cells between steps
+	if (!static_valid) {
+		JobPool::parallel_for(static_count, 256, cover);
+		static_map.rebuild(body_cells, body_mapped, 0, static_count);
+		static_valid = true;
+	}
+	JobPool::parallel_for(bodies.size() - static_count, 256, [&cover](size_t begin, size_t end) {
+		cover(static_count + begin, static_count + end);
+	});
+	collision_map.rebuild(body_cells, body_mapped, static_count, bodies.size());
+}
+
+// Pairs are found per cell, and a pair sharing several cells is only
+// emitted by the cell at the lowest corner of its overlap inside the grid.
+// This makes every pair unique without tracking which ones were already
+// seen, so bodies spanning many cells (such as long walls) cost no more than
+// the cells they cover. Moving bodies are paired with each other by
+// scanning rows of the moving map, and with fixed bodies by looking up
+// their own cells in the static map. Fixed bodies are never paired with
+// each other. Both scans run in parallel and the result is sorted, so the
+// pair list does not depend on the thread count.
+void Physics::find_pairs() {
+	glm::ivec2 const grid_min = collision_map.offset;
+	glm::ivec2 const grid_max = collision_map.offset + collision_map.dims - glm::ivec2(1, 1);
+	auto emit = [](std::vector<BodyPair>& found, uint32_t i, uint32_t j) {
+		if (bodies[i]->id < bodies[j]->id) {
+			found.push_back({ i, j });
+		}
+		else {
+			found.push_back({ j, i });
+		}
+	};
+
+	static std::vector<std::vector<BodyPair>> row_pairs;
+	size_t const rows_per_block = 4;
+	size_t const row_blocks = (collision_map.dims.y + rows_per_block - 1) / rows_per_block;
+	if (row_pairs.size() < row_blocks) {
+		row_pairs.resize(row_blocks);
+	}
+	JobPool::parallel_for(collision_map.dims.y, rows_per_block, [&](size_t begin, size_t end) {
+		std::vector<BodyPair>& found = row_pairs[begin / rows_per_block];
+		found.clear();
+		for (int y = (int) begin; y < (int) end; y++) {
+			for (int x = 0; x < collision_map.dims.x; x++) {
+				glm::ivec2 const cell = grid_min + glm::ivec2(x, y);
+				CellSpan bucket = collision_map.bucket_at(cell);
+				for (uint32_t const* i = bucket.begin(); i != bucket.end(); i++) {
+					for (uint32_t const* j = i + 1; j != bucket.end(); j++) {
+						glm::ivec2 owner = glm::max(
+							glm::max(body_cells[*i].minima, body_cells[*j].minima),
+							grid_min
+						);
+						if (owner == cell) {
+							emit(found, *i, *j);
+						}
+					}
+				}
+			}
+		}
+	});
+
+	static std::vector<std::vector<BodyPair>> body_pairs;
+	size_t const moving_count     = bodies.size() - static_count;
+	size_t const bodies_per_block = 64;
+	size_t const body_blocks = (moving_count + bodies_per_block - 1) / bodies_per_block;
+	if (body_pairs.size() < body_blocks) {
+		body_pairs.resize(body_blocks);
+	}
+	JobPool::parallel_for(moving_count, bodies_per_block, [&](size_t begin, size_t end) {
+		std::vector<BodyPair>& found = body_pairs[begin / bodies_per_block];
+		found.clear();
+		for (size_t i = static_count + begin; i < static_count + end; i++) {
+			if (!body_mapped[i]) {
+				continue;
+			}
+			glm::ivec2 lo = glm::max(body_cells[i].minima, grid_min);
+			glm::ivec2 hi = glm::min(body_cells[i].maxima, grid_max);
+			for (int y = lo.y; y <= hi.y; y++) {
+				for (int x = lo.x; x <= hi.x; x++) {
+					glm::ivec2 const cell(x, y);
+					for (uint32_t fixed : static_map.bucket_at(cell)) {
+						glm::ivec2 owner = glm::max(
+							glm::max(body_cells[i].minima, body_cells[fixed].minima),
+							grid_min
+						);
+						if (owner == cell) {
+							emit(found, (uint32_t) i, fixed);
+						}
+					}
+				}
+			}
+		}
+	});
+
+	pairs.clear();
+	for (size_t block = 0; block < row_blocks; block++) {
+		pairs.insert(pairs.end(), row_pairs[block].begin(), row_pairs[block].end());
+	}
+	for (size_t block = 0; block < body_blocks; block++) {
+		pairs.insert(pairs.end(), body_pairs[block].begin(), body_pairs[block].end());
+	}
+	std::sort(pairs.begin(), pairs.end(), pair_order);
+}
+
+void Physics::sweep_pairs() {
+	body_bounds.resize(bodies.size());
+	body_mapped.resize(bodies.size());
+	auto bound = [](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			Physics& phys = *bodies[i];
+			glm::vec2 minima, maxima;
+			phys.bounds(minima, maxima);
+			body_bounds[i] = SweepEntry{ minima, maxima, phys.id, (uint32_t) i };
+			body_mapped[i] = in_broad_phase(phys);
+		}
+	};
+	// Keeps the bounds of mapped bodies in [first,last), in body order
+	auto compact = [](size_t first, size_t last) {
+		size_t count = 0;
+		for (size_t i = first; i < last; i++) {
+			if (body_mapped[i]) {
+				body_bounds[count++] = body_bounds[i];
+			}
+		}
+		body_bounds.resize(count);
+	};
+	if (!static_valid) {
+		JobPool::parallel_for(static_count, 256, bound);
+		compact(0, static_count);
+		sweep_and_prune.set_fixed(body_bounds);
+		body_bounds.resize(bodies.size());
+		static_valid = true;
+	}
+	JobPool::parallel_for(bodies.size() - static_count, 256, [&bound](size_t begin, size_t end) {
+		bound(static_count + begin, static_count + end);
+	});
+	compact(static_count, bodies.size());
+	sweep_and_prune.find_pairs(body_bounds, pairs);
+}
+
+// Places each pair in the batch right after the last batch that used either
+// of its movable bodies, so every body sees its pairs in a fixed order.
+// Fixed bodies are read-only during resolution, so any number of pairs in a
+// batch can share one. Pairs are then grouped by batch with a counting sort.
+void Physics::batch_pairs() {
+	static std::vector<uint32_t> next_batch;
+	static std::vector<uint32_t> pair_batch;
+	next_batch.assign(bodies.size(), 0);
+	pair_batch.resize(pairs.size());
+	uint32_t batch_count = 0;
+	// Pairs between moving bodies are placed first, so that contacts with
+	// fixed bodies are resolved last and a body pushed by others still ends
+	// up on the right side of a wall
+	for (int pass = 0; pass < 2; pass++) {
+		for (size_t k = 0; k < pairs.size(); k++) {
+			uint32_t a = pairs[k].a;
+			uint32_t b = pairs[k].b;
+			bool const with_fixed = bodies[a]->fixed || bodies[b]->fixed;
+			if (with_fixed != (pass == 1)) {
+				continue;
+			}
+			uint32_t batch = std::max(
+				bodies[a]->fixed ? 0 : next_batch[a],
+				bodies[b]->fixed ? 0 : next_batch[b]
+			);
+			next_batch[a] = batch + 1;
+			next_batch[b] = batch + 1;
+			pair_batch[k] = batch;
+			batch_count = std::max(batch_count, batch + 1);
+		}
+	}
+	batch_starts.assign(batch_count + 1, 0);
+	for (size_t k = 0; k < pairs.size(); k++) {
+		batch_starts[pair_batch[k] + 1]++;
+	}
+	for (size_t batch = 0; batch < batch_count; batch++) {
+		batch_starts[batch + 1] += batch_starts[batch];
+	}
+	batched_pairs.resize(pairs.size());
+	for (size_t k = 0; k < pairs.size(); k++) {
+		batched_pairs[batch_starts[pair_batch[k]]++] = (uint32_t) k;
+	}
+	for (size_t batch = batch_count; batch > 0; batch--) {
+		batch_starts[batch] = batch_starts[batch - 1];
+	}
+	batch_starts[0] = 0;
+}
+
+// Moves each continuous body back along its path to the earliest contact
+// found among its pairs, so that a fast body meets the first wall in its way
+// instead of ending the step on the far side of it
+void Physics::rewind_to_impacts() {
+	pair_impacts.resize(pairs.size());
+	JobPool::parallel_for(pairs.size(), 256, [](size_t begin, size_t end) {
+		for (size_t k = begin; k < end; k++) {
+			Physics& self  = *bodies[pairs[k].a];
+			Physics& other = *bodies[pairs[k].b];
+			bool const swept = (self.continuous && !self.fixed) || (other.continuous && !other.fixed);
+			pair_impacts[k] = swept ? self.time_of_impact(other) : 1.f;
+		}
+	});
+	body_impacts.assign(bodies.size(), 1.f);
+	for (size_t k = 0; k < pairs.size(); k++) {
+		if (pair_impacts[k] >= 1.f) {
+			continue;
+		}
+		if (!bodies[pairs[k].a]->solid || !bodies[pairs[k].b]->solid) {
+			continue;
+		}
+		body_impacts[pairs[k].a] = std::min(body_impacts[pairs[k].a], pair_impacts[k]);
+		body_impacts[pairs[k].b] = std::min(body_impacts[pairs[k].b], pair_impacts[k]);
+	}
+	JobPool::parallel_for(bodies.size(), 256, [](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			Physics& phys = *bodies[i];
+			if ((body_impacts[i] >= 1.f) || !phys.continuous || phys.fixed) {
+				continue;
+			}
+			glm::vec3& pos = ecs::get<Position>(phys.id);
+			glm::vec2 at = glm::mix(phys.swept_from, glm::vec2(pos), body_impacts[i]);
+			pos = glm::vec3(at, pos.z);
+		}
+	});
+}
+
+void Physics::resolve_pairs() {
+	pair_hits.assign(pairs.size(), 0);
+	for (size_t batch = 0; batch + 1 < batch_starts.size(); batch++) {
+		uint32_t first = batch_starts[batch];
+		uint32_t count = batch_starts[batch + 1] - first;
+		JobPool::parallel_for(count, 32, [first](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				uint32_t k = batched_pairs[first + i];
+				Physics& self  = *bodies[pairs[k].a];
+				Physics& other = *bodies[pairs[k].b];
+				glm::vec2 normal;
+				if (!self.collides(other, normal)) {
+					continue;
+				}
+				pair_hits[k] = 1;
+				if (self.fixed && other.fixed) {
+					continue;
+				}
+				if ((!self.solid) || (!other.solid)) {
+					continue;
+				}
+				self.resolve_collision(other, normal);
+			}
+		});
+	}
+}
+
+void Physics::set_drag(float new_drag) {
+	drag = new_drag;
+}
+
+void Physics::set_gravity(float new_gravity) {
+	gravity = new_gravity;
+}
+
+// Meant to be called at startup. Switching later is allowed, but the first
+// step after a switch has no previous order to start the sweep from.
+void Physics::set_broad_phase(BroadPhase new_broad_phase) {
+	broad_phase = new_broad_phase;
+	collision_map.clear();
+	static_map.clear();
+	sweep_and_prune.clear();
+	static_valid = false;
+}
+
+// Fixed bodies are only looked at again when they are added or removed.
+// Call this after moving, resizing or otherwise changing one.
+void Physics::invalidate_static() {
+	static_valid = false;
+}
+
+
+
+float Physics::drag    = 1;
+float Physics::gravity = 0;
+BroadPhase    Physics::broad_phase     = BroadPhase::grid;
+CollisionMap  Physics::collision_map   = CollisionMap();
+CollisionMap  Physics::static_map      = CollisionMap();
+SweepAndPrune Physics::sweep_and_prune = SweepAndPrune();
+size_t              Physics::static_count = 0;
+bool                Physics::static_valid = false;
+std::vector<size_t> Physics::static_ids   = std::vector<size_t>();
+std::vector<Physics*>   Physics::bodies        = std::vector<Physics*>();
+std::vector<CellRect>   Physics::body_cells    = std::vector<CellRect>();
+std::vector<uint8_t>    Physics::body_mapped   = std::vector<uint8_t>();
+std::vector<SweepEntry> Physics::body_bounds   = std::vector<SweepEntry>();
+std::vector<BodyPair>   Physics::pairs         = std::vector<BodyPair>();
+std::vector<uint32_t>   Physics::batched_pairs = std::vector<uint32_t>();
+std::vector<uint32_t>   Physics::batch_starts  = std::vector<uint32_t>();
+std::vector<uint8_t>    Physics::pair_hits     = std::vector<uint8_t>();
+std::vector<float>      Physics::pair_impacts  = std::vector<float>();
+std::vector<float>      Physics::body_impacts  = std::vector<float>();
+
+
+
+void Sprite::setup() {
+	if (is_setup) {
+		return;
+	}
+#ifndef GLAZY_HEADLESS
+	is_setup = true;
+	vao     = new VAO;
+	pos     = new Buffer<glm::vec3>;
+	uv      = new Buffer<glm::vec2>;
+
+	std::vector<glm::vec3> const quad_pos_cpu = {
+		{-1.0,-1.0,0.0}, {1.0,1.0,0.0}, {1.0,-1.0,0.0},
+		{-1.0,-1.0,0.0}, {-1.0,1.0,0.0}, {1.0,1.0,0.0},
+	};
+
+	// The texture positions of the quad's vertexes
+	std::vector<glm::vec2> const quad_uv_cpu = {
+		{0.0,1.0}, {1.0,0.0}, {1.0,1.0},
+		{0.0,1.0}, {0.0,0.0}, {1.0,0.0},
+	};
+
+	VAO::BindGuard guard(*vao);
+
+	pos->set_data(quad_pos_cpu,GL_STATIC_DRAW);
+	uv ->set_data(quad_uv_cpu,GL_STATIC_DRAW);
+
+	(*vao)[0].enable();
+	(*vao)[0] = *pos;
+	(*vao)[1].enable();
+	(*vao)[1] = *uv;
+
+#endif
+}
+
+
+
+Sprite::Sprite(size_t id,std::shared_ptr<Texture> tex, glm::vec2 scale)
+	: Component(id)
+	, tex(tex)
+	, scale(scale)
+	, program(get_default_program())
+	, depth(0.f)
+	, screenlock(false)
+{
+	setup();
+}
+
+Sprite::Sprite(size_t id, AtlasImage image, glm::vec2 scale)
+	: Component(id)
+	, image(image)
+	, scale(scale)
+	, program(get_default_program())
+	, depth(0.f)
+	, screenlock(false)
+{
+	setup();
+}
+
+Sprite::Sprite(size_t id, AtlasImage image, glm::vec2 scale, std::shared_ptr<GPUProgram> program)
+	: Component(id)
+	, image(image)
+	, scale(scale)
+	, program(program)
+	, depth(0.f)
+	, screenlock(false)
+{
+	setup();
+}
+
+Sprite::Sprite(size_t id,std::shared_ptr<Texture> tex, glm::vec2 scale, std::shared_ptr<GPUProgram> program)
+	: Component(id)
+	, tex(tex)
+	, scale(scale)
+	, program(program)
+	, depth(0.f)
+	, screenlock(false)
+{
+	setup();
+}
+
+Sprite::Sprite(
+	size_t id,
+	std::shared_ptr<Texture> tex,
+	glm::vec2 scale,
+	std::shared_ptr<GPUProgram> program,
+	std::function<void(std::shared_ptr<GPUProgram>)> uniform_callback
+)
+	: Component(id)
+	, tex(tex)
+	, scale(scale)
+	, program(program)
+	, uniform_callback(uniform_callback)
+	, depth(0.f)
+	, screenlock(false)
+{
+	setup();
+}
+
+void Sprite::store_camera() {
+	cam_previous = cam_pos;
+}
+
+// Headless builds have no programs, so the lookup is repeated there, but it
+// is cheap
+std::shared_ptr<GPUProgram> Sprite::get_default_program() {
+	if (!default_program) {
+		default_program = ProgramCache::load("shaders/sprite.vert", "shaders/sprite.frag");
+	}
+	return default_program;
+}
+
+GPUProgram &Sprite::get_program() {
+	return *program;
+}
+
+VAO &Sprite::get_vao() {
+	return *vao;
+}
+
+bool               Sprite::is_setup = false;
+VAO               *Sprite::vao      = nullptr;
+Buffer<glm::vec3> *Sprite::pos      = nullptr;
+Buffer<glm::vec2> *Sprite::uv       = nullptr;
+glm::vec2          Sprite::cam_pos      = glm::vec2(0, 0);
+glm::vec2          Sprite::cam_previous = glm::vec2(0, 0);
+std::shared_ptr<GPUProgram> Sprite::default_program = nullptr;
+
+
+void AICommands::add_velocity(size_t id, glm::vec2 change) {
+	commands.push_back({ Command::add_velocity, id, glm::vec3(change, 0.f), 0 });
+}
+
+void AICommands::set_position(size_t id, glm::vec3 position) {
+	commands.push_back({ Command::set_position, id, position, 0 });
+}
+
+void AICommands::set_scale(size_t id, glm::vec2 scale) {
+	commands.push_back({ Command::set_scale, id, glm::vec3(scale, 0.f), 0 });
+}
+
+void AICommands::damage(size_t id, int amount) {
+	commands.push_back({ Command::damage, id, glm::vec3(0.f), amount });
+}
+
+void AICommands::defer(std::function<void()> fn) {
+	commands.push_back({ Command::call, 0, glm::vec3(0.f), (int) calls.size() });
+	calls.push_back(std::move(fn));
+}
+
+void AICommands::apply() {
+	for (Command const& command : commands) {
+		switch (command.kind) {
+		case Command::add_velocity:
+			ecs::get<Physics>(command.id).velocity += glm::vec2(command.value);
+			break;
+		case Command::set_position:
+			ecs::get<Position>(command.id).position = command.value;
+			break;
+		case Command::set_scale:
+			ecs::get<Sprite>(command.id).scale = glm::vec2(command.value);
+			break;
+		case Command::damage:
+			ecs::get<Status>(command.id).health -= command.amount;
+			break;
+		case Command::call:
+			calls[command.amount]();
+			break;
+		}
+	}
+	clear();
+}
+
+void AICommands::clear() {
+	commands.clear();
+	calls.clear();
+}
+
+size_t AICommands::size() const {
+	return commands.size();
+}
+
+
+AI::AI (size_t id, void(*d_update)(size_t,float,void*,AICommands&),void* data)
+	: Component(id)
+	, d_update(d_update)
+	, data(data)
+	, exclusive(false)
+	, always_run(false)
+	, pending(0.f)
+	, waited(0)
+	, importance(critical)
+	, seen_health(0)
+	, since_damage(std::numeric_limits<float>::infinity())
+{}
+
+void AI::delta_update(float delta) {
+	AICommands commands;
+	d_update(id,delta,data,commands);
+	commands.apply();
+}
+
+void AI::configure(AISchedule schedule) {
+	AI::schedule = schedule;
+}
+
+AIStats const& AI::last_update() {
+	return stats;
+}
+
+// Only touches this agent's own fields, so agents can be classified in
+// parallel
+void AI::classify(float delta) {
+	if (always_run || !ecs::has<Position>(id)) {
+		importance = critical;
+		return;
+	}
+	if (ecs::has<Status>(id)) {
+		int health = ecs::get<Status>(id).health;
+		since_damage = (health < seen_health) ? 0.f : since_damage + delta;
+		seen_health  = health;
+	}
+	glm::vec2 position = glm::vec2(ecs::get<Position>(id).position);
+	glm::vec2 reach    = glm::abs(position - Sprite::cam_pos);
+	float     view     = 1.f + schedule.view_margin;
+	if (((reach.x <= view) && (reach.y <= view)) || (since_damage < schedule.damage_memory)) {
+		importance = critical;
+		return;
+	}
+	float distance = glm::length(position - Sprite::cam_pos);
+	if (distance <= schedule.near_distance) {
+		importance = nearby;
+		return;
+	}
+	// Looking for players is the dear part, so an agent that is not due
+	// keeps its importance until it is
+	if ((importance > nearby) && !due()) {
+		return;
+	}
+	SpatialHit player;
+	if (SpatialIndex::nearest(position, Status::GOOD, std::min(distance, schedule.far_distance), player)) {
+		distance = player.distance;
+	}
+	if (distance <= schedule.near_distance) {
+		importance = nearby;
+	}
+	else if (distance <= schedule.far_distance) {
+		importance = midrange;
+	}
+	else {
+		importance = distant;
+	}
+}
+
+bool AI::due() const {
+	uint32_t interval = 1;
+	if (importance == midrange) {
+		interval = (uint32_t) std::max(schedule.middle_interval, 1);
+	}
+	else if (importance == distant) {
+		interval = (uint32_t) std::max(schedule.far_interval, 1);
+	}
+	return (waited >= interval) || ((step_count + id) % interval == 0);
+}
+
+// Runs agents[first, last), recording into the buffers from 'first_block'
+// on, and returns how many buffers it used
+size_t AI::run(size_t first, size_t last, size_t first_block) {
+	size_t const block_size  = 64;
+	size_t const block_count = (last - first + block_size - 1) / block_size;
+	if (block_commands.size() < first_block + block_count) {
+		block_commands.resize(first_block + block_count);
+	}
+	JobPool::parallel_for(last - first, block_size, [first, first_block, block_size](size_t begin, size_t end) {
+		AICommands& commands = block_commands[first_block + begin / block_size];
+		commands.clear();
+		for (size_t i = first + begin; i < first + end; i++) {
+			AI& ai = *agents[i];
+			ai.d_update(ai.id, ai.pending, ai.data, commands);
+			ai.pending = 0.f;
+			ai.waited  = 0;
+		}
+	});
+	stats.ran += last - first;
+	return block_count;
+}
+
+void AI::update(float delta) {
+	auto const began = std::chrono::steady_clock::now();
+	stats = AIStats();
+	step_count++;
+	agents.clear();
+	exclusive_ids.clear();
+	ecs::ComponentSet<AI>::for_each([delta](AI& ai) {
+		ai.pending += delta;
+		ai.waited++;
+		if (ai.exclusive) {
+			exclusive_ids.push_back(ai.id);
+		}
+		else {
+			agents.push_back(&ai);
+		}
+	});
+	stats.agents = agents.size() + exclusive_ids.size();
+
+	JobPool::parallel_for(agents.size(), 256, [delta](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			agents[i]->classify(delta);
+		}
+	});
+	// Critical agents go first, then the others that are due, longest
+	// waiting first, and the rest are dropped
+	auto rest = std::stable_partition(agents.begin(), agents.end(), [](AI* ai) {
+		return ai->importance <= nearby;
+	});
+	auto last = std::stable_partition(rest, agents.end(), [](AI* ai) {
+		return ai->due();
+	});
+	std::stable_sort(rest, last, [](AI* a, AI* b) {
+		return a->waited > b->waited;
+	});
+	size_t const critical_count = rest - agents.begin();
+	size_t const due_count      = last - agents.begin();
+	stats.critical = critical_count + exclusive_ids.size();
+	stats.skipped  = agents.size() - due_count;
+
+	// The budget only covers the other agents. Without a time cap they run
+	// as one slice.
+	size_t const limit = critical_count + std::min(due_count - critical_count, schedule.budget_agents);
+	size_t const slice = std::isinf(schedule.budget_seconds) ? due_count : 1024;
+	size_t blocks = run(0, critical_count, 0);
+	size_t next = critical_count;
+	while (next < limit) {
+		size_t const end = std::min(next + slice, limit);
+		blocks += run(next, end, blocks);
+		next = end;
+		if (std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count() >= schedule.budget_seconds) {
+			break;
+		}
+	}
+	stats.over_budget = due_count - next;
+	// Commands can create components and move the storage that 'agents'
+	// points into, so nothing is applied until every agent has run
+	for (size_t block = 0; block < blocks; block++) {
+		block_commands[block].apply();
+	}
+
+	// Exclusive agents are found again by id, since applying commands may
+	// have created components and moved the storage. They were collected in
+	// storage order, so they are sorted to run in id order.
+	std::sort(exclusive_ids.begin(), exclusive_ids.end());
+	for (size_t id : exclusive_ids) {
+		if (ecs::has<AI>(id)) {
+			AI& ai = ecs::get<AI>(id);
+			float pending = ai.pending;
+			ai.pending = 0.f;
+			ai.waited  = 0;
+			ai.delta_update(pending);
+			stats.ran++;
+		}
+	}
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+}
+
+AISchedule              AI::schedule         = { 1.5f, 3.f, 2, 8, 0.25f, 0.5f, std::numeric_limits<size_t>::max(), std::numeric_limits<double>::infinity() };
+AIStats                 AI::stats            = AIStats();
+uint64_t                AI::step_count       = 0;
+std::vector<AI*>        AI::agents           = std::vector<AI*>();
+std::vector<size_t>     AI::exclusive_ids    = std::vector<size_t>();
+std::vector<AICommands> AI::block_commands   = std::vector<AICommands>();
+
+
+
+Status::Status(int id, int health, int armor)
+	: Component(id)
+	, health(health)
+	, armor(armor)
+	, alignment(NEUTRAL)
+{
+	FactionIndex::add(id, alignment);
+}
+
+void Status::set_alignment(Alignment new_alignment) {
+	alignment = new_alignment;
+	FactionIndex::change(id, alignment);
+}
+
+
+ecs::SparseSet<glm::vec2>& FactionIndex::faction_of(Status::Alignment alignment) {
+	return factions[(int) alignment - (int) Status::EVIL];
+}
+
+void FactionIndex::add(size_t id, Status::Alignment alignment) {
+	remove(id);
+	faction_of(alignment).emplace(id, glm::vec2(0, 0));
+}
+
+void FactionIndex::change(size_t id, Status::Alignment alignment) {
+	ecs::SparseSet<glm::vec2>& target = faction_of(alignment);
+	for (ecs::SparseSet<glm::vec2>& faction : factions) {
+		glm::vec2 const* position = faction.find(id);
+		if ((position == nullptr) || (&faction == &target)) {
+			continue;
+		}
+		glm::vec2 last_position = *position;
+		faction.remove(id);
+		target.emplace(id, last_position);
+		return;
+	}
+}
+
+void FactionIndex::remove(size_t id) {
+	for (ecs::SparseSet<glm::vec2>& faction : factions) {
+		faction.remove(id);
+	}
+}
+
+void FactionIndex::refresh() {
+	for (ecs::SparseSet<glm::vec2>& faction : factions) {
+		size_t const* ids = faction.ids();
+		glm::vec2* positions = faction.data();
+		JobPool::parallel_for(faction.size(), 256, [ids, positions](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				positions[i] = glm::vec2(ecs::get<Position>(ids[i]).position);
+			}
+		});
+	}
+}
+
+FactionSpan FactionIndex::members(Status::Alignment alignment) {
+	ecs::SparseSet<glm::vec2>& faction = faction_of(alignment);
+	return FactionSpan{ faction.ids(), faction.data(), faction.size() };
+}
+
+
+ecs::SparseSet<glm::vec2> FactionIndex::factions[3] = {};
+
+
+// Make the sets for our component types exist	
+template<> std::vector<ecs::ComponentSet<Position>::Entry> ecs::ComponentSet<Position> ::data = std::vector<ecs::ComponentSet<Position>::Entry>();
+template<> std::vector<ecs::ComponentSet<Physics>::Entry>  ecs::ComponentSet<Physics> ::data = std::vector<ecs::ComponentSet<Physics>::Entry>();
+template<> std::vector<ecs::ComponentSet<Sprite>::Entry>   ecs::ComponentSet<Sprite>  ::data = std::vector<ecs::ComponentSet<Sprite>::Entry>();
+template<> std::vector<ecs::ComponentSet<AI>::Entry>       ecs::ComponentSet<AI>      ::data = std::vector<ecs::ComponentSet<AI>::Entry>();
+template<> std::vector<ecs::ComponentSet<Status>::Entry>   ecs::ComponentSet<Status>  ::data = std::vector<ecs::ComponentSet<Status>::Entry>();
+
+
@@ -1,133 +1,460 @@
-
-#ifndef COMPONENTS
-#define COMPONENTS
-
-#include "common.h"
-
-// Forward declare our component types
-struct Position;
-struct Physics;
-struct Sprite;
-struct AI;
-
-
-
-struct CollisionMap {
-	float scale;
-	glm::ivec2 dims;
-	glm::ivec2 offset;
-	std::vector<std::vector<Physics*>> buckets;
-
-	CollisionMap();
-	void clear();
-	std::vector<Physics*>* bucket_at(glm::ivec2 position);
-	void mark(glm::ivec2 minima, glm::ivec2 maxima, Physics* marker);
-	void configure(float scale, glm::ivec2 dims, glm::ivec2 offset);
-};
-
-
-struct Position : public ecs::Component {
-	glm::vec3     position;
-	operator glm::vec3& ();
-	Position(size_t id);
-	Position(size_t id, glm::vec2 position);
-	Position(size_t id, glm::vec3 position);
-};
-
-
-
-// All entities with velocity update their position component over time
-struct Physics : public ecs::Component {
-	
-	static float  drag;
-	static float  gravity;
-
-	static CollisionMap collision_map;
-
-	glm::vec2     velocity;
-	bool fixed;
-	bool solid;
-	bool has_drag;
-
-	std::vector<std::function<void(size_t)>> on_collide;
-
-	glm::vec2     bbox_dims;
-
-	Physics(size_t id);
-	bool collides(Physics& other, glm::vec2& normal);
-	void resolve_collision(Physics& other, glm::vec2 normal);
-	void delta_update(float delta);
-	static void update_collision_map();
-	static void set_drag(float new_drag);
-	static void set_gravity(float new_gravity);
-	Physics(Physics const&) = default;
-};
-
-
-
-// The sprite component renders a sprite to the screen with a given
-// image and dimensions, with the screen position informed by the 
-// position component
-struct Sprite : public ecs::Component {
-
-
-	// All sprites use the same unit-wide quad
-	static bool is_setup;
-	static VAO               *vao;
-	static Buffer<glm::vec3> *pos;
-	static Buffer<glm::vec2> *uv;
-	static glm::vec2          cam_pos;
-
-	
-
-	// Sprites can have different textures and dimensions
-	std::function<void(std::shared_ptr<GPUProgram>)> uniform_callback;
-	std::shared_ptr<GPUProgram> program;
-	std::shared_ptr<Texture> tex;
-	glm::vec2 scale;
-	float depth;
-	bool screenlock;
-
-	static void setup();
-	Sprite(size_t id, std::shared_ptr<Texture> tex, glm::vec2 scale);
-	Sprite(size_t id, std::shared_ptr<Texture> tex, glm::vec2 scale, std::shared_ptr<GPUProgram> program);
-	Sprite(size_t id, std::shared_ptr<Texture> tex, glm::vec2 scale, std::shared_ptr<GPUProgram> program, std::function<void(std::shared_ptr<GPUProgram>)> uniform_callback);
-	void fixed_update();
-	GPUProgram& get_program();
-	static VAO& get_vao();
-	Sprite(Sprite const&) = default;
-
-};
-
-
-struct AI : ecs::Component {
-
-	void (*d_update)(size_t,float,void*);
-	void* data;
-
-	AI(size_t id, void(*d_update)(size_t, float, void*), void* data);
-	void delta_update(float delta);
-	AI(AI const&) = default;
-
-};
-
-
-struct Status : ecs::Component {
-
-	int health;
-	int armor;
-
-	enum Alignment {
-		EVIL    = -1,
-		NEUTRAL =  0,
-		GOOD    =  1,
-	};
-
-	Alignment alignment;
-	Status(int id, int health, int armor);
-	Status(Status const&) = default;
-
-};
-
-
-#endif
+
+#ifndef COMPONENTS
+#define COMPONENTS
+
+#include "atlas.h"
+#include "common.h"
+#include "glazy_sparse_set.h"
+
+// Forward declare our component types
+struct Position;
+struct Physics;
+struct Sprite;
+struct AI;
+
+
+
+// The inclusive range of map cells covered by a body
+struct CellRect {
+	glm::ivec2 minima;
+	glm::ivec2 maxima;
+};
+
+
+// A read-only view of the entries stored in one map cell
+struct CellSpan {
+	uint32_t const* first;
+	uint32_t const* last;
+
+	uint32_t const* begin() const;
+	uint32_t const* end() const;
+	size_t size() const;
+	bool empty() const;
+};
+
+
+// Entries are indexes into Physics::bodies, stored in one flat array sorted
+// by cell. A map holds a range of bodies, so fixed and moving bodies can be
+// kept in separate maps. The map is rebuilt with a counting sort: cells count their
+// entries, a prefix sum turns the counts into offsets, and a second pass
+// scatters the indexes into place. The storage is reused between rebuilds,
+// so once it has grown to fit a level, rebuilding never allocates.
+struct CollisionMap {
+	float scale;
+	glm::ivec2 dims;
+	glm::ivec2 offset;
+	std::vector<uint32_t> cell_starts;
+	std::vector<uint32_t> entries;
+
+	CollisionMap();
+	void clear();
+	CellSpan bucket_at(glm::ivec2 position) const;
+	CellRect cells_covered(glm::vec2 center, glm::vec2 half_dims) const;
+	void rebuild(std::vector<CellRect> const& rects, std::vector<uint8_t> const& included, size_t first, size_t last);
+	void configure(float scale, glm::ivec2 dims, glm::ivec2 offset);
+};
+
+
+// The bounding box of a body that takes part in sweep and prune
+struct SweepEntry {
+	glm::vec2 minima;
+	glm::vec2 maxima;
+	size_t    id;
+	uint32_t  body;
+};
+
+
+// A candidate collision between two entries of Physics::bodies, with
+// 'a' being the body with the lower entity id
+struct BodyPair {
+	uint32_t a;
+	uint32_t b;
+};
+
+
+// Sweep and prune sorts bodies by the left edge of their bounding box, so
+// each body only needs to be compared with those that start before its
+// right edge. Unlike CollisionMap it has no world bounds, and its cost
+// follows the number of overlaps rather than the area bodies cover.
+// The sorted order is kept between steps. Bodies barely move from one step
+// to the next, so an insertion sort restores the order in close to linear time.
+// Fixed bodies are sorted once, when they change, and are only tested
+// against moving bodies.
+struct SweepAndPrune {
+	std::vector<size_t>      order;
+	std::vector<SweepEntry>  entries;
+	ecs::SparseSet<uint32_t> slots;
+	std::vector<SweepEntry>  fixed_entries;
+	float                    fixed_reach;
+
+	SweepAndPrune();
+	void clear();
+	void set_fixed(std::vector<SweepEntry> const& bounds);
+	void find_pairs(std::vector<SweepEntry> const& bounds, std::vector<BodyPair>& pairs);
+};
+
+
+enum class BroadPhase {
+	grid,
+	sweep
+};
+
+
+struct Position : public ecs::Component {
+	glm::vec3     position;
+
+	// Where the entity was before the latest simulation step, so rendering
+	// can blend between steps. 'stamp' tells whether 'previous' was recorded
+	// for that step, since entities created since then have no previous
+	// position yet.
+	glm::vec3     previous;
+	size_t        stamp;
+	static size_t step_count;
+
+	operator glm::vec3& ();
+	Position(size_t id);
+	Position(size_t id, glm::vec2 position);
+	Position(size_t id, glm::vec3 position);
+	glm::vec3 interpolated(float alpha) const;
+	static void store_previous();
+};
+
+
+// All entities with velocity update their position component over time
+struct Physics : public ecs::Component {
+	
+	static float  drag;
+	static float  gravity;
+
+	static BroadPhase    broad_phase;
+	static CollisionMap  collision_map;
+	static CollisionMap  static_map;
+	static SweepAndPrune sweep_and_prune;
+
+	// Fixed bodies come first in Physics::bodies. Their part of the broad
+	// phase is only rebuilt when the set of fixed bodies changes, or after
+	// Physics::invalidate_static is called.
+	static size_t              static_count;
+	static bool                static_valid;
+	static std::vector<size_t> static_ids;
+
+	// Per-step working state, rebuilt by Physics::step
+	static std::vector<Physics*>   bodies;
+	static std::vector<CellRect>   body_cells;
+	static std::vector<uint8_t>    body_mapped;
+	static std::vector<SweepEntry> body_bounds;
+	static std::vector<BodyPair>   pairs;
+	static std::vector<uint32_t>   batched_pairs;
+	static std::vector<uint32_t>   batch_starts;
+	static std::vector<uint8_t>    pair_hits;
+	static std::vector<float>      pair_impacts;
+	static std::vector<float>      body_impacts;
+
+	glm::vec2     velocity;
+	bool fixed;
+	bool solid;
+	bool has_drag;
+
+	// Fast bodies that could pass through a thin wall within one step.
+	// Their broad phase covers the whole distance moved during the step, and
+	// they are moved back to their first contact before resolution.
+	bool continuous;
+	glm::vec2 swept_from;
+
+	std::vector<std::function<void(size_t)>> on_collide;
+
+	glm::vec2     bbox_dims;
+
+	Physics(size_t id);
+	Physics(size_t id, glm::vec2 bbox_dims, bool fixed);
+	bool collides(Physics& other, glm::vec2& normal);
+	void resolve_collision(Physics& other, glm::vec2 normal);
+	float time_of_impact(Physics& other);
+	void bounds(glm::vec2& minima, glm::vec2& maxima);
+	void delta_update(float delta);
+	static void step(float delta);
+	static void gather_bodies();
+	static void update_collision_map();
+	static void find_pairs();
+	static void sweep_pairs();
+	static void batch_pairs();
+	static void rewind_to_impacts();
+	static void resolve_pairs();
+	static void set_drag(float new_drag);
+	static void set_gravity(float new_gravity);
+	static void set_broad_phase(BroadPhase new_broad_phase);
+	static void invalidate_static();
+	Physics(Physics const&) = default;
+	Physics(Physics&&) = default;
+	Physics& operator=(Physics const&) = default;
+	Physics& operator=(Physics&&) = default;
+};
+
+
+
+// The sprite component renders a sprite to the screen with a given
+// image and dimensions, with the screen position informed by the 
+// position component
+struct Sprite : public ecs::Component {
+
+
+	// All sprites use the same unit-wide quad, and are drawn by SpriteBatch
+	static bool is_setup;
+	static VAO               *vao;
+	static Buffer<glm::vec3> *pos;
+	static Buffer<glm::vec2> *uv;
+	static glm::vec2          cam_pos;
+	static glm::vec2          cam_previous;
+	// Looked up once, rather than by name for every sprite
+	static std::shared_ptr<GPUProgram> default_program;
+
+	
+
+	// Sprites can have different textures and dimensions. A sprite shows its
+	// atlas image if it has one, and its own texture otherwise.
+	std::function<void(std::shared_ptr<GPUProgram>)> uniform_callback;
+	std::shared_ptr<GPUProgram> program;
+	std::shared_ptr<Texture> tex;
+	AtlasImage image;
+	glm::vec2 scale;
+	float depth;
+	bool screenlock;
+
+	static void setup();
+	Sprite(size_t id, std::shared_ptr<Texture> tex, glm::vec2 scale);
+	Sprite(size_t id, AtlasImage image, glm::vec2 scale);
+	Sprite(size_t id, AtlasImage image, glm::vec2 scale, std::shared_ptr<GPUProgram> program);
+	Sprite(size_t id, std::shared_ptr<Texture> tex, glm::vec2 scale, std::shared_ptr<GPUProgram> program);
+	Sprite(size_t id, std::shared_ptr<Texture> tex, glm::vec2 scale, std::shared_ptr<GPUProgram> program, std::function<void(std::shared_ptr<GPUProgram>)> uniform_callback);
+	static void store_camera();
+	static std::shared_ptr<GPUProgram> get_default_program();
+	GPUProgram& get_program();
+	static VAO& get_vao();
+	Sprite(Sprite const&) = default;
+	Sprite(Sprite&&) = default;
+	Sprite& operator=(Sprite const&) = default;
+	Sprite& operator=(Sprite&&) = default;
+
+};
+
+
+// Changes recorded by AI logic while the AI runs in parallel, and applied
+// once every agent has run. Logic reads the world as it was when the update
+// started, and never writes to it directly, so agents can run in any order
+// on any thread. Anything without a command of its own, such as spawning a
+// creature, can be deferred as a function.
+class AICommands {
+
+	struct Command {
+		enum Kind : uint8_t {
+			add_velocity,
+			set_position,
+			set_scale,
+			damage,
+			call,
+		};
+		Kind      kind;
+		size_t    id;
+		glm::vec3 value;
+		int       amount;
+	};
+
+	std::vector<Command>               commands;
+	std::vector<std::function<void()>> calls;
+
+public:
+
+	void add_velocity(size_t id, glm::vec2 change);
+	void set_position(size_t id, glm::vec3 position);
+	void set_scale(size_t id, glm::vec2 scale);
+	void damage(size_t id, int amount);
+	void defer(std::function<void()> fn);
+
+	// Applies the commands in the order they were recorded, then forgets them
+	void apply();
+	void clear();
+	size_t size() const;
+
+};
+
+
+// How often AI::update runs each agent. Agents that matter to the player run
+// every step; the rest run less often, with the time they missed added to
+// their next delta, so their logic sees the same total time.
+struct AISchedule {
+	// Agents this close to the camera or to a member of the good faction
+	// run every step, and those beyond 'far_distance' run least often
+	float  near_distance;
+	float  far_distance;
+	// Steps between runs of agents between the two distances, and beyond
+	int    middle_interval;
+	int    far_interval;
+	// How far past the edge of the view an agent still counts as on screen
+	float  view_margin;
+	// How long an agent that lost health keeps running every step
+	float  damage_memory;
+	// The most agents that are not on screen, near or recently damaged that
+	// run each step. Agents left over run first on the next step. The budget
+	// counts agents rather than time, so which agents run never depends on
+	// the speed of the machine or the thread count.
+	size_t budget_agents;
+	// An optional cap, in seconds since the update began, on running those
+	// same agents. It is checked between slices of them, and the first slice
+	// always runs. Which agents run then depends on the machine, so it is
+	// infinite unless a game asks for it.
+	double budget_seconds;
+};
+
+
+// Counts for the last AI update
+struct AIStats {
+	size_t agents;
+	// On screen, near, recently damaged, exclusive or always run
+	size_t critical;
+	size_t ran;
+	// Not due this step
+	size_t skipped;
+	// Due, but put off to a later step by the budget
+	size_t over_budget;
+	double seconds;
+};
+
+
+// AI::update runs every agent's logic across the JobPool. Agents are split
+// into fixed blocks, and each block records into its own AICommands. The
+// blocks are applied in order once every agent has run, so the result is
+// the same whatever the thread count. Agents do not see each other's
+// commands from the same step, since they all read the world as it was
+// when the update started.
+// Logic that cannot run alongside other agents, such as the player's, which
+// reads input and moves the camera, is marked 'exclusive'. Exclusive agents
+// run afterwards on the calling thread, in id order, and their commands are
+// applied as soon as each one finishes, so each sees the ones before it.
+// Agents are first sorted by importance, following 'schedule'. Those due
+// this step run, critical ones first, and distant ones are staggered by id
+// so they do not all run on the same step. Distances are measured with
+// SpatialIndex, so it must be rebuilt before the update.
+struct AI : ecs::Component {
+
+	enum Importance : uint8_t {
+		critical,
+		nearby,
+		midrange,
+		distant,
+	};
+
+	static AISchedule              schedule;
+	static AIStats                 stats;
+	static uint64_t                step_count;
+	static std::vector<AI*>        agents;
+	static std::vector<size_t>     exclusive_ids;
+	static std::vector<AICommands> block_commands;
+
+	void (*d_update)(size_t,float,void*,AICommands&);
+	void* data;
+	bool  exclusive;
+	// Runs every step whatever the schedule, for logic that counts its runs,
+	// such as a bullet losing health each time it runs
+	bool  always_run;
+	// Time since the agent last ran, passed to its next run
+	float      pending;
+	uint32_t   waited;
+	Importance importance;
+	int        seen_health;
+	float      since_damage;
+
+	AI(size_t id, void(*d_update)(size_t, float, void*, AICommands&), void* data);
+	// Runs this agent on its own, applying its commands straight away
+	void delta_update(float delta);
+	static void update(float delta);
+	static void configure(AISchedule schedule);
+	static AIStats const& last_update();
+	AI(AI const&) = default;
+	AI(AI&&) = default;
+	AI& operator=(AI const&) = default;
+	AI& operator=(AI&&) = default;
+
+private:
+
+	void classify(float delta);
+	bool due() const;
+	static size_t run(size_t first, size_t last, size_t first_block);
+
+};
+
+
+struct Status : ecs::Component {
+
+	int health;
+	int armor;
+
+	enum Alignment {
+		EVIL    = -1,
+		NEUTRAL =  0,
+		GOOD    =  1,
+	};
+
+	// Change it through set_alignment, which keeps FactionIndex up to date
+	Alignment alignment;
+	Status(int id, int health, int armor);
+	void set_alignment(Alignment new_alignment);
+	Status(Status const&) = default;
+	Status(Status&&) = default;
+	Status& operator=(Status const&) = default;
+	Status& operator=(Status&&) = default;
+
+};
+
+
+// The members of one faction, packed: ids[i] was at positions[i] when
+// FactionIndex::refresh last ran
+struct FactionSpan {
+	size_t const*    ids;
+	glm::vec2 const* positions;
+	size_t           count;
+};
+
+
+// Keeps entities with a Status in one dense list per alignment, so logic
+// that only cares about one faction scans just that faction, in contiguous
+// memory, without looking up components. Membership is kept up as it
+// changes rather than rebuilt: a Status joins NEUTRAL when it is created,
+// set_alignment moves it, and remove() drops it, which creatures call when
+// they die and when they are destroyed. Positions are copied in by
+// refresh(), which should run once a step before any faction is read.
+class FactionIndex {
+
+	static ecs::SparseSet<glm::vec2> factions[3];
+
+	static ecs::SparseSet<glm::vec2>& faction_of(Status::Alignment alignment);
+
+public:
+
+	static void add(size_t id, Status::Alignment alignment);
+	// Does nothing for entities that are not in the index
+	static void change(size_t id, Status::Alignment alignment);
+	static void remove(size_t id);
+	static void refresh();
+	static FactionSpan members(Status::Alignment alignment);
+
+};
+
+
+// Makes room in each component set for 'count' more entities, so that a
+// batch of them is appended without reallocating. Capacity at least doubles
+// when it grows, so many small batches still grow the sets geometrically.
+template<typename T>
+void reserve_component(size_t count) {
+	auto& data = ecs::ComponentSet<T>::data;
+	if (data.size() + count > data.capacity()) {
+		data.reserve(std::max(data.size() + count, data.capacity() * 2));
+	}
+}
+
+template<typename... Ts>
+void reserve_components(size_t count) {
+	(reserve_component<Ts>(count), ...);
+}
+
+
+#endif
@@ -1,188 +1,266 @@
-﻿// By Braxton Cuneo, Published under Creative Commons CC-BY
-
-#include <glm/ext/matrix_transform.hpp>
-#include <glm/ext/matrix_clip_space.hpp>
-#include <glad.h>
-#include <glfw3.h>
-
-#include "glazy.h"
-#include "shape.h"
-
-
-// Window dimensions
-glm::ivec2 const window_dims = { 1000,1000 };
-glm::ivec2 const window_pos = { 100, 100 };
-
-
-
-#include "components.h"
-#include "level.h"
-#include "noise.h"
-#include "quad.h"
-
-
-
-void key_handler(GLFWwindow* window, int key, int scancode, int action, int mods);
-void entry_exit_handler(GLFWwindow* window, int entered);
-void cursor_position(GLFWwindow* window, double xpos, double ypos);
-void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
-
-int main() {
-
-	std::vector<glazy::context::WindowHint> hints = {};
-	GLFWwindow* window = setup(window_pos, window_dims, "ECS Platform", hints);
-	glfwSetKeyCallback(window, key_handler);
-	glfwSetCursorEnterCallback(window, entry_exit_handler);
-	glfwSetCursorPosCallback(window, cursor_position);
-	glfwSetMouseButtonCallback(window, mouse_button_callback);
-
-
-	std::shared_ptr<Texture>  bird_tex1(new Texture("assets/bird1.png", true));
-	std::shared_ptr<Texture>  bird_tex2(new Texture("assets/bird2.png", true));
-	std::shared_ptr<Texture>  ally_tex(new Texture("assets/ally.png", true));
-	std::vector<std::shared_ptr<Bird>> birds;
-		
-	Bird::loop = {
-		{ bird_tex1,bird_tex2 },
-		20,
-		0
-	};
-
-	Physics::collision_map.configure(0.1f, { 200, 200 }, { -100, -100 });
-
-	Level::register_quad_class<Wall>();
-	Level::register_quad_class<Background>();
-	Level::register_quad_class<TextBox>();
-
-	Level::register_creature_class<Bird>();
-	Level::register_creature_class<Enemy>();
-
-	Level level("assets/level_0.txt");
-
-	// Make sure to use the u8 prefix and not to use multi-codepoint symbols
-	// (unless you want to handle that logic yourself, of course).
-	std::string unicode = u8"Example Unicode:\n😀🌳💤🤙👀🐁🐢☢\n古池や\n蛙飛び込む\n水の音";
-	TextBox unicode_textbox(glm::vec2(-2,0),glm::vec2(0.4,0.4),glm::ivec2(8,8),unicode);
-	
-	TextBox counting_textbox(glm::vec2(0,0.6),glm::vec2(0.8,0.1),glm::ivec2(8,1),unicode);
-	
-	TextBox fps_textbox(glm::vec2(0.7,-0.95),glm::vec2(0.48,0.04),glm::ivec2(12,1),unicode);
-	Sprite& fps_sprite = ecs::get<Sprite>(fps_textbox);
-	fps_sprite.depth = -0.5f;
-	fps_sprite.screenlock = true;
-	fps_textbox.set_background(glm::vec4(0,0,0,0));
-	fps_textbox.set_foreground(glm::vec4(1,0,0,1));
-
-	srand((unsigned int) time(nullptr));
-	
-	
-	mouseclick_callbacks[-1] = [](glm::vec2 mouse_position) {
-		if (Bird::shoot_cooldown > 0) {
-			return;
-		}
-		glm::vec2 correction(Sprite::cam_pos.x, Sprite::cam_pos.y);
-		glm::vec2 offset = correction - mouse_position;
-		glm::vec2 direction = glm::normalize(-mouse_position);
-		glm::vec2 velocity = direction * 5.f;
-		glm::vec2 position = Sprite::cam_pos + direction*0.1f;
-		Bird::shoot_cooldown = 0.2f;
-		Creature::track_life(std::shared_ptr<Creature>(new Bullet(position, velocity)));
-	};
-
-	Physics::set_drag(0.1f);
-
-	glEnable(GL_DEPTH_TEST);
-
-	int frame_count = 0;
-
-	GLfloat first_time = (float)glfwGetTime();
-	GLfloat last_time = (float)glfwGetTime();
-	while (!glfwWindowShouldClose(window)) {
-
-		Creature::cleanup();
-		ecs::cleanup<AI>();
-		ecs::cleanup<Physics>();
-		ecs::cleanup<Sprite>();
-		ecs::cleanup<Status>();
-
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		GLfloat time = (float)glfwGetTime();	
-		counting_textbox.set_text(std::to_string(time),true);
-
-		GLfloat fps = 1.f / (time - last_time);
-		std::string fps_string = "fps=";
-		fps_string += std::to_string(fps);
-		fps_textbox.set_text(fps_string, true);
-
-		ecs::ComponentSet<AI>::delta_update(time-last_time);
-		Physics::update_collision_map();
-		ecs::ComponentSet<Physics>::delta_update(time-last_time);
-
-		VAO::BindGuard guard(Sprite::get_vao());
-		glActiveTexture(GL_TEXTURE0);
-		ecs::ComponentSet<Sprite>::fixed_update();
-		last_time = time;
-		// Add this to simulate random lag
-		// std::this_thread::sleep_for(std::chrono::milliseconds(rand() % 80));
-		glFlush();
-		glfwSwapBuffers(window);
-		glfwPollEvents();
-	}
-
-	glfwDestroyWindow(window);
-	glfwTerminate();
-	return 0;
-}
-
-
-void key_handler(GLFWwindow* window, int key, int scancode, int action, int mods) {
-	if (action == GLFW_PRESS) {
-		switch (key) {
-		case GLFW_KEY_G:
-			if (Physics::gravity < 0.001) {
-				Physics::gravity = 0.1f;
-			}
-			else {
-				Physics::gravity = 0.f;
-			}
-			break;
-		}
-	}
-
-	switch (key) {
-	case GLFW_KEY_W: Bird::w_down = (action != GLFW_RELEASE); break;
-	case GLFW_KEY_A: Bird::a_down = (action != GLFW_RELEASE); break;
-	case GLFW_KEY_S: Bird::s_down = (action != GLFW_RELEASE); break;
-	case GLFW_KEY_D: Bird::d_down = (action != GLFW_RELEASE); break;
-	}
-
-}
-
-void entry_exit_handler(GLFWwindow* window, int entered) {
-	mouse_on_screen = entered;
-	if (entered) {
-		std::cout << "Mouse entered!" << std::endl;
-	}
-	else {
-		std::cout << "Mouse left!" << std::endl;
-	}
-}
-
-void cursor_position(GLFWwindow* window, double xpos, double ypos) {
-	xpos = -((xpos / 500.f) - 1.0f);
-	ypos = (ypos / 500.f) - 1.0f;
-	mouse_position = glm::vec2((float)xpos, (float)ypos);
-}
-
-
-void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
-	if ((button == GLFW_MOUSE_BUTTON_1) && (action == GLFW_PRESS)) {
-		for (const auto& pair : mouseclick_callbacks) {
-			pair.second(mouse_position);
-		}
-	}
-}
-
-
-
-
+﻿// By Braxton Cuneo, Published under Creative Commons CC-BY
+
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glad.h>
+#include <glfw3.h>
+
+#include "glazy.h"
+#include "shape.h"
+
+
+// Window dimensions
+glm::ivec2 const window_dims = { 1000,1000 };
+glm::ivec2 const window_pos = { 100, 100 };
+
+// Toggled with F3
+bool show_stats = false;
+
+
+
+#include "batch.h"
+#include "components.h"
+#include "jobs.h"
+#include "level.h"
+#include "loop.h"
+#include "navigation.h"
+#include "noise.h"
+#include "quad.h"
+#include "spatial.h"
+
+
+
+void key_handler(GLFWwindow* window, int key, int scancode, int action, int mods);
+void entry_exit_handler(GLFWwindow* window, int entered);
+void cursor_position(GLFWwindow* window, double xpos, double ypos);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
+
+int main() {
+
+	std::vector<glazy::context::WindowHint> hints = {};
+	GLFWwindow* window = setup(window_pos, window_dims, "ECS Platform", hints);
+	glfwSetKeyCallback(window, key_handler);
+	glfwSetCursorEnterCallback(window, entry_exit_handler);
+	glfwSetCursorPosCallback(window, cursor_position);
+	glfwSetMouseButtonCallback(window, mouse_button_callback);
+
+
+	// Images are decoded on the workers, so the pool has to be running first
+	JobPool::start(0);
+
+	AtlasImage bird_image1 = TextureAtlas::load("assets/bird1.png");
+	AtlasImage bird_image2 = TextureAtlas::load("assets/bird2.png");
+	std::vector<std::shared_ptr<Bird>> birds;
+		
+	Bird::loop = {
+		{ bird_image1,bird_image2 },
+		20,
+		0
+	};
+	Bird::shoot_image = TextureAtlas::load("assets/shoot_texture.png");
+
+	// The grid only covers 20x20 units around the origin. Levels that reach
+	// further should use BroadPhase::sweep, which has no bounds.
+	Physics::set_broad_phase(BroadPhase::grid);
+	Physics::collision_map.configure(0.1f, { 200, 200 }, { -100, -100 });
+
+	// Creatures off screen and away from the bird think less often, and at
+	// most 2000 of them run each step. No time limit is set, so the same
+	// creatures run on any machine.
+	AISchedule schedule = AI::schedule;
+	schedule.budget_agents = 2000;
+	AI::configure(schedule);
+
+	// Enemies follow a flow field towards the bird, over the same 20x20
+	// units as the grid, kept an enemy's width clear of walls. The bird is
+	// the only goal, so the whole field depends on it, and it is only
+	// moved once it leaves the two cells around where it was placed.
+	Navigation::configure(0.1f, { 200, 200 }, { -100, -100 }, 0.024f, 2);
+	Navigation::track(Status::GOOD);
+
+	Level::register_quad_class<Wall>();
+	Level::register_quad_class<Background>();
+	Level::register_quad_class<TextBox>();
+
+	Level::register_creature_class<Bird>();
+	Level::register_creature_class<Enemy>();
+
+	// Enemies anywhere in the level collide with its walls and find their
+	// way around them, so a small level is loaded whole. Large or compiled
+	// levels can be streamed instead, keeping quads near the camera with
+	// Level::StreamSettings{ 2.f, 4.f, 100000, 2000 }. The view spans one
+	// unit either side of the camera, so a radius of four keeps loading
+	// well out of sight. stream() does nothing for a level loaded whole.
+	Level level("assets/level_0.txt");
+
+	// Make sure to use the u8 prefix and not to use multi-codepoint symbols
+	// (unless you want to handle that logic yourself, of course).
+	std::string unicode = u8"Example Unicode:\n😀🌳💤🤙👀🐁🐢☢\n古池や\n蛙飛び込む\n水の音";
+	TextBox unicode_textbox(glm::vec2(-2,0),glm::vec2(0.4,0.4),glm::ivec2(8,8),unicode);
+	
+	TextBox counting_textbox(glm::vec2(0,0.6),glm::vec2(0.8,0.1),glm::ivec2(8,1),unicode);
+	
+	TextBox fps_textbox(glm::vec2(0.7,-0.95),glm::vec2(0.48,0.04),glm::ivec2(12,1),unicode);
+	Sprite& fps_sprite = ecs::get<Sprite>(fps_textbox);
+	fps_sprite.depth = -0.5f;
+	fps_sprite.screenlock = true;
+	fps_textbox.set_background(glm::vec4(0,0,0,0));
+	fps_textbox.set_foreground(glm::vec4(1,0,0,1));
+
+	srand((unsigned int) time(nullptr));
+	
+	
+	mouseclick_callbacks[-1] = [](glm::vec2 mouse_position) {
+		if (Bird::shoot_cooldown > 0) {
+			return;
+		}
+		glm::vec2 correction(Sprite::cam_pos.x, Sprite::cam_pos.y);
+		glm::vec2 offset = correction - mouse_position;
+		glm::vec2 direction = glm::normalize(-mouse_position);
+		glm::vec2 velocity = direction * 5.f;
+		glm::vec2 position = Sprite::cam_pos + direction*0.1f;
+		Bird::shoot_cooldown = 0.2f;
+		Creature::track_life(std::shared_ptr<Creature>(new Bullet(position, velocity)));
+	};
+
+	Physics::set_drag(0.1f);
+
+	glEnable(GL_DEPTH_TEST);
+
+	int frame_count = 0;
+
+	// Physics is only stable with a steady step length, so the simulation
+	// runs at a fixed rate and rendering blends between the last two steps
+	FixedStepLoop loop(60.f, 8);
+
+	loop.on_step([&level](float step) {
+		level.stream(Sprite::cam_pos);
+		Creature::cleanup();
+		ecs::cleanup<AI>();
+		ecs::cleanup<Physics>();
+		ecs::cleanup<Sprite>();
+		ecs::cleanup<Status>();
+
+		Position::store_previous();
+		Sprite::store_camera();
+		FactionIndex::refresh();
+		SpatialIndex::rebuild();
+		Navigation::update();
+		AI::update(step);
+		Physics::step(step);
+	});
+
+	GLfloat first_time = (float)glfwGetTime();
+	GLfloat last_time = (float)glfwGetTime();
+	GLfloat time = last_time;
+
+	loop.on_render([&](float alpha) {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		counting_textbox.set_text(std::to_string(time),true);
+
+		GLfloat fps = 1.f / (time - last_time);
+		std::string fps_string = "fps=";
+		fps_string += std::to_string(fps);
+		fps_textbox.set_text(fps_string, true);
+
+		// Images still loading are streamed in a little at a time, so a level
+		// full of new images never stalls a frame for long
+		TextureAtlas::update(0.002);
+		SpriteBatch::draw(alpha);
+
+		// While show_stats is on, draw calls and state changes are reported
+		// once a second, so batching can be checked on any driver, including
+		// software ones
+		frame_count++;
+		if ((time - first_time) >= 1.f) {
+			if (show_stats) {
+				RenderStats const& stats = SpriteBatch::last_frame();
+				std::cout << "sprites=" << stats.sprites
+					<< " culled=" << stats.culled
+					<< " buckets=" << stats.buckets
+					<< " draw_calls=" << stats.draw_calls
+					<< " program_binds=" << stats.program_binds
+					<< " texture_binds=" << stats.texture_binds
+					<< " uniform_uploads=" << stats.uniform_uploads
+					<< " images_pending=" << TextureAtlas::pending()
+					<< " ai_ran=" << AI::last_update().ran
+					<< " ai_skipped=" << AI::last_update().skipped
+					<< " ai_over_budget=" << AI::last_update().over_budget
+					<< " frames=" << frame_count << std::endl;
+			}
+			first_time  = time;
+			frame_count = 0;
+		}
+	});
+
+	while (!glfwWindowShouldClose(window)) {
+		time = (float)glfwGetTime();
+		loop.advance(time - last_time);
+		last_time = time;
+		// Add this to simulate random lag
+		// std::this_thread::sleep_for(std::chrono::milliseconds(rand() % 80));
+		glFlush();
+		glfwSwapBuffers(window);
+		glfwPollEvents();
+	}
+
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return 0;
+}
+
+
+void key_handler(GLFWwindow* window, int key, int scancode, int action, int mods) {
+	if (action == GLFW_PRESS) {
+		switch (key) {
+		case GLFW_KEY_G:
+			if (Physics::gravity < 0.001) {
+				Physics::gravity = 0.1f;
+			}
+			else {
+				Physics::gravity = 0.f;
+			}
+			break;
+		case GLFW_KEY_F3:
+			show_stats = !show_stats;
+			break;
+		}
+	}
+
+	switch (key) {
+	case GLFW_KEY_W: Bird::w_down = (action != GLFW_RELEASE); break;
+	case GLFW_KEY_A: Bird::a_down = (action != GLFW_RELEASE); break;
+	case GLFW_KEY_S: Bird::s_down = (action != GLFW_RELEASE); break;
+	case GLFW_KEY_D: Bird::d_down = (action != GLFW_RELEASE); break;
+	}
+
+}
+
+void entry_exit_handler(GLFWwindow* window, int entered) {
+	mouse_on_screen = entered;
+	if (entered) {
+		std::cout << "Mouse entered!" << std::endl;
+	}
+	else {
+		std::cout << "Mouse left!" << std::endl;
+	}
+}
+
+void cursor_position(GLFWwindow* window, double xpos, double ypos) {
+	xpos = -((xpos / 500.f) - 1.0f);
+	ypos = (ypos / 500.f) - 1.0f;
+	mouse_position = glm::vec2((float)xpos, (float)ypos);
+}
+
+
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+	if ((button == GLFW_MOUSE_BUTTON_1) && (action == GLFW_PRESS)) {
+		for (const auto& pair : mouseclick_callbacks) {
+			pair.second(mouse_position);
+		}
+	}
+}
+
+
+
+
@@ -0,0 +1,1121 @@
+// Runs the simulation without a window or GL context, for batch runs and
+// performance baselines. Built by headless.vcxproj with GLAZY_HEADLESS.
+//
+// Usage: headless <scenario> [count] [frames] [threads] [grid|sweep]
+//        headless compile <text level> <compiled level>
+//
+// 'threads' is the number of worker threads besides the main one, where 0
+// (the default) picks one per remaining hardware thread.
+//
+//   level       Loads assets/level_0.txt, adds 'count' enemies and 'count'
+//               bullets, and reports the time per frame of every system
+//   broadphase  Moves 'count' bodies around a closed box and reports the
+//               time per frame of the broad phase and the whole physics step
+//   tunnel      Fires 'count' fast bullets at a thin wall, 100 per frame, and
+//               counts how many get through it
+//   lookup      Creates 'count' entities and compares 100k random lookups
+//               of them per frame through ComponentSet and through a
+//               SparseSet. Run with 1000, 10000 and 100000 to see how each
+//               scales.
+//   uniforms    Sets the five per-sprite uniforms of 'count' sprites against
+//               a mock GL, by name as GPUAccessor does, through a
+//               UniformTable lookup, and through pre-resolved handles
+//   assets      Loads the same texture and program 'count' times per frame,
+//               through string keys as the caches used to, by string_view,
+//               by interned id, and from every worker thread at once
+//   levelload   Writes a text level of 'count' walls and count/100 enemies,
+//               compiles it, and times loading each version once
+//   parse       Writes a text level of 'count' lines and reports how many
+//               lines per second the parser reads, against the stringstream
+//               parsers that tried each class in turn
+//   stream      Compiles a level of 'count' walls, then moves the focus
+//               across it over 'frames' frames, streaming chunks around it,
+//               and compares the first frame with loading everything
+//   spawn       Creates 'count' walls from level records each frame, one at
+//               a time and then as one batch, and deletes them again
+//   targets     Finds the nearest of count/10 allies for each of 'count'
+//               enemies, by testing every creature as Enemy::logic used to,
+//               by testing the GOOD faction, and through SpatialIndex
+//   schedule    Spreads 'count' enemies around the camera and runs their AI
+//               every step, with the default AISchedule, with that schedule
+//               and a budget of 1000 agents, and with that schedule capped
+//               at half a millisecond, reporting how many ran
+//   flowfield   Builds a 512x512 flow field over random walls with 8 goals,
+//               and times updating it in place after one goal moves a cell
+//               and after all of them do, against building it again, and
+//               'count' agents sampling it
+//   chase       Moves a single goal in a circle over 20x20 units of random
+//               walls, as the bird is the only goal of the enemies' field,
+//               and times updating fields of 0.05 and 0.1 unit cells, with
+//               and without two cells of slack
+//   particles   Moves 'count' bodies made of Position and Physics components
+//               as Physics::step integrates them, and 'count' particles
+//               stored in an Archetype, under the same gravity and drag
+
+#include "components.h"
+#include "jobs.h"
+#include "level.h"
+#include "loop.h"
+#include "navigation.h"
+#include "particles.h"
+#include "quad.h"
+#include "spatial.h"
+#include "glazy_uniform.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+
+typedef std::chrono::steady_clock Clock;
+
+
+struct Settings {
+	std::string scenario;
+	size_t      count;
+	size_t      frames;
+	size_t      threads;
+	BroadPhase  broad_phase;
+};
+
+
+// Accumulates the time spent in one system over a run
+struct Timer {
+	std::string name;
+	double      total_ms;
+
+	template<typename Fn>
+	void measure(Fn&& fn) {
+		Clock::time_point start = Clock::now();
+		fn();
+		total_ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+};
+
+
+// A moving box with no behaviour of its own
+struct Body
+	: ecs::ComponentHandle<Position>
+	, ecs::ComponentHandle<Physics>
+{
+	Body(glm::vec2 position, glm::vec2 velocity, glm::vec2 half_dims, bool fixed) {
+		glm::vec3& pos = ecs::get<Position>(*this);
+		Physics& phys  = ecs::get<Physics>(*this);
+		pos = glm::vec3(position, 0.f);
+		phys.velocity  = velocity;
+		phys.bbox_dims = half_dims;
+		phys.fixed     = fixed;
+		phys.has_drag  = false;
+	}
+};
+
+
+float random_range(float low, float high) {
+	return low + (high - low) * ((rand() % 10000) / 10000.0f);
+}
+
+void report(Settings const& settings, std::vector<Timer> const& timers) {
+	std::cout << settings.scenario
+		<< " count=" << settings.count
+		<< " frames=" << settings.frames
+		<< " threads=" << JobPool::thread_count()
+		<< " broad_phase=" << ((settings.broad_phase == BroadPhase::grid) ? "grid" : "sweep")
+		<< std::endl;
+	for (Timer const& timer : timers) {
+		std::cout << "  " << std::left << std::setw(12) << timer.name
+			<< std::fixed << std::setprecision(3)
+			<< (timer.total_ms / settings.frames) << " ms/frame" << std::endl;
+	}
+}
+
+void register_level_classes() {
+	Level::register_quad_class<Wall>();
+	Level::register_quad_class<Background>();
+	Level::register_quad_class<TextBox>();
+	Level::register_creature_class<Bird>();
+	Level::register_creature_class<Enemy>();
+	Bird::loop = { { AtlasImage() }, 20, 0 };
+}
+
+void run_level(Settings const& settings) {
+	register_level_classes();
+	Navigation::configure(0.1f, { 200, 200 }, { -100, -100 }, 0.024f, 2);
+	Navigation::track(Status::GOOD);
+
+	Level level("assets/level_0.txt");
+	for (size_t i = 0; i < settings.count; i++) {
+		glm::vec2 position(random_range(-2.8f, 2.8f), random_range(-0.8f, 0.8f));
+		Creature::track_life(std::shared_ptr<Creature>(new Enemy(position)));
+		glm::vec2 velocity(random_range(-5.f, 5.f), random_range(-5.f, 5.f));
+		Creature::track_life(std::shared_ptr<Creature>(new Bullet(position, velocity)));
+	}
+
+	std::vector<Timer> timers = { {"cleanup"}, {"ai"}, {"physics"}, {"total"} };
+	FixedStepLoop loop(60.f, 1);
+	loop.on_step([&timers](float step) {
+		timers[0].measure([]() {
+			Creature::cleanup();
+			ecs::cleanup<AI>();
+			ecs::cleanup<Physics>();
+			ecs::cleanup<Sprite>();
+			ecs::cleanup<Status>();
+			Position::store_previous();
+		});
+		timers[1].measure([step]() {
+			FactionIndex::refresh();
+			SpatialIndex::rebuild();
+			Navigation::update();
+			AI::update(step);
+		});
+		timers[2].measure([step]() { Physics::step(step); });
+	});
+	timers[3].measure([&]() {
+		for (size_t frame = 0; frame < settings.frames; frame++) {
+			loop.advance(loop.step());
+		}
+	});
+	report(settings, timers);
+	std::cout << "  creatures   " << Creature::alive.size() << " alive at the end" << std::endl;
+}
+
+
+void run_broadphase(Settings const& settings) {
+	float const side = std::sqrt((float) settings.count) * 0.05f;
+	new Body({ 0.f, -side - 0.1f }, { 0.f, 0.f }, { side + 0.2f, 0.1f }, true);
+	new Body({ 0.f,  side + 0.1f }, { 0.f, 0.f }, { side + 0.2f, 0.1f }, true);
+	new Body({ -side - 0.1f, 0.f }, { 0.f, 0.f }, { 0.1f, side }, true);
+	new Body({  side + 0.1f, 0.f }, { 0.f, 0.f }, { 0.1f, side }, true);
+	for (size_t i = 0; i < settings.count; i++) {
+		glm::vec2 position(random_range(-side, side), random_range(-side, side));
+		glm::vec2 velocity(random_range(-1.f, 1.f), random_range(-1.f, 1.f));
+		new Body(position, velocity, { 0.012f, 0.012f }, false);
+	}
+
+	std::vector<Timer> timers = { {"broadphase"}, {"physics"} };
+	for (size_t frame = 0; frame < settings.frames; frame++) {
+		timers[1].measure([&timers]() {
+			Physics::gather_bodies();
+			JobPool::parallel_for(Physics::bodies.size(), 256, [](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					Physics::bodies[i]->delta_update(1.f / 60.f);
+				}
+			});
+			timers[0].measure([]() {
+				if (Physics::broad_phase == BroadPhase::sweep) {
+					Physics::sweep_pairs();
+				}
+				else {
+					Physics::update_collision_map();
+					Physics::find_pairs();
+				}
+			});
+			Physics::batch_pairs();
+			Physics::rewind_to_impacts();
+			Physics::resolve_pairs();
+		});
+	}
+	report(settings, timers);
+	std::cout << "  pairs       " << Physics::pairs.size() << " in the last frame" << std::endl;
+}
+
+
+void run_tunnel(Settings const& settings) {
+	// A wall 0.1 units thick, which a bullet crosses in a fraction of a step
+	float const wall_half_height = 4.f;
+	new Body({ 0.f, 0.f }, { 0.f, 0.f }, { 0.05f, wall_half_height }, true);
+
+	// Bullets are fired in waves and removed a few steps later, once they
+	// have had time to reach the wall, so the scene stays the same size
+	struct Shot {
+		std::unique_ptr<Body> body;
+		glm::vec2 last_position;
+		size_t    fired;
+	};
+	std::vector<Shot> shots;
+	size_t fired    = 0;
+	size_t tunneled = 0;
+	size_t const per_wave = 100;
+	size_t const lifetime = 8;
+	float const step = 1.f / 10.f;
+
+	std::vector<Timer> timers = { {"physics"} };
+	size_t frame = 0;
+	for (; (frame < settings.frames) || (!shots.empty()); frame++) {
+		for (size_t i = 0; (i < per_wave) && (fired < settings.count); i++, fired++) {
+			glm::vec2 position(random_range(-2.f, -1.f), random_range(-3.5f, 3.5f));
+			glm::vec2 velocity(5.f, random_range(-0.5f, 0.5f));
+			Body* bullet = new Body(position, velocity, { 0.025f, 0.025f }, false);
+			ecs::get<Physics>(*bullet).continuous = true;
+			ecs::get<Physics>(*bullet).swept_from = position;
+			shots.push_back({ std::unique_ptr<Body>(bullet), position, frame });
+		}
+		timers[0].measure([step]() { Physics::step(step); });
+
+		// A bullet tunnels if it crossed the wall's plane within the wall's span
+		for (Shot& shot : shots) {
+			glm::vec2 position = glm::vec2(ecs::get<Position>(*shot.body).position);
+			bool crossed = (shot.last_position.x < 0.f) && (position.x > 0.f);
+			bool within  = (std::abs(position.y) < wall_half_height) && (std::abs(shot.last_position.y) < wall_half_height);
+			if (crossed && within) {
+				tunneled++;
+			}
+			shot.last_position = position;
+		}
+		shots.erase(
+			std::remove_if(shots.begin(), shots.end(), [frame, lifetime](Shot const& shot) {
+				return frame - shot.fired >= lifetime;
+			}),
+			shots.end()
+		);
+		ecs::cleanup<Position>();
+		ecs::cleanup<Physics>();
+	}
+	Settings ran = settings;
+	ran.frames = frame;
+	report(ran, timers);
+	std::cout << "  bullets     " << fired << " fired" << std::endl;
+	std::cout << "  tunneled    " << tunneled << std::endl;
+}
+
+
+void run_lookup(Settings const& settings) {
+	size_t const lookup_count = 100000;
+	ecs::SparseSet<glm::vec3> positions;
+	std::vector<size_t> ids;
+	for (size_t i = 0; i < settings.count; i++) {
+		Body* body = new Body({ random_range(-1.f, 1.f), random_range(-1.f, 1.f) }, { 0.f, 0.f }, { 0.01f, 0.01f }, false);
+		ids.push_back(*body);
+		positions.emplace(*body, ecs::get<Position>(*body).position);
+	}
+	std::vector<size_t> order(lookup_count);
+	for (size_t i = 0; i < lookup_count; i++) {
+		order[i] = ids[rand() % ids.size()];
+	}
+
+	// Summing the results keeps the lookups from being optimized away
+	float sum = 0.f;
+	std::vector<Timer> timers = { {"component"}, {"sparse_set"} };
+	for (size_t frame = 0; frame < settings.frames; frame++) {
+		timers[0].measure([&]() {
+			for (size_t id : order) {
+				sum += ecs::get<Position>(id).position.x;
+			}
+		});
+		timers[1].measure([&]() {
+			for (size_t id : order) {
+				sum += positions.get(id).x;
+			}
+		});
+	}
+	report(settings, timers);
+	std::cout << "  checksum    " << sum << std::endl;
+}
+
+
+// Stands in for GL with a linked sprite program, so the cost of setting
+// uniforms can be measured without a context
+namespace mock {
+
+	struct Uniform {
+		char const* name;
+		GLenum      type;
+	};
+
+	Uniform const uniforms[] = {
+		{ "cam_pos", GL_FLOAT_VEC2 },
+		{ "depth",   GL_FLOAT      },
+		{ "offset",  GL_FLOAT_VEC2 },
+		{ "scale",   GL_FLOAT_VEC2 },
+		{ "tex",     GL_SAMPLER_2D },
+	};
+	GLint const uniform_count = sizeof(uniforms) / sizeof(Uniform);
+
+	size_t uploads = 0;
+	float  sink    = 0.f;
+
+	void get_program(GLuint program, GLenum name, GLint* value) {
+		*value = (name == GL_ACTIVE_UNIFORMS) ? uniform_count : 16;
+	}
+
+	void get_active_uniform(GLuint program, GLuint index, GLsizei buffer_size, GLsizei* length, GLint* size, GLenum* type, GLchar* name) {
+		*length = (GLsizei) strlen(uniforms[index].name);
+		*size   = 1;
+		*type   = uniforms[index].type;
+		memcpy(name, uniforms[index].name, *length + 1);
+	}
+
+	GLint get_location(GLuint program, GLchar const* name) {
+		for (GLint i = 0; i < uniform_count; i++) {
+			if (strcmp(uniforms[i].name, name) == 0) {
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	void upload(GLint location, GLenum type, GLsizei count, void const* data) {
+		uploads++;
+		sink += *static_cast<float const*>(data);
+	}
+
+}
+
+void run_uniforms(Settings const& settings) {
+	uniform::functions = { mock::get_program, mock::get_active_uniform, mock::get_location, mock::upload };
+	UniformTable& table = UniformTable::build(1);
+
+	// Offsets differ per sprite, while the rest mostly repeat, as they do in
+	// a typical scene
+	std::vector<glm::vec2> offsets(settings.count);
+	for (glm::vec2& offset : offsets) {
+		offset = glm::vec2(random_range(-1.f, 1.f), random_range(-1.f, 1.f));
+	}
+	float const     depths[] = { -0.1f, -0.15f, -0.2f };
+	glm::vec2 const scale(0.03f, 0.03f);
+	glm::vec2 const camera(0.5f, 0.5f);
+
+	std::vector<Timer> timers = { {"by_name"}, {"table"}, {"handle"} };
+	std::vector<size_t> uploads(timers.size(), 0);
+
+	// Calls go through the function table, as they would through the GL
+	// loader's function pointers
+	auto by_name = [](char const* name, GLenum type, void const* data) {
+		uniform::functions.upload(uniform::functions.get_location(1, name), type, 1, data);
+	};
+	auto by_table = [&table](char const* name, void const* data, size_t bytes) {
+		table.set(table.find(name), data, bytes);
+	};
+	UniformHandle<glm::vec2> offset_handle(table, "offset");
+	UniformHandle<GLfloat>   depth_handle(table, "depth");
+	UniformHandle<glm::vec2> scale_handle(table, "scale");
+	UniformHandle<GLint>     tex_handle(table, "tex");
+	UniformHandle<glm::vec2> cam_handle(table, "cam_pos");
+
+	GLint const unit = 0;
+	for (size_t frame = 0; frame < settings.frames; frame++) {
+		size_t before = mock::uploads;
+		timers[0].measure([&]() {
+			for (size_t i = 0; i < offsets.size(); i++) {
+				by_name("offset",  GL_FLOAT_VEC2, &offsets[i]);
+				by_name("depth",   GL_FLOAT,      &depths[i % 3]);
+				by_name("scale",   GL_FLOAT_VEC2, &scale);
+				by_name("tex",     GL_SAMPLER_2D, &unit);
+				by_name("cam_pos", GL_FLOAT_VEC2, &camera);
+			}
+		});
+		uploads[0] += mock::uploads - before;
+
+		before = mock::uploads;
+		timers[1].measure([&]() {
+			for (size_t i = 0; i < offsets.size(); i++) {
+				by_table("offset",  &offsets[i],    sizeof(glm::vec2));
+				by_table("depth",   &depths[i % 3], sizeof(GLfloat));
+				by_table("scale",   &scale,         sizeof(glm::vec2));
+				by_table("tex",     &unit,          sizeof(GLint));
+				by_table("cam_pos", &camera,        sizeof(glm::vec2));
+			}
+		});
+		uploads[1] += mock::uploads - before;
+
+		before = mock::uploads;
+		table.forget();
+		timers[2].measure([&]() {
+			for (size_t i = 0; i < offsets.size(); i++) {
+				offset_handle = offsets[i];
+				depth_handle  = depths[i % 3];
+				scale_handle  = scale;
+				tex_handle    = unit;
+				cam_handle    = camera;
+			}
+		});
+		uploads[2] += mock::uploads - before;
+		table.forget();
+	}
+	report(settings, timers);
+	for (size_t i = 0; i < timers.size(); i++) {
+		std::cout << "  " << std::left << std::setw(12) << timers[i].name
+			<< (uploads[i] / settings.frames) << " uploads/frame" << std::endl;
+	}
+	std::cout << "  checksum    " << mock::sink << std::endl;
+	uniform::functions = uniform::gl_functions();
+}
+
+// The caches as they were before names were interned: the path is copied
+// into a std::string, then looked up three times
+namespace string_keys {
+
+	std::unordered_map<std::string, std::shared_ptr<Texture>>    textures;
+	std::unordered_map<std::string, std::shared_ptr<GPUProgram>> programs;
+
+	std::shared_ptr<Texture> load_texture(std::string file_path) {
+		if (textures.find(file_path) == textures.end()) {
+			textures[file_path] = nullptr;
+		}
+		return textures[file_path];
+	}
+
+	std::shared_ptr<GPUProgram> load_program(std::string vertex, std::string fragment) {
+		std::string key = vertex + '\n' + fragment;
+		if (programs.count(key) == 0) {
+			programs[key] = nullptr;
+		}
+		return programs[key];
+	}
+
+}
+
+void run_assets(Settings const& settings) {
+	char const* texture_path  = "assets/shoot_texture.png";
+	char const* vertex_path   = "shaders/sprite.vert";
+	char const* fragment_path = "shaders/sprite.frag";
+	AssetId texture_id  = AssetIds::intern(texture_path);
+	AssetId vertex_id   = AssetIds::intern(vertex_path);
+	AssetId fragment_id = AssetIds::intern(fragment_path);
+	TextureCache::load(texture_id, false);
+	ProgramCache::load(vertex_id, fragment_id);
+
+	std::vector<Timer> timers = { {"string"}, {"view"}, {"id"}, {"parallel"} };
+	// Headless caches hold null, so every load adds one. This keeps the
+	// loads from being optimized out.
+	size_t checksum = 0;
+	for (size_t frame = 0; frame < settings.frames; frame++) {
+		timers[0].measure([&]() {
+			for (size_t i = 0; i < settings.count; i++) {
+				checksum += (string_keys::load_texture(texture_path) == nullptr);
+				checksum += (string_keys::load_program(vertex_path, fragment_path) == nullptr);
+			}
+		});
+		timers[1].measure([&]() {
+			for (size_t i = 0; i < settings.count; i++) {
+				checksum += (TextureCache::load(texture_path, false) == nullptr);
+				checksum += (ProgramCache::load(vertex_path, fragment_path) == nullptr);
+			}
+		});
+		timers[2].measure([&]() {
+			for (size_t i = 0; i < settings.count; i++) {
+				checksum += (TextureCache::load(texture_id, false) == nullptr);
+				checksum += (ProgramCache::load(vertex_id, fragment_id) == nullptr);
+			}
+		});
+		std::atomic<size_t> parallel_sum(0);
+		timers[3].measure([&]() {
+			JobPool::parallel_for(settings.count, 256, [&](size_t begin, size_t end) {
+				size_t local = 0;
+				for (size_t i = begin; i < end; i++) {
+					local += (AssetIds::find(texture_path) == texture_id);
+					local += (TextureCache::find(texture_id) == nullptr);
+				}
+				parallel_sum += local;
+			});
+		});
+		checksum += parallel_sum;
+	}
+	report(settings, timers);
+	for (Timer const& timer : timers) {
+		double per_load = timer.total_ms * 1e6 / ((double) settings.frames * settings.count * 2);
+		std::cout << "  " << std::left << std::setw(12) << timer.name
+			<< std::setprecision(1) << per_load << " ns/load" << std::endl;
+	}
+	std::cout << "  checksum    " << checksum << std::endl;
+}
+
+void run_levelload(Settings const& settings) {
+	register_level_classes();
+	std::string const text_path     = "levelload.txt";
+	std::string const compiled_path = "levelload.lvl";
+	{
+		std::ofstream file(text_path);
+		for (size_t i = 0; i < settings.count; i++) {
+			file << "wall " << random_range(-100.f, 100.f) << " " << random_range(-100.f, 100.f)
+				<< " 0.05 0.05 wall.png shaders/tile.vert shaders/tile.frag\n";
+		}
+		file << "\n";
+		for (size_t i = 0; i < settings.count / 100; i++) {
+			file << "enemy " << random_range(-100.f, 100.f) << " " << random_range(-100.f, 100.f) << "\n";
+		}
+	}
+
+	std::vector<Timer> timers = { {"text"}, {"compile"}, {"compiled"} };
+	size_t quads = 0;
+	timers[0].measure([&]() {
+		Level level(text_path);
+		quads += level.grid.back().size();
+	});
+	Creature::alive.clear();
+	timers[1].measure([&]() {
+		Level::compile(text_path, compiled_path);
+	});
+	timers[2].measure([&]() {
+		Level level(compiled_path);
+		quads += level.grid.back().size();
+	});
+	Creature::alive.clear();
+	// Each version is loaded once, so the times reported are per load
+	Settings once = settings;
+	once.frames = 1;
+	report(once, timers);
+	std::cout << "  quads       " << quads << std::endl;
+}
+
+// The level parsers as they were before dispatching on the keyword: every
+// class re-reads the line with a stringstream until one accepts it
+namespace stream_parsers {
+
+	bool tiled(char const* keyword, std::string const& line) {
+		std::stringstream stream(line);
+		std::string token;
+		if (!(stream >> token) || (token != keyword)) {
+			return false;
+		}
+		glm::vec2 pos, scale;
+		if (!(stream >> pos.x >> pos.y >> scale.x >> scale.y >> token)) {
+			return false;
+		}
+		std::string tex_path = "assets/" + token;
+		std::string vertex, fragment;
+		stream >> vertex >> fragment;
+		return true;
+	}
+
+	bool text(std::string const& line) {
+		std::stringstream stream(line);
+		std::string token;
+		if (!(stream >> token) || (token != "text")) {
+			return false;
+		}
+		glm::vec2 pos, scale;
+		glm::ivec2 dims;
+		if (!(stream >> pos.x >> pos.y >> scale.x >> scale.y >> dims.x >> dims.y >> token)) {
+			return false;
+		}
+		std::string rest;
+		std::getline(stream, rest);
+		return true;
+	}
+
+	bool creature(char const* keyword, std::string const& line) {
+		std::stringstream stream(line);
+		std::string token;
+		stream >> token;
+		glm::vec2 position;
+		return (token == keyword) && (stream >> position.x >> position.y);
+	}
+
+	size_t parse(std::string const& file_path) {
+		std::ifstream file(file_path);
+		std::string line;
+		size_t lines = 0;
+		while (std::getline(file, line) && !line.empty()) {
+			if (!(tiled("wall", line) || tiled("back", line) || text(line))) {
+				throw std::runtime_error("Failed to parse '" + line + "'.");
+			}
+			lines++;
+		}
+		while (std::getline(file, line) && !line.empty()) {
+			if (!(creature("bird", line) || creature("enemy", line))) {
+				throw std::runtime_error("Failed to parse '" + line + "'.");
+			}
+			lines++;
+		}
+		return lines;
+	}
+
+}
+
+void run_parse(Settings const& settings) {
+	register_level_classes();
+	std::string const path = "parse.txt";
+	{
+		std::ofstream file(path);
+		size_t creatures = settings.count / 10;
+		for (size_t i = 0; i + creatures < settings.count; i++) {
+			float x = random_range(-100.f, 100.f);
+			float y = random_range(-100.f, 100.f);
+			switch (i % 9) {
+			case 0:
+				file << "text " << x << " " << y << " 1.0 0.4 20 8 Line number " << i << " of a generated level\n";
+				break;
+			case 1: case 2: case 3: case 4:
+				file << "wall " << x << " " << y << " 0.05 0.05 wall.png shaders/tile.vert shaders/tile.frag\n";
+				break;
+			default:
+				file << "back " << x << " " << y << " 0.05 0.05 floor.png\n";
+				break;
+			}
+		}
+		file << "\n";
+		for (size_t i = 0; i < creatures; i++) {
+			file << "enemy " << random_range(-100.f, 100.f) << " " << random_range(-100.f, 100.f) << "\n";
+		}
+	}
+
+	std::vector<Timer> timers = { {"stream"}, {"tokens"} };
+	std::vector<size_t> lines(timers.size(), 0);
+	for (size_t frame = 0; frame < settings.frames; frame++) {
+		timers[0].measure([&]() {
+			lines[0] += stream_parsers::parse(path);
+		});
+		timers[1].measure([&]() {
+			Level::Records records;
+			Level::parse_text(path, records);
+			lines[1] += records.quads.size() + records.creatures.size();
+		});
+	}
+	report(settings, timers);
+	for (size_t i = 0; i < timers.size(); i++) {
+		double per_second = lines[i] / (timers[i].total_ms / 1000.0);
+		std::cout << "  " << std::left << std::setw(12) << timers[i].name
+			<< std::setprecision(0) << per_second << " lines/s" << std::endl;
+	}
+}
+
+void run_stream(Settings const& settings) {
+	register_level_classes();
+	std::string const text_path     = "stream.txt";
+	std::string const compiled_path = "stream.lvl";
+	{
+		std::ofstream file(text_path);
+		for (size_t i = 0; i < settings.count; i++) {
+			file << "wall " << random_range(-100.f, 100.f) << " " << random_range(-100.f, 100.f)
+				<< " 0.05 0.05 wall.png shaders/tile.vert shaders/tile.frag\n";
+		}
+		file << "\n";
+	}
+	Level::compile(text_path, compiled_path);
+
+	std::vector<Timer> timers = { {"eager load"}, {"stream load"}, {"stream"} };
+	timers[0].measure([&]() {
+		Level level(compiled_path);
+	});
+	Level::StreamSettings stream_settings = { 2.f, 4.f, settings.count / 10, 2000 };
+	size_t peak = 0;
+	timers[1].measure([&]() {
+		Level level(compiled_path, stream_settings);
+		level.stream(glm::vec2(-90, -90));
+	});
+	Level level(compiled_path, stream_settings);
+	for (size_t frame = 0; frame < settings.frames; frame++) {
+		float along = (float) frame / settings.frames;
+		glm::vec2 focus = glm::mix(glm::vec2(-90, -90), glm::vec2(90, 90), along);
+		timers[2].measure([&]() {
+			level.stream(focus);
+		});
+		peak = std::max(peak, level.resident_quads());
+	}
+	// The loads happen once, so their times are per load
+	Settings once = settings;
+	once.frames = 1;
+	report(once, { timers[0], timers[1] });
+	report(settings, { timers[2] });
+	std::cout << "  peak quads  " << peak << std::endl;
+	std::cout << "  final quads " << level.resident_quads() << std::endl;
+}
+
+void run_spawn(Settings const& settings) {
+	register_level_classes();
+	Level::Records records;
+	uint32_t texture  = records.strings.add("assets/wall.png");
+	uint32_t vertex   = records.strings.add("shaders/tile.vert");
+	uint32_t fragment = records.strings.add("shaders/tile.frag");
+	std::vector<LevelRecord const*> pointers;
+	records.quads.reserve(settings.count);
+	for (size_t i = 0; i < settings.count; i++) {
+		LevelRecord record = LevelRecord::blank();
+		record.set(glm::vec2(random_range(-100.f, 100.f), random_range(-100.f, 100.f)), glm::vec2(0.05f, 0.05f), glm::ivec2(0, 0));
+		record.strings[0] = texture;
+		record.strings[1] = vertex;
+		record.strings[2] = fragment;
+		records.quads.push_back(record);
+	}
+	for (LevelRecord const& record : records.quads) {
+		pointers.push_back(&record);
+	}
+
+	std::vector<Timer> timers = { {"single"}, {"batch"}, {"destroy"} };
+	std::vector<Quad*> quads;
+	auto destroy = [&]() {
+		for (Quad* quad : quads) {
+			delete quad;
+		}
+		quads.clear();
+		ecs::cleanup<Physics>();
+		ecs::cleanup<Sprite>();
+		ecs::cleanup<Position>();
+	};
+	for (size_t frame = 0; frame < settings.frames; frame++) {
+		// Each frame starts from empty sets, as a level load would
+		ecs::ComponentSet<Position>::data.shrink_to_fit();
+		ecs::ComponentSet<Sprite>::data.shrink_to_fit();
+		ecs::ComponentSet<Physics>::data.shrink_to_fit();
+		timers[0].measure([&]() {
+			for (LevelRecord const& record : records.quads) {
+				quads.push_back(construct<Wall>(record, records.strings));
+			}
+		});
+		timers[2].measure(destroy);
+		ecs::ComponentSet<Position>::data.shrink_to_fit();
+		ecs::ComponentSet<Sprite>::data.shrink_to_fit();
+		ecs::ComponentSet<Physics>::data.shrink_to_fit();
+		timers[1].measure([&]() {
+			construct_batch<Wall>(pointers.data(), pointers.size(), records.strings, quads);
+		});
+		timers[2].measure(destroy);
+	}
+	report(settings, timers);
+}
+
+void run_targets(Settings const& settings) {
+	register_level_classes();
+	float const side = std::sqrt((float) settings.count) * 0.05f;
+	for (size_t i = 0; i < settings.count; i++) {
+		glm::vec2 position(random_range(-side, side), random_range(-side, side));
+		Creature::track_life(std::shared_ptr<Creature>(new Enemy(position)));
+	}
+	for (size_t i = 0; i < settings.count / 10; i++) {
+		glm::vec2 position(random_range(-side, side), random_range(-side, side));
+		Creature::track_life(std::shared_ptr<Creature>(new Bird(position)));
+	}
+	std::vector<size_t> enemies;
+	for (auto const& creature : Creature::alive) {
+		if (ecs::get<Status>(*creature).alignment == Status::EVIL) {
+			enemies.push_back(*creature);
+		}
+	}
+
+	std::vector<Timer> timers = { {"every"}, {"refresh"}, {"faction"}, {"rebuild"}, {"nearest"} };
+	std::vector<size_t> every_targets(enemies.size());
+	std::vector<size_t> faction_targets(enemies.size());
+	std::vector<size_t> index_targets(enemies.size());
+	size_t tests = 0;
+	for (size_t frame = 0; frame < settings.frames; frame++) {
+		timers[0].measure([&]() {
+			for (size_t k = 0; k < enemies.size(); k++) {
+				glm::vec3& my_pos = ecs::get<Position>(enemies[k]);
+				size_t target = 0;
+				float target_dist = std::numeric_limits<float>::infinity();
+				for (auto const& creature : Creature::alive) {
+					glm::vec3& other_pos = ecs::get<Position>(*creature);
+					Status& status = ecs::get<Status>(*creature);
+					float dist = glm::distance(my_pos, other_pos);
+					if ((status.alignment == Status::GOOD) && (dist < target_dist)) {
+						target = *creature;
+						target_dist = dist;
+					}
+					tests++;
+				}
+				every_targets[k] = target;
+			}
+		});
+		timers[1].measure([]() { FactionIndex::refresh(); });
+		timers[2].measure([&]() {
+			FactionSpan allies = FactionIndex::members(Status::GOOD);
+			for (size_t k = 0; k < enemies.size(); k++) {
+				glm::vec2 my_pos = glm::vec2(ecs::get<Position>(enemies[k]).position);
+				size_t target = 0;
+				float target_dist = std::numeric_limits<float>::infinity();
+				for (size_t i = 0; i < allies.count; i++) {
+					float dist = glm::distance(my_pos, allies.positions[i]);
+					if ((dist < target_dist) || ((dist == target_dist) && (allies.ids[i] < target))) {
+						target = allies.ids[i];
+						target_dist = dist;
+					}
+				}
+				faction_targets[k] = target;
+			}
+		});
+		timers[3].measure([]() { SpatialIndex::rebuild(); });
+		timers[4].measure([&]() {
+			for (size_t k = 0; k < enemies.size(); k++) {
+				glm::vec2 my_pos = glm::vec2(ecs::get<Position>(enemies[k]).position);
+				SpatialHit hit;
+				SpatialIndex::nearest(my_pos, Status::GOOD, std::numeric_limits<float>::infinity(), hit);
+				index_targets[k] = hit.id;
+			}
+		});
+	}
+	report(settings, timers);
+	size_t same = 0;
+	for (size_t k = 0; k < enemies.size(); k++) {
+		same += (every_targets[k] == index_targets[k]) && (faction_targets[k] == index_targets[k]);
+	}
+	std::cout << "  tests       " << tests / settings.frames << " distance tests per frame when testing every creature" << std::endl;
+	std::cout << "  agreement   " << same << " of " << enemies.size() << " targets" << std::endl;
+}
+
+
+void run_schedule(Settings const& settings) {
+	register_level_classes();
+	float const side = std::sqrt((float) settings.count) * 0.05f;
+	for (size_t i = 0; i < settings.count; i++) {
+		glm::vec2 position(random_range(-side, side), random_range(-side, side));
+		Creature::track_life(std::shared_ptr<Creature>(new Enemy(position)));
+	}
+	Creature::track_life(std::shared_ptr<Creature>(new Bird({ 0.f, 0.f })));
+	Sprite::cam_pos = glm::vec2(0.f, 0.f);
+
+	float const inf = std::numeric_limits<float>::infinity();
+	AISchedule const defaults = AI::schedule;
+	AISchedule every_step = { inf, inf, 1, 1, 0.f, 0.f, std::numeric_limits<size_t>::max(), std::numeric_limits<double>::infinity() };
+	AISchedule budgeted = defaults;
+	budgeted.budget_agents = 1000;
+	AISchedule timed = defaults;
+	timed.budget_seconds = 0.0005;
+	AISchedule const schedules[] = { every_step, defaults, budgeted, timed };
+
+	std::vector<Timer> timers = { {"every"}, {"scheduled"}, {"budgeted"}, {"timed"} };
+	for (size_t k = 0; k < timers.size(); k++) {
+		AI::configure(schedules[k]);
+		AIStats totals = AIStats();
+		for (size_t frame = 0; frame < settings.frames; frame++) {
+			FactionIndex::refresh();
+			SpatialIndex::rebuild();
+			timers[k].measure([]() { AI::update(1.f / 60.f); });
+			AIStats const& stats = AI::last_update();
+			totals.critical    += stats.critical;
+			totals.ran         += stats.ran;
+			totals.skipped     += stats.skipped;
+			totals.over_budget += stats.over_budget;
+		}
+		std::cout << "  " << timers[k].name << " ran " << totals.ran / settings.frames
+			<< ", critical " << totals.critical / settings.frames
+			<< ", skipped " << totals.skipped / settings.frames
+			<< ", over budget " << totals.over_budget / settings.frames
+			<< " of " << AI::last_update().agents << " agents per frame" << std::endl;
+	}
+	AI::configure(defaults);
+	report(settings, timers);
+}
+
+
+void run_flowfield(Settings const& settings) {
+	int const side = 512;
+	FlowField field;
+	field.configure(1.f, { side, side }, { 0, 0 });
+	for (int i = 0; i < 4000; i++) {
+		glm::vec2 corner(random_range(0.f, (float) side), random_range(0.f, (float) side));
+		glm::vec2 size = (rand() % 2) ? glm::vec2(random_range(2.f, 16.f), 1.f) : glm::vec2(1.f, random_range(2.f, 16.f));
+		field.block(corner, corner + size - 0.5f);
+	}
+	FlowField fresh = field;
+	std::vector<glm::vec2> goals(8);
+	for (glm::vec2& goal : goals) {
+		goal = glm::vec2(random_range(0.f, (float) side), random_range(0.f, (float) side));
+	}
+	std::vector<glm::vec2> agents(settings.count);
+	for (glm::vec2& agent : agents) {
+		agent = glm::vec2(random_range(0.f, (float) side), random_range(0.f, (float) side));
+	}
+
+	std::vector<Timer> timers = { {"one moved"}, {"all moved"}, {"rebuild"}, {"sample"} };
+	field.set_goals(goals.data(), goals.size());
+	field.update();
+	auto wander = [side](glm::vec2& goal) {
+		goal += glm::vec2((float) (rand() % 3 - 1), (float) (rand() % 3 - 1));
+		goal  = glm::clamp(goal, glm::vec2(0.f, 0.f), glm::vec2(side - 0.5f, side - 0.5f));
+	};
+	size_t settled_one = 0;
+	size_t settled_all = 0;
+	size_t steered     = 0;
+	for (size_t frame = 0; frame < settings.frames; frame++) {
+		wander(goals[frame % goals.size()]);
+		field.set_goals(goals.data(), goals.size());
+		timers[0].measure([&]() { field.update(); });
+		settled_one += field.last_update().settled_cells;
+		for (glm::vec2& goal : goals) {
+			wander(goal);
+		}
+		field.set_goals(goals.data(), goals.size());
+		timers[1].measure([&]() { field.update(); });
+		settled_all += field.last_update().settled_cells;
+		fresh.set_goals(goals.data(), goals.size());
+		fresh.invalidate();
+		timers[2].measure([&]() { fresh.update(); });
+		timers[3].measure([&]() {
+			for (glm::vec2 const& agent : agents) {
+				glm::vec2 heading;
+				steered += field.direction(agent, heading);
+			}
+		});
+	}
+	report(settings, timers);
+	size_t same = 0;
+	for (int y = 0; y < side; y++) {
+		for (int x = 0; x < side; x++) {
+			glm::vec2 center(x + 0.5f, y + 0.5f);
+			same += field.cost(center) == fresh.cost(center);
+		}
+	}
+	std::cout << "  settled     " << settled_one / settings.frames << " cells with one goal moved, "
+		<< settled_all / settings.frames << " with all moved, of " << side * side << std::endl;
+	std::cout << "  steered     " << steered / settings.frames << " of " << agents.size() << " agents per frame" << std::endl;
+	std::cout << "  agreement   " << same << " of " << side * side << " costs match a full rebuild" << std::endl;
+}
+
+
+void run_chase(Settings const& settings) {
+	struct Variant {
+		float scale;
+		int   slack;
+	};
+	Variant const variants[] = { { 0.05f, 0 }, { 0.05f, 2 }, { 0.1f, 0 }, { 0.1f, 2 } };
+	std::vector<std::pair<glm::vec2, glm::vec2>> walls(200);
+	for (auto& wall : walls) {
+		wall.first  = glm::vec2(random_range(-10.f, 10.f), random_range(-10.f, 10.f));
+		wall.second = wall.first + ((rand() % 2) ? glm::vec2(random_range(0.2f, 1.5f), 0.1f) : glm::vec2(0.1f, random_range(0.2f, 1.5f)));
+	}
+
+	std::vector<Timer> timers;
+	std::vector<size_t> rebuilds;
+	for (Variant const& variant : variants) {
+		int const side = (int) std::lround(20.f / variant.scale);
+		FlowField field;
+		field.configure(variant.scale, { side, side }, { -side / 2, -side / 2 });
+		field.set_slack(variant.slack);
+		for (auto const& wall : walls) {
+			field.block(wall.first, wall.second);
+		}
+		std::string name = std::to_string(side) + (variant.slack ? " slack" : "");
+		timers.push_back({ name });
+		rebuilds.push_back(0);
+		// About the speed of the bird, a unit a second
+		for (size_t frame = 0; frame < settings.frames; frame++) {
+			float angle = (float) frame / 180.f;
+			glm::vec2 goal = 3.f * glm::vec2(std::cos(angle), std::sin(angle));
+			field.set_goals(&goal, 1);
+			timers.back().measure([&]() { field.update(); });
+			rebuilds.back() += field.last_update().rebuilt;
+		}
+	}
+	report(settings, timers);
+	for (size_t k = 0; k < timers.size(); k++) {
+		std::cout << "  " << std::left << std::setw(12) << timers[k].name
+			<< rebuilds[k] << " of " << settings.frames << " updates rebuilt the field" << std::endl;
+	}
+}
+
+
+void run_particles(Settings const& settings) {
+	Physics::set_gravity(0.001f);
+	float const step = 1.f / 60.f;
+	float const life = step * (settings.frames + 1);
+	for (size_t i = 0; i < settings.count; i++) {
+		glm::vec2 position(random_range(-1.f, 1.f), random_range(-1.f, 1.f));
+		glm::vec2 velocity(random_range(-1.f, 1.f), random_range(-1.f, 1.f));
+		Body* body = new Body(position, velocity, { 0.01f, 0.01f }, false);
+		ecs::get<Physics>(*body).has_drag = true;
+		Particles::spawn(position, velocity, life, AtlasImage(), { 0.01f, 0.01f }, 0.f);
+	}
+
+	// Every body integrates as in Physics::step, looking up its position
+	std::vector<Timer> timers = { {"components"}, {"archetype"} };
+	for (size_t frame = 0; frame < settings.frames; frame++) {
+		timers[0].measure([step]() {
+			Physics::gather_bodies();
+			JobPool::parallel_for(Physics::bodies.size(), 256, [step](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					Physics::bodies[i]->delta_update(step);
+				}
+			});
+		});
+		timers[1].measure([step]() { Particles::step(step); });
+	}
+	report(settings, timers);
+
+	// Both ways move their copies of each body the same way
+	float body_sum = 0.f;
+	ecs::ComponentSet<Position>::for_each([&body_sum](Position& position) {
+		body_sum += position.position.x + position.position.y;
+	});
+	float particle_sum = 0.f;
+	Particles::for_each_chunk([&particle_sum](size_t count, size_t const* ids, ParticleBody* bodies, ParticleLook* looks) {
+		for (size_t i = 0; i < count; i++) {
+			particle_sum += bodies[i].position.x + bodies[i].position.y;
+		}
+	});
+	std::cout << "  checksum    " << body_sum << " " << particle_sum << std::endl;
+	std::cout << "  particles   " << Particles::size() << " alive at the end" << std::endl;
+}
+
+
+int main(int argc, char** argv) {
+	if ((argc == 4) && (std::string(argv[1]) == "compile")) {
+		register_level_classes();
+		Level::compile(argv[2], argv[3]);
+		return 0;
+	}
+
+	Settings settings = { "level", 1000, 600, 0, BroadPhase::grid };
+	if (argc > 1) {
+		settings.scenario = argv[1];
+	}
+	if (argc > 2) {
+		settings.count = std::stoul(argv[2]);
+	}
+	if (argc > 3) {
+		settings.frames = std::max<size_t>(std::stoul(argv[3]), 1);
+	}
+	if (argc > 4) {
+		settings.threads = std::stoul(argv[4]);
+	}
+	if ((argc > 5) && (std::string(argv[5]) == "sweep")) {
+		settings.broad_phase = BroadPhase::sweep;
+	}
+
+	// A fixed seed keeps runs comparable
+	srand(1);
+	JobPool::start(settings.threads);
+	Physics::set_broad_phase(settings.broad_phase);
+	Physics::collision_map.configure(0.1f, { 200, 200 }, { -100, -100 });
+	Physics::set_drag(0.1f);
+
+	if (settings.scenario == "level") {
+		run_level(settings);
+	}
+	else if (settings.scenario == "broadphase") {
+		run_broadphase(settings);
+	}
+	else if (settings.scenario == "tunnel") {
+		run_tunnel(settings);
+	}
+	else if (settings.scenario == "lookup") {
+		run_lookup(settings);
+	}
+	else if (settings.scenario == "uniforms") {
+		run_uniforms(settings);
+	}
+	else if (settings.scenario == "assets") {
+		run_assets(settings);
+	}
+	else if (settings.scenario == "levelload") {
+		run_levelload(settings);
+	}
+	else if (settings.scenario == "parse") {
+		run_parse(settings);
+	}
+	else if (settings.scenario == "stream") {
+		run_stream(settings);
+	}
+	else if (settings.scenario == "spawn") {
+		run_spawn(settings);
+	}
+	else if (settings.scenario == "targets") {
+		run_targets(settings);
+	}
+	else if (settings.scenario == "schedule") {
+		run_schedule(settings);
+	}
+	else if (settings.scenario == "flowfield") {
+		run_flowfield(settings);
+	}
+	else if (settings.scenario == "chase") {
+		run_chase(settings);
+	}
+	else if (settings.scenario == "particles") {
+		run_particles(settings);
+	}
+	else {
+		std::cerr << "Unknown scenario '" << settings.scenario << "'." << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,154 @@
+#include "jobs.h"
+
+
+namespace {
+
+	thread_local bool inside_job = false;
+
+	// Joins the workers during static destruction, since a joinable
+	// std::thread would otherwise terminate the program
+	struct PoolShutdown {
+		~PoolShutdown() {
+			JobPool::stop();
+		}
+	};
+
+}
+
+
+void JobPool::run_blocks() {
+	inside_job = true;
+	size_t block = next_block++;
+	while (block < block_count) {
+		size_t begin = block * task_block;
+		size_t end   = std::min(begin + task_block, task_count);
+		(*task)(begin, end);
+		if (--blocks_left == 0) {
+			std::lock_guard<std::mutex> lock(mutex);
+			done.notify_all();
+		}
+		block = next_block++;
+	}
+	inside_job = false;
+}
+
+void JobPool::worker_loop() {
+	size_t seen = 0;
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		wake.wait(lock, [&seen]() { return stopping || (generation != seen) || !background.empty(); });
+		if (stopping) {
+			return;
+		}
+		// Background jobs are not counted as active, so a long one never
+		// holds up the start of a parallel_for
+		if (generation == seen) {
+			std::function<void()> job = std::move(background.front());
+			background.pop_front();
+			lock.unlock();
+			job();
+			lock.lock();
+			continue;
+		}
+		seen = generation;
+		active++;
+		lock.unlock();
+		run_blocks();
+		lock.lock();
+		active--;
+		if (active == 0) {
+			done.notify_all();
+		}
+	}
+}
+
+void JobPool::start(size_t thread_count) {
+	static PoolShutdown shutdown;
+	stop();
+	if (thread_count == 0) {
+		size_t hardware = std::thread::hardware_concurrency();
+		thread_count = (hardware > 1) ? (hardware - 1) : 0;
+	}
+	stopping = false;
+	for (size_t i = 0; i < thread_count; i++) {
+		workers.emplace_back(worker_loop);
+	}
+}
+
+void JobPool::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+	background.clear();
+}
+
+size_t JobPool::thread_count() {
+	return workers.size() + 1;
+}
+
+void JobPool::parallel_for(size_t count, size_t block_size, std::function<void(size_t,size_t)> fn) {
+	if (count == 0) {
+		return;
+	}
+	block_size = std::max<size_t>(block_size, 1);
+	if (workers.empty() || inside_job || (count <= block_size)) {
+		for (size_t begin = 0; begin < count; begin += block_size) {
+			fn(begin, std::min(begin + block_size, count));
+		}
+		return;
+	}
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, []() { return active == 0; });
+		task        = &fn;
+		task_count  = count;
+		task_block  = block_size;
+		block_count = (count + block_size - 1) / block_size;
+		next_block  = 0;
+		blocks_left = block_count;
+		generation++;
+	}
+	wake.notify_all();
+	run_blocks();
+	// Wait for stragglers too, so no worker can still be holding 'fn'
+	// when the next call replaces it
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, []() { return (blocks_left == 0) && (active == 0); });
+	task = nullptr;
+}
+
+void JobPool::submit(std::function<void()> job) {
+	if (workers.empty()) {
+		job();
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		background.push_back(std::move(job));
+	}
+	wake.notify_one();
+}
+
+
+std::vector<std::thread>  JobPool::workers;
+std::mutex                JobPool::mutex;
+std::condition_variable   JobPool::wake;
+std::condition_variable   JobPool::done;
+bool                      JobPool::stopping   = false;
+size_t                    JobPool::generation = 0;
+size_t                    JobPool::active     = 0;
+
+std::function<void(size_t,size_t)> const* JobPool::task = nullptr;
+size_t              JobPool::task_count  = 0;
+size_t              JobPool::task_block  = 0;
+size_t              JobPool::block_count = 0;
+std::atomic<size_t> JobPool::next_block(0);
+std::atomic<size_t> JobPool::blocks_left(0);
+
+std::deque<std::function<void()>> JobPool::background;
@@ -0,0 +1,59 @@
+#ifndef JOBS
+#define JOBS
+
+#include "common.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+
+// A fixed set of worker threads shared by the engine's systems.
+//
+// parallel_for splits [0,count) into blocks of a fixed size, so the same
+// block always covers the same indexes no matter how many threads run it.
+// As long as each index only writes its own outputs, results do not depend
+// on the thread count. Calls made from inside a job run inline.
+//
+// submit queues a job to run in the background, for work such as decoding
+// files that should not hold up the frame. Idle workers take background jobs
+// one at a time, and prefer parallel_for blocks whenever both are waiting.
+class JobPool {
+
+	static std::vector<std::thread>  workers;
+	static std::mutex                mutex;
+	static std::condition_variable   wake;
+	static std::condition_variable   done;
+	static bool                      stopping;
+	static size_t                    generation;
+	static size_t                    active;
+
+	static std::function<void(size_t,size_t)> const* task;
+	static size_t              task_count;
+	static size_t              task_block;
+	static size_t              block_count;
+	static std::atomic<size_t> next_block;
+	static std::atomic<size_t> blocks_left;
+
+	static std::deque<std::function<void()>> background;
+
+	static void worker_loop();
+	static void run_blocks();
+
+public:
+
+	// Starts the pool with the given number of worker threads, in addition to
+	// the calling thread. Zero picks one less than the hardware thread count.
+	static void start(size_t thread_count);
+	static void stop();
+	static size_t thread_count();
+
+	static void parallel_for(size_t count, size_t block_size, std::function<void(size_t,size_t)> fn);
+
+	// Without worker threads the job runs immediately, on the calling thread
+	static void submit(std::function<void()> job);
+
+};
+
+
+#endif
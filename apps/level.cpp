@@ -1,393 +1,734 @@
-
-#include "level.h"
-#include "noise.h"
-
-
-Quad::Quad(glm::vec2 position, std::shared_ptr<Texture> tex, glm::vec2 dimensions)
-	: ecs::ComponentHandle<Position>(position)
-	, ecs::ComponentHandle<Sprite>(tex,dimensions)
-{}
-
-CollisionQuad::CollisionQuad(glm::vec2 position, std::shared_ptr<Texture> tex, glm::vec2 dimensions)
-	: Quad(position,tex,dimensions)
-{
-	Physics& phys = ecs::get<Physics>(id);
-	phys.fixed = true;
-	phys.solid = true;
-	phys.bbox_dims = glm::vec2(dimensions);
-}
-
-
-
-
-void Creature::logic(float delta) {}
-
-void Creature::on_death() {}
-
-void Creature::logic_trampoline(size_t id, float delta, void* self_ptr) {
-	Creature* self = (Creature*)self_ptr;
-	self->logic(delta);
-}
-
-Creature::Creature()
-	: ecs::ComponentHandle<Physics>()
-	, ecs::ComponentHandle<Sprite>(TextureCache::load("assets/placeholder.png",false),glm::vec2(0.1f,0.1f))
-	, ecs::ComponentHandle<AI>(logic_trampoline,this)
-	, ecs::ComponentHandle<Status>(0,0)
-{}
-
-void Creature::track_life(std::shared_ptr<Creature> creature) {
-	alive.push_back(creature);
-}
-
-void Creature::cleanup() {
-	std::vector<std::shared_ptr<Creature>> old_alive;
-	old_alive.reserve(alive.size());
-	std::swap(alive,old_alive);
-	for (auto creature : old_alive) {
-		Status& status = ecs::get<Status>(*creature);
-		if (status.health > 0) {
-			alive.push_back(creature);
-		}
-		else {
-			creature->on_death();
-		}
-	}
-}
-
-Creature::~Creature() {}
-
-
-std::vector<std::shared_ptr<Creature>> Creature::alive = std::vector<std::shared_ptr<Creature>>();
-
-
-Level::Level(std::string file_path) {
-	std::ifstream level_file(file_path);
-	if (!level_file) {
-		std::string message = "Failed to load level at '";
-		message += file_path + "'.";
-		throw std::runtime_error(message);
-	}
-	std::string line;
-	glm::ivec2 quad_pos(0, 0);
-	while (std::getline(level_file,line)) {
-		if (line.empty()) {
-			break;
-		}
-		Quad* quad = nullptr;
-		for (auto deser : quad_deserializers) {
-			quad = deser(line);
-			if (quad != nullptr) {
-				break;
-			}
-		}
-		if (quad == nullptr) {
-			std::string message = "Failed to deserialize quad from string '";
-			message = message + line + "'.";
-			throw std::runtime_error(message);
-		}
-	}
-
-	while (std::getline(level_file, line)) {
-		if (line.empty()) {
-			break;
-		}	
-		Creature* creature = nullptr;
-		for (auto deser : creature_deserializers) {
-			creature = deser(line);
-			if (creature != nullptr) {
-				break;
-			}
-		}
-		if (creature == nullptr) {
-			std::string message = "Failed to deserialize creature string '";
-			message = message + line + "'.";
-			throw std::runtime_error(message);
-		}
-		Creature::track_life(std::shared_ptr<Creature>(creature));
-	}
-}
-
-
-
-
-Level::~Level() {
-	for (auto row : grid) {
-		for (auto quad : row) {
-			delete quad;
-		}
-	}
-}
-
-std::vector < std::function<Quad* (std::string)> > Level::quad_deserializers = std::vector < std::function<Quad * (std::string)> >();
-std::vector < std::function<Creature* (std::string)> > Level::creature_deserializers = std::vector < std::function<Creature * (std::string)> >();
-
-
-
-
-void HealthBar::logic(size_t id, float delta, void* data) {
-	HealthBar* self = (HealthBar*)data;
-	if (! ecs::has<Status>(self->subject_id)) {
-		return;
-	}
-	Physics& self_phys     = ecs::get<Physics>(*self);
-	Sprite&  self_sprite   = ecs::get<Sprite>(*self);
-	Physics& subject_phys  = ecs::get<Physics>(self->subject_id);
-	Status&  subject_stat  = ecs::get<Status>(self->subject_id);
-	glm::vec3& self_pos    = ecs::get<Position>(id);
-	glm::vec3& subject_pos = ecs::get<Position>(self->subject_id);
-	self_pos = subject_pos + glm::vec3(0.0f,0.1f, -0.15f);
-	glm::vec2 new_dims(subject_stat.health * 0.001, 0.01);
-	self_sprite.scale = new_dims;
-	self_sprite.depth = -0.15f;
-}
-
-HealthBar::HealthBar(size_t subject_id)
-	: ecs::ComponentHandle<Physics>()
-	, ecs::ComponentHandle<Sprite>(TextureCache::load("assets/red.png",false),glm::vec2(0,0))
-	, ecs::ComponentHandle<AI>(logic,this)
-	, subject_id(subject_id)
-{
-	Physics& self_phys = ecs::get<Physics>(id);
-	self_phys.solid = false;
-}
-
-
-void Enemy::logic(float delta) {
-	Physics& my_phys = ecs::get<Physics>(id);
-	glm::vec3& my_pos = ecs::get<Position>(id);
-	Physics* target_phys = nullptr;
-	float target_dist = std::numeric_limits<float>::infinity();
-	for (auto creature : Creature::alive) {
-		glm::vec3& other_pos = ecs::get<Position>(*creature);
-		Status& status = ecs::get<Status>(*creature);
-		bool valid_target = (status.alignment == Status::GOOD);
-		Physics& other_phys = ecs::get<Physics>(*creature);
-		float dist = glm::distance(my_pos, other_pos);
-		bool target_closer = (target_phys == nullptr) || (dist < target_dist);
-		if (valid_target && target_closer) {
-			target_phys = &other_phys;
-			target_dist = dist;
-		}
-	}
-	if (target_phys != nullptr) {
-		glm::vec3& target_pos = ecs::get<Position>(target_phys->get_id());
-		glm::vec2 offset = target_pos - my_pos;
-		my_phys.velocity += glm::vec2(glm::normalize(target_pos - my_pos) * delta);
-	}
-}
-
-Enemy::Enemy(glm::vec2 position)
-	: Creature()
-	, health_bar(*this)
-{
-	glm::vec3& pos  = ecs::get<Position>(*this);
-	Physics& phys   = ecs::get<Physics>(*this);
-	Sprite & sprite = ecs::get<Sprite>(*this);
-	Status & status = ecs::get<Status>(*this);
-	phys.bbox_dims = glm::vec2(0.024f,0.024f);
-	pos = glm::vec3(position,0.f);
-	sprite.scale = glm::vec2(0.030f, 0.030f);
-	sprite.tex = TextureCache::load("assets/enemy.png",false);
-	sprite.depth = -0.1f;
-	status.health = 100;
-	status.alignment = Status::EVIL;
-	phys.on_collide.push_back([](size_t id) {
-		if (!ecs::has<Status>(id)) {
-			return;
-		}
-		Status & status = ecs::get<Status>(id);
-		if (status.alignment == Status::GOOD) {
-			status.health-=10;
-		}
-	});
-}
-
-
-void Bullet::logic(float delta) {
-	Status & status = ecs::get<Status>(*this);
-	status.health--;
-}
-
-Bullet::Bullet(glm::vec2 position, glm::vec2 velocity)
-	: Creature()
-{
-	glm::vec3& pos  = ecs::get<Position>(*this);
-	Physics& phys   = ecs::get<Physics>(*this);
-	Sprite & sprite = ecs::get<Sprite>(*this);
-	Status & status = ecs::get<Status>(*this);
-	phys.bbox_dims = glm::vec2(0.05f,0.05f);
-	pos = glm::vec3(position,0.0f);
-	phys.velocity = velocity;
-	phys.has_drag = false;
-	sprite.scale = glm::vec2(0.02f, 0.02f);
-	sprite.tex = TextureCache::load("assets/ally.png",false);
-	sprite.depth = -0.15f;
-	status.health = 10;
-	status.alignment = Status::NEUTRAL;
-	phys.on_collide.push_back([](size_t id) {
-		if (! ecs::has<Status>(id)) {
-			return;
-		}
-		Status & status = ecs::get<Status>(id);
-		if (status.alignment == Status::EVIL) {
-			status.health -= 10;
-		}
-	});
-}
-
-
-
-
-
-void PopUp::logic(float delta) {
-
-}
-
-void PopUp::on_death() {
-	mouseclick_callbacks.erase(id);
-}
-
-PopUp::PopUp(std::shared_ptr<Texture> tex, glm::vec2 position, glm::vec2 dimensions)
-{
-	glm::vec3& pos  = ecs::get<Position>(*this);
-	Sprite& sprite = ecs::get<Sprite>(id);
-	sprite.depth = -0.2f;
-	sprite.tex = tex;
-	sprite.scale = dimensions;
-	Physics& phys = ecs::get<Physics>(id);
-	phys.solid = false;
-	pos = glm::vec3(position,0.f);
-	ecs::get<Status>(id).health = 1;
-	mouseclick_callbacks[id] = [this](glm::vec2 pos) {
-		ecs::get<Status>(id).health = 0;
-	};
-}
-
-
-
-void Bird::logic(float delta) {
-
-	x_ease *= 0.9f;
-	y_ease *= 0.9f;
-
-	if ( (w_down || s_down) && (y_ease < 1.0f)) {
-		y_ease += 0.01f;
-	}
-
-	if ( (d_down || a_down) && (x_ease < 1.0f) ) {
-		x_ease += 0.01f;
-	}
-
-	float up_force = (w_down - s_down) * y_ease;
-	float right_force = (d_down - a_down) * x_ease;
-
-
-	Sprite& sprite = ecs::get<Sprite>(id);
-
-	if (shoot_cooldown <= 0) {
-		int frame_total = loop.tex_list.size() * loop.frames_per_tex;
-		loop.tex_iterator = (loop.tex_iterator + 1) % frame_total;
-		int tex_index = loop.tex_iterator / loop.frames_per_tex;
-		sprite.tex = loop.tex_list[tex_index];
-	}
-	else {
-		sprite.tex = TextureCache::load("assets/shoot_texture.png",false);
-	}
-
-
-	Physics& phys = ecs::get<Physics>(id);
-	phys.velocity += glm::vec2(right_force, up_force);
-
-	glm::vec3& pos  = ecs::get<Position>(*this);
-	Sprite::cam_pos = pos;
-
-	shoot_cooldown -= delta;
-
-}
-
-
-void Bird::on_death () {
-	Creature::track_life(std::shared_ptr<Creature>(new PopUp(
-		TextureCache::load("assets/game_over.png",false),
-		Sprite::cam_pos,
-		glm::vec2(0.5,0.5)
-	)));
-}
-
-Bird::Bird(glm::vec2 position)
-	: health_bar(*this)
-{
-	glm::vec3& pos  = ecs::get<Position>(*this);
-	Physics& phys   = ecs::get<Physics>(*this);
-	Sprite & sprite = ecs::get<Sprite>(*this);
-	Status & status = ecs::get<Status>(*this);
-	phys.bbox_dims = glm::vec2(0.08f,0.08f);
-	pos = glm::vec3(position,0.f);
-	sprite.scale = glm::vec2(0.1f, 0.1f);
-	sprite.tex = TextureCache::load("assets/bird1.png",false);
-	sprite.depth = -0.1f;
-	status.health = 100;
-	status.alignment = Status::GOOD;
-
-}
-
-
-float Bird::x_ease = 0.f;
-float Bird::y_ease = 0.f;
-bool  Bird::w_down = false;
-bool  Bird::a_down = false;
-bool  Bird::s_down = false;
-bool  Bird::d_down = false;
-float Bird::shoot_cooldown = 0.1f;
-AnimationLoop Bird::loop = AnimationLoop{};
-
-
-
-
-float random_norm() {
-	return (rand() % 10000) / 10000.0f;
-}
-
-
-
-
-template<>
-Bird* deserialize(std::string line) {
-	std::stringstream stream(line);
-	std::string creature_type;
-	stream >> creature_type;
-	if (creature_type != "bird") {
-		return nullptr;
-	}
-	glm::vec2 position;
-	if (!(stream >> position.x)) {
-		return nullptr;
-	}
-	if (!(stream >> position.y)) {
-		return nullptr;
-	}
-	return new Bird(position);
-}
-
-template<>
-Enemy* deserialize(std::string line) {
-	std::stringstream stream(line);
-	std::string creature_type;
-	stream >> creature_type;
-	if (creature_type != "enemy") {
-		return nullptr;
-	}
-	glm::vec2 position;
-	if (!(stream >> position.x)) {
-		return nullptr;
-	}
-	if (!(stream >> position.y)) {
-		return nullptr;
-	}
-	return new Enemy(position);
-}
-
-
-
-
+
+#include "level.h"
+#include "jobs.h"
+#include "navigation.h"
+#include "noise.h"
+#include "spatial.h"
+
+
+Quad::Quad(glm::vec2 position, std::shared_ptr<Texture> tex, glm::vec2 dimensions)
+	: ecs::ComponentHandle<Position>(position)
+	, ecs::ComponentHandle<Sprite>(tex,dimensions)
+{}
+
+Quad::Quad(glm::vec2 position, AtlasImage image, glm::vec2 dimensions)
+	: ecs::ComponentHandle<Position>(position)
+	, ecs::ComponentHandle<Sprite>(image,dimensions)
+{}
+
+Quad::Quad(glm::vec2 position, AtlasImage image, glm::vec2 dimensions, std::shared_ptr<GPUProgram> program)
+	: ecs::ComponentHandle<Position>(position)
+	, ecs::ComponentHandle<Sprite>(image,dimensions,program)
+{}
+
+// The physics component is made fixed and solid up front, rather than looked
+// up again afterwards
+CollisionQuad::CollisionQuad(glm::vec2 position, AtlasImage image, glm::vec2 dimensions)
+	: Quad(position,image,dimensions)
+	, ecs::ComponentHandle<Physics>(glm::vec2(dimensions),true)
+{}
+
+CollisionQuad::CollisionQuad(glm::vec2 position, AtlasImage image, glm::vec2 dimensions, std::shared_ptr<GPUProgram> program)
+	: Quad(position,image,dimensions,program)
+	, ecs::ComponentHandle<Physics>(glm::vec2(dimensions),true)
+{}
+
+
+
+
+void Creature::logic(float delta, AICommands& commands) {}
+
+void Creature::on_death() {}
+
+void Creature::logic_trampoline(size_t id, float delta, void* self_ptr, AICommands& commands) {
+	Creature* self = (Creature*)self_ptr;
+	self->logic(delta, commands);
+}
+
+Creature::Creature()
+	: ecs::ComponentHandle<Physics>()
+	, ecs::ComponentHandle<Sprite>(TextureAtlas::load("assets/placeholder.png"),glm::vec2(0.1f,0.1f))
+	, ecs::ComponentHandle<AI>(logic_trampoline,this)
+	, ecs::ComponentHandle<Status>(0,0)
+{}
+
+void Creature::track_life(std::shared_ptr<Creature> creature) {
+	alive.push_back(creature);
+}
+
+void Creature::cleanup() {
+	std::vector<std::shared_ptr<Creature>> old_alive;
+	old_alive.reserve(alive.size());
+	std::swap(alive,old_alive);
+	for (auto creature : old_alive) {
+		Status& status = ecs::get<Status>(*creature);
+		if (status.health > 0) {
+			alive.push_back(creature);
+		}
+		else {
+			FactionIndex::remove(*creature);
+			creature->on_death();
+		}
+	}
+}
+
+Creature::~Creature() {
+	FactionIndex::remove(id);
+}
+
+
+std::vector<std::shared_ptr<Creature>> Creature::alive = std::vector<std::shared_ptr<Creature>>();
+
+
+namespace {
+
+	char const level_magic[4] = { 'M', 'A', 'Z', 'E' };
+
+	size_t padded(size_t bytes) {
+		return (bytes + 3) & ~(size_t) 3;
+	}
+
+	// Finds the class for each tag once, rather than once per record
+	template<typename Base>
+	std::vector<Level::LevelClass<Base> const*> classes_by_tag(std::unordered_map<std::string_view, Level::LevelClass<Base>> const& classes, LevelStrings const& strings) {
+		std::vector<Level::LevelClass<Base> const*> result(strings.size(), nullptr);
+		for (uint32_t i = 0; i < strings.size(); i++) {
+			auto found = classes.find(strings.get(i));
+			if (found != classes.end()) {
+				result[i] = &found->second;
+			}
+		}
+		return result;
+	}
+
+	std::string_view tag_name(LevelRecord const& record, LevelStrings const& strings) {
+		return (record.tag < strings.size()) ? strings.get(record.tag) : std::string_view("?");
+	}
+
+	// Splits off the next line, without its line break
+	std::string_view next_line(std::string_view& text) {
+		size_t end = text.find('\n');
+		std::string_view line = text.substr(0, end);
+		text.remove_prefix((end == std::string_view::npos) ? text.size() : end + 1);
+		if (!line.empty() && (line.back() == '\r')) {
+			line.remove_suffix(1);
+		}
+		return line;
+	}
+
+	// Reads one section of a text level, which ends at the first empty line
+	template<typename Base>
+	void parse_section(std::string_view& text, std::unordered_map<std::string_view, Level::LevelClass<Base>> const& classes, char const* kind, LevelStrings& strings, std::vector<LevelRecord>& records) {
+		while (!text.empty()) {
+			std::string_view line = next_line(text);
+			if (line.empty()) {
+				break;
+			}
+			LineTokens tokens(line);
+			std::string_view keyword;
+			LevelRecord record = LevelRecord::blank();
+			auto found = classes.end();
+			if (tokens.next(keyword)) {
+				found = classes.find(keyword);
+			}
+			if ((found == classes.end()) || !found->second.parse(tokens, record, strings)) {
+				std::string message = "Failed to deserialize ";
+				message += std::string(kind) + " from string '" + std::string(line) + "'.";
+				throw std::runtime_error(message);
+			}
+			record.tag = strings.add(keyword);
+			records.push_back(record);
+		}
+	}
+
+}
+
+
+// The file is mapped and split into lines in place, so the only copies
+// made are of the strings that go into the table
+void Level::parse_text(std::string const& file_path, Records& records) {
+	std::unique_ptr<MappedFile> file;
+	try {
+		file.reset(new MappedFile(file_path));
+	}
+	catch (std::runtime_error const&) {
+		std::string message = "Failed to load level at '";
+		message += file_path + "'.";
+		throw std::runtime_error(message);
+	}
+	std::string_view text(static_cast<char const*>(file->data()), file->size());
+	parse_section(text, quad_classes, "quad", records.strings, records.quads);
+	parse_section(text, creature_classes, "creature", records.strings, records.creatures);
+}
+
+// Compiled levels are read straight from the mapping, after checking that
+// every section fits in the file
+std::shared_ptr<Level::Source> Level::open(std::string const& file_path) {
+	std::shared_ptr<Source> source(new Source());
+	char magic[4] = {};
+	{
+		std::ifstream probe(file_path, std::ios::binary);
+		probe.read(magic, sizeof(magic));
+	}
+	if (!std::equal(std::begin(magic), std::end(magic), level_magic)) {
+		parse_text(file_path, source->parsed);
+		source->strings        = &source->parsed.strings;
+		source->quads          = source->parsed.quads.data();
+		source->quad_count     = source->parsed.quads.size();
+		source->creatures      = source->parsed.creatures.data();
+		source->creature_count = source->parsed.creatures.size();
+		return source;
+	}
+
+	source->file.reset(new MappedFile(file_path));
+	MappedFile const& file = *source->file;
+	char const* base = static_cast<char const*>(file.data());
+	LevelFileHeader header;
+	if (file.size() < sizeof(header)) {
+		throw std::runtime_error("Level '" + file_path + "' is truncated.");
+	}
+	memcpy(&header, base, sizeof(header));
+	if (header.version != LevelFileHeader::current_version) {
+		std::string message = "Level '" + file_path + "' has version ";
+		message += std::to_string(header.version) + ", expected ";
+		message += std::to_string(LevelFileHeader::current_version) + ". Compile it again.";
+		throw std::runtime_error(message);
+	}
+	size_t offsets_at = sizeof(header);
+	size_t bytes_at   = offsets_at + ((size_t) header.string_count + 1) * sizeof(uint32_t);
+	size_t records_at = bytes_at + padded(header.string_bytes);
+	size_t end        = records_at + ((size_t) header.quad_count + header.creature_count) * sizeof(LevelRecord);
+	if (file.size() < end) {
+		throw std::runtime_error("Level '" + file_path + "' is truncated.");
+	}
+	uint32_t const* offsets = reinterpret_cast<uint32_t const*>(base + offsets_at);
+	for (uint32_t i = 0; i < header.string_count; i++) {
+		if ((offsets[i] > offsets[i + 1]) || (offsets[i + 1] > header.string_bytes)) {
+			throw std::runtime_error("Level '" + file_path + "' has a corrupt string table.");
+		}
+	}
+	source->file_strings.reset(new LevelStrings(offsets, base + bytes_at, header.string_count));
+	source->strings        = source->file_strings.get();
+	source->quads          = reinterpret_cast<LevelRecord const*>(base + records_at);
+	source->quad_count     = header.quad_count;
+	source->creatures      = source->quads + header.quad_count;
+	source->creature_count = header.creature_count;
+	return source;
+}
+
+// Records are grouped by class, keeping their order within each class, so
+// every class creates all of its quads in one batch
+void Level::construct_quads(std::vector<LevelRecord const*>& records, std::vector<Quad*>& quads) {
+	LevelStrings const& strings = *source->strings;
+	for (LevelRecord const* record : records) {
+		if ((record->tag >= quad_classes_by_tag.size()) || (quad_classes_by_tag[record->tag] == nullptr)) {
+			throw std::runtime_error("No registered class for level record '" + std::string(tag_name(*record, strings)) + "'.");
+		}
+	}
+	std::stable_sort(records.begin(), records.end(), [](LevelRecord const* lhs, LevelRecord const* rhs) {
+		return lhs->tag < rhs->tag;
+	});
+	quads.reserve(quads.size() + records.size());
+	size_t first = 0;
+	while (first < records.size()) {
+		size_t last = first + 1;
+		while ((last < records.size()) && (records[last]->tag == records[first]->tag)) {
+			last++;
+		}
+		quad_classes_by_tag[records[first]->tag]->construct_batch(records.data() + first, last - first, strings, quads);
+		first = last;
+	}
+}
+
+void Level::build_creatures() {
+	LevelStrings const& strings = *source->strings;
+	auto creature_classes_by_tag = classes_by_tag(creature_classes, strings);
+	for (size_t i = 0; i < source->creature_count; i++) {
+		LevelRecord const& record = source->creatures[i];
+		if ((record.tag >= creature_classes_by_tag.size()) || (creature_classes_by_tag[record.tag] == nullptr)) {
+			throw std::runtime_error("No registered class for level record '" + std::string(tag_name(record, strings)) + "'.");
+		}
+		Creature* creature = creature_classes_by_tag[record.tag]->construct(record, strings);
+		Creature::track_life(std::shared_ptr<Creature>(creature));
+	}
+}
+
+Level::Level(std::string file_path)
+	: source(open(file_path))
+	, streaming(false)
+	, settings()
+	, chunk_origin(0, 0)
+	, chunk_dims(0, 0)
+	, resident(0)
+{
+	quad_classes_by_tag = classes_by_tag(quad_classes, *source->strings);
+	// The level owns its quads, and deletes them with the grid
+	std::vector<LevelRecord const*> records(source->quad_count);
+	for (size_t i = 0; i < source->quad_count; i++) {
+		records[i] = &source->quads[i];
+	}
+	grid.emplace_back();
+	construct_quads(records, grid.back());
+	resident = source->quad_count;
+	build_creatures();
+}
+
+Level::Level(std::string file_path, StreamSettings settings)
+	: source(open(file_path))
+	, streaming(true)
+	, settings(settings)
+	, chunk_origin(0, 0)
+	, chunk_dims(0, 0)
+	, resident(0)
+{
+	if (settings.chunk_size <= 0.f) {
+		throw std::runtime_error("Level chunks must have a positive size.");
+	}
+	quad_classes_by_tag = classes_by_tag(quad_classes, *source->strings);
+	partition();
+	build_creatures();
+}
+
+// One pass over the quad records finds their bounds and sorts them into
+// chunks, without creating anything
+void Level::partition() {
+	glm::vec2 low( std::numeric_limits<float>::max());
+	glm::vec2 high(std::numeric_limits<float>::lowest());
+	for (size_t i = 0; i < source->quad_count; i++) {
+		glm::vec2 position = source->quads[i].get_position();
+		low  = glm::min(low, position);
+		high = glm::max(high, position);
+	}
+	if (source->quad_count == 0) {
+		low = high = glm::vec2(0, 0);
+	}
+	chunk_origin = low;
+	chunk_dims   = glm::ivec2(glm::floor((high - low) / settings.chunk_size)) + glm::ivec2(1, 1);
+
+	size_t chunk_count = (size_t) chunk_dims.x * chunk_dims.y;
+	source->chunk_quads.assign(chunk_count, std::vector<uint32_t>());
+	for (size_t i = 0; i < source->quad_count; i++) {
+		glm::ivec2 cell = glm::ivec2(glm::floor((source->quads[i].get_position() - chunk_origin) / settings.chunk_size));
+		cell = glm::clamp(cell, glm::ivec2(0, 0), chunk_dims - 1);
+		source->chunk_quads[(size_t) cell.y * chunk_dims.x + cell.x].push_back((uint32_t) i);
+	}
+	chunks.resize(chunk_count);
+	for (size_t i = 0; i < chunk_count; i++) {
+		glm::vec2 cell((float) (i % chunk_dims.x), (float) (i / chunk_dims.x));
+		chunks[i].center = chunk_origin + (cell + 0.5f) * settings.chunk_size;
+		chunks[i].state  = ChunkState::unloaded;
+	}
+	grid.assign(chunk_count, std::vector<Quad*>());
+}
+
+void Level::unload(size_t chunk) {
+	for (Quad* quad : grid[chunk]) {
+		delete quad;
+	}
+	resident -= grid[chunk].size();
+	grid[chunk].clear();
+	chunks[chunk].state = ChunkState::unloaded;
+}
+
+// Unloads the furthest resident chunk, if it is further than 'distance'
+bool Level::evict_beyond(glm::vec2 focus, float distance) {
+	size_t furthest = chunks.size();
+	for (size_t i = 0; i < chunks.size(); i++) {
+		float away = glm::distance(chunks[i].center, focus);
+		if ((chunks[i].state == ChunkState::resident) && (away > distance)) {
+			furthest = i;
+			distance = away;
+		}
+	}
+	if (furthest == chunks.size()) {
+		return false;
+	}
+	unload(furthest);
+	return true;
+}
+
+void Level::stream(glm::vec2 focus) {
+	if (!streaming) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(source->loaded_mutex);
+		for (LoadedChunk& loaded : source->loaded) {
+			chunks[loaded.chunk].state = ChunkState::waiting;
+			waiting.push_back(std::move(loaded));
+		}
+		source->loaded.clear();
+	}
+
+	// A margin of one chunk keeps chunks on the edge of the radius from
+	// being loaded and unloaded over and over
+	float keep = settings.radius + settings.chunk_size;
+	for (size_t i = 0; i < chunks.size(); i++) {
+		if ((chunks[i].state == ChunkState::resident) && (glm::distance(chunks[i].center, focus) > keep)) {
+			unload(i);
+		}
+	}
+
+	glm::ivec2 first = glm::ivec2(glm::floor((focus - settings.radius - chunk_origin) / settings.chunk_size));
+	glm::ivec2 last  = glm::ivec2(glm::floor((focus + settings.radius - chunk_origin) / settings.chunk_size));
+	first = glm::clamp(first, glm::ivec2(0, 0), chunk_dims - 1);
+	last  = glm::clamp(last,  glm::ivec2(0, 0), chunk_dims - 1);
+	for (int y = first.y; y <= last.y; y++) {
+		for (int x = first.x; x <= last.x; x++) {
+			size_t chunk = (size_t) y * chunk_dims.x + x;
+			bool in_range = glm::distance(chunks[chunk].center, focus) <= settings.radius;
+			if (!in_range || (chunks[chunk].state != ChunkState::unloaded) || source->chunk_quads[chunk].empty()) {
+				continue;
+			}
+			chunks[chunk].state = ChunkState::loading;
+			std::shared_ptr<Source> shared = source;
+			JobPool::submit([shared, chunk]() {
+				LoadedChunk loaded;
+				loaded.chunk = chunk;
+				loaded.records.reserve(shared->chunk_quads[chunk].size());
+				for (uint32_t index : shared->chunk_quads[chunk]) {
+					loaded.records.push_back(shared->quads[index]);
+				}
+				std::lock_guard<std::mutex> lock(shared->loaded_mutex);
+				shared->loaded.push_back(std::move(loaded));
+			});
+		}
+	}
+
+	// Nearer chunks are created first, and the first one always is, so
+	// loading keeps moving however small the budget
+	std::sort(waiting.begin(), waiting.end(), [this, focus](LoadedChunk const& lhs, LoadedChunk const& rhs) {
+		return glm::distance(chunks[lhs.chunk].center, focus) < glm::distance(chunks[rhs.chunk].center, focus);
+	});
+	std::vector<LevelRecord const*> records;
+	size_t created = 0;
+	size_t next    = 0;
+	for (; (next < waiting.size()) && (created < settings.quads_per_step); next++) {
+		LoadedChunk& loaded = waiting[next];
+		float away = glm::distance(chunks[loaded.chunk].center, focus);
+		if (away > keep) {
+			chunks[loaded.chunk].state = ChunkState::unloaded;
+			continue;
+		}
+		while ((resident + loaded.records.size() > settings.max_quads) && evict_beyond(focus, away)) {}
+		if (resident + loaded.records.size() > settings.max_quads) {
+			break;
+		}
+		std::vector<Quad*>& quads = grid[loaded.chunk];
+		records.clear();
+		for (LevelRecord const& record : loaded.records) {
+			records.push_back(&record);
+		}
+		construct_quads(records, quads);
+		chunks[loaded.chunk].state = ChunkState::resident;
+		resident += quads.size();
+		created  += quads.size();
+	}
+	waiting.erase(waiting.begin(), waiting.begin() + next);
+}
+
+size_t Level::resident_quads() const {
+	return resident;
+}
+
+void Level::compile(std::string text_path, std::string binary_path) {
+	Records parsed;
+	parse_text(text_path, parsed);
+
+	LevelFileHeader header;
+	std::copy(std::begin(level_magic), std::end(level_magic), header.magic);
+	header.version        = LevelFileHeader::current_version;
+	header.string_count   = parsed.strings.size();
+	header.string_bytes   = parsed.strings.offset_data()[parsed.strings.size()];
+	header.quad_count     = (uint32_t) parsed.quads.size();
+	header.creature_count = (uint32_t) parsed.creatures.size();
+
+	std::ofstream file(binary_path, std::ios::binary | std::ios::trunc);
+	if (!file) {
+		throw std::runtime_error("Failed to open '" + binary_path + "' for writing.");
+	}
+	char const padding[4] = {};
+	file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+	file.write(reinterpret_cast<char const*>(parsed.strings.offset_data()), ((size_t) header.string_count + 1) * sizeof(uint32_t));
+	file.write(parsed.strings.byte_data(), header.string_bytes);
+	file.write(padding, padded(header.string_bytes) - header.string_bytes);
+	file.write(reinterpret_cast<char const*>(parsed.quads.data()), parsed.quads.size() * sizeof(LevelRecord));
+	file.write(reinterpret_cast<char const*>(parsed.creatures.data()), parsed.creatures.size() * sizeof(LevelRecord));
+	if (!file) {
+		throw std::runtime_error("Failed to write '" + binary_path + "'.");
+	}
+}
+
+
+
+
+Level::~Level() {
+	for (auto row : grid) {
+		for (auto quad : row) {
+			delete quad;
+		}
+	}
+}
+
+std::unordered_map<std::string_view, Level::LevelClass<Quad>>     Level::quad_classes     = std::unordered_map<std::string_view, Level::LevelClass<Quad>>();
+std::unordered_map<std::string_view, Level::LevelClass<Creature>> Level::creature_classes = std::unordered_map<std::string_view, Level::LevelClass<Creature>>();
+
+
+
+
+void HealthBar::logic(size_t id, float delta, void* data, AICommands& commands) {
+	HealthBar* self = (HealthBar*)data;
+	if (! ecs::has<Status>(self->subject_id)) {
+		return;
+	}
+	Status&    subject_stat = ecs::get<Status>(self->subject_id);
+	glm::vec3& subject_pos  = ecs::get<Position>(self->subject_id);
+	commands.set_position(id, subject_pos + glm::vec3(0.0f,0.1f, -0.15f));
+	commands.set_scale(id, glm::vec2(subject_stat.health * 0.001, 0.01));
+}
+
+HealthBar::HealthBar(size_t subject_id)
+	: ecs::ComponentHandle<Physics>()
+	, ecs::ComponentHandle<Sprite>(TextureAtlas::load("assets/red.png"),glm::vec2(0,0))
+	, ecs::ComponentHandle<AI>(logic,this)
+	, subject_id(subject_id)
+{
+	Physics& self_phys = ecs::get<Physics>(id);
+	self_phys.solid = false;
+	ecs::get<Sprite>(id).depth = -0.15f;
+}
+
+
+void Enemy::logic(float delta, AICommands& commands) {
+	glm::vec2 my_pos = glm::vec2(ecs::get<Position>(id).position);
+	SpatialHit target;
+	if (!SpatialIndex::nearest(my_pos, Status::GOOD, std::numeric_limits<float>::infinity(), target)) {
+		return;
+	}
+	// The flow field leads around walls. It has no direction in the target's
+	// own cell, or where no path is known, so the enemy heads straight there.
+	glm::vec2 heading;
+	if (!Navigation::direction(my_pos, Status::GOOD, heading)) {
+		heading = glm::normalize(target.position - my_pos);
+	}
+	commands.add_velocity(id, heading * delta);
+}
+
+Enemy::Enemy(glm::vec2 position)
+	: Creature()
+	, health_bar(*this)
+{
+	glm::vec3& pos  = ecs::get<Position>(*this);
+	Physics& phys   = ecs::get<Physics>(*this);
+	Sprite & sprite = ecs::get<Sprite>(*this);
+	Status & status = ecs::get<Status>(*this);
+	phys.bbox_dims = glm::vec2(0.024f,0.024f);
+	pos = glm::vec3(position,0.f);
+	sprite.scale = glm::vec2(0.030f, 0.030f);
+	sprite.image = TextureAtlas::load("assets/enemy.png");
+	sprite.depth = -0.1f;
+	status.health = 100;
+	status.set_alignment(Status::EVIL);
+	phys.on_collide.push_back([](size_t id) {
+		if (!ecs::has<Status>(id)) {
+			return;
+		}
+		Status & status = ecs::get<Status>(id);
+		if (status.alignment == Status::GOOD) {
+			status.health-=10;
+		}
+	});
+}
+
+
+void Bullet::logic(float delta, AICommands& commands) {
+	commands.damage(id, 1);
+}
+
+Bullet::Bullet(glm::vec2 position, glm::vec2 velocity)
+	: Creature()
+{
+	glm::vec3& pos  = ecs::get<Position>(*this);
+	Physics& phys   = ecs::get<Physics>(*this);
+	Sprite & sprite = ecs::get<Sprite>(*this);
+	Status & status = ecs::get<Status>(*this);
+	phys.bbox_dims = glm::vec2(0.05f,0.05f);
+	pos = glm::vec3(position,0.0f);
+	phys.velocity = velocity;
+	phys.has_drag = false;
+	phys.continuous = true;
+	phys.swept_from = position;
+	// Each run costs the bullet one health, so it must run every step to
+	// last the same time wherever it is
+	ecs::get<AI>(id).always_run = true;
+	sprite.scale = glm::vec2(0.02f, 0.02f);
+	sprite.image = TextureAtlas::load("assets/ally.png");
+	sprite.depth = -0.15f;
+	status.health = 10;
+	status.set_alignment(Status::NEUTRAL);
+	phys.on_collide.push_back([](size_t id) {
+		if (! ecs::has<Status>(id)) {
+			return;
+		}
+		Status & status = ecs::get<Status>(id);
+		if (status.alignment == Status::EVIL) {
+			status.health -= 10;
+		}
+	});
+}
+
+
+
+
+
+void PopUp::logic(float delta, AICommands& commands) {
+
+}
+
+void PopUp::on_death() {
+	mouseclick_callbacks.erase(id);
+}
+
+PopUp::PopUp(AtlasImage image, glm::vec2 position, glm::vec2 dimensions)
+{
+	glm::vec3& pos  = ecs::get<Position>(*this);
+	Sprite& sprite = ecs::get<Sprite>(id);
+	sprite.depth = -0.2f;
+	sprite.image = image;
+	sprite.scale = dimensions;
+	Physics& phys = ecs::get<Physics>(id);
+	phys.solid = false;
+	pos = glm::vec3(position,0.f);
+	ecs::get<Status>(id).health = 1;
+	mouseclick_callbacks[id] = [this](glm::vec2 pos) {
+		ecs::get<Status>(id).health = 0;
+	};
+}
+
+
+
+// The bird reads the input and moves the camera, so it runs exclusively and
+// writes to the world directly
+void Bird::logic(float delta, AICommands& commands) {
+
+	x_ease *= 0.9f;
+	y_ease *= 0.9f;
+
+	if ( (w_down || s_down) && (y_ease < 1.0f)) {
+		y_ease += 0.01f;
+	}
+
+	if ( (d_down || a_down) && (x_ease < 1.0f) ) {
+		x_ease += 0.01f;
+	}
+
+	float up_force = (w_down - s_down) * y_ease;
+	float right_force = (d_down - a_down) * x_ease;
+
+
+	Sprite& sprite = ecs::get<Sprite>(id);
+
+	if (shoot_cooldown <= 0) {
+		int frame_total = loop.images.size() * loop.frames_per_image;
+		loop.image_iterator = (loop.image_iterator + 1) % frame_total;
+		int image_index = loop.image_iterator / loop.frames_per_image;
+		sprite.image = loop.images[image_index];
+	}
+	else {
+		sprite.image = shoot_image;
+	}
+
+
+	Physics& phys = ecs::get<Physics>(id);
+	phys.velocity += glm::vec2(right_force, up_force);
+
+	glm::vec3& pos  = ecs::get<Position>(*this);
+	Sprite::cam_pos = pos;
+
+	shoot_cooldown -= delta;
+
+}
+
+
+void Bird::on_death () {
+	Creature::track_life(std::shared_ptr<Creature>(new PopUp(
+		TextureAtlas::load("assets/game_over.png"),
+		Sprite::cam_pos,
+		glm::vec2(0.5,0.5)
+	)));
+}
+
+Bird::Bird(glm::vec2 position)
+	: health_bar(*this)
+{
+	glm::vec3& pos  = ecs::get<Position>(*this);
+	Physics& phys   = ecs::get<Physics>(*this);
+	Sprite & sprite = ecs::get<Sprite>(*this);
+	Status & status = ecs::get<Status>(*this);
+	phys.bbox_dims = glm::vec2(0.08f,0.08f);
+	pos = glm::vec3(position,0.f);
+	sprite.scale = glm::vec2(0.1f, 0.1f);
+	sprite.image = TextureAtlas::load("assets/bird1.png");
+	sprite.depth = -0.1f;
+	status.health = 100;
+	status.set_alignment(Status::GOOD);
+	ecs::get<AI>(id).exclusive = true;
+	// The bar was created after the bird, so as an exclusive agent it runs
+	// after the bird's logic in the same step, rather than a step behind
+	ecs::get<AI>(health_bar).exclusive = true;
+
+}
+
+
+float Bird::x_ease = 0.f;
+float Bird::y_ease = 0.f;
+bool  Bird::w_down = false;
+bool  Bird::a_down = false;
+bool  Bird::s_down = false;
+bool  Bird::d_down = false;
+float Bird::shoot_cooldown = 0.1f;
+AnimationLoop Bird::loop = AnimationLoop{};
+AtlasImage    Bird::shoot_image = AtlasImage();
+char const* const Bird::keyword  = "bird";
+char const* const Enemy::keyword = "enemy";
+
+
+
+
+float random_norm() {
+	return (rand() % 10000) / 10000.0f;
+}
+
+
+
+
+template<>
+bool parse<Bird>(LineTokens& tokens, LevelRecord& record, LevelStrings& strings) {
+	glm::vec2 position;
+	if (!(tokens.next(position.x) && tokens.next(position.y))) {
+		return false;
+	}
+	record.set(position, glm::vec2(0, 0), glm::ivec2(0, 0));
+	return true;
+}
+
+template<>
+Bird* construct<Bird>(LevelRecord const& record, LevelStrings const& strings) {
+	return new Bird(record.get_position());
+}
+
+template<>
+bool parse<Enemy>(LineTokens& tokens, LevelRecord& record, LevelStrings& strings) {
+	glm::vec2 position;
+	if (!(tokens.next(position.x) && tokens.next(position.y))) {
+		return false;
+	}
+	record.set(position, glm::vec2(0, 0), glm::ivec2(0, 0));
+	return true;
+}
+
+template<>
+Enemy* construct<Enemy>(LevelRecord const& record, LevelStrings const& strings) {
+	return new Enemy(record.get_position());
+}
+
@@ -1,166 +1,322 @@
-
-#ifndef LEVEL
-#define LEVEL
-
-#include "components.h"
-
-
-
-
-
-struct Quad
-	: ecs::ComponentHandle<Position>
-	, ecs::ComponentHandle<Sprite>
-{
-	glm::vec2 const tile_scale = glm::vec2(0.1f, 0.1f);
-	Quad(glm::vec2 position, std::shared_ptr<Texture> tex, glm::vec2 dimensions);
-};
-
-struct CollisionQuad
-	: Quad
-	, ecs::ComponentHandle<Physics>
-{
-	CollisionQuad(glm::vec2 position, std::shared_ptr<Texture> tex, glm::vec2 dimensions);
-};
-
-struct Creature
-	: ecs::ComponentHandle<Position>
-	, ecs::ComponentHandle<Physics>
-	, ecs::ComponentHandle<Sprite>
-	, ecs::ComponentHandle<AI>
-	, ecs::ComponentHandle<Status>
-{
-
-	static std::vector<std::shared_ptr<Creature>> alive;
-	virtual void logic(float delta);
-	virtual void on_death();
-	static void logic_trampoline(size_t id, float delta, void* self_ptr);
-	Creature();
-	static void track_life(std::shared_ptr<Creature> creature);
-	static void cleanup();
-	virtual ~Creature();
-
-};
-
-
-struct Level {
-
-	static std::vector < std::function<Quad*(std::string)> > quad_deserializers;
-	static std::vector < std::function<Creature*(std::string)> > creature_deserializers;
-
-	std::vector<std::vector<Quad*>> grid;
-
-	Level(std::string file_path);
-	~Level();
-
-	template<typename T>
-	static void register_quad_class() {
-		quad_deserializers.push_back(deserialize<T>);
-	}
-
-	template<typename T>
-	static void register_creature_class() {
-		creature_deserializers.push_back(deserialize<T>);
-	}
-	
-};
-
-struct HealthBar
-	: ecs::ComponentHandle<Position>
-	, ecs::ComponentHandle<Physics>
-	, ecs::ComponentHandle<Sprite>
-	, ecs::ComponentHandle<AI>
-{
-
-	size_t subject_id;
-
-	static void logic(size_t id, float delta, void* data);
-	HealthBar(size_t subject_id);
-
-};
-
-
-
-
-struct Enemy : public Creature {
-
-	HealthBar health_bar;
-
-	void logic(float delta);
-	Enemy(glm::vec2 position);
-
-};
-
-
-
-struct Bullet : public Creature {
-
-	void logic(float delta);
-	Bullet(glm::vec2 position, glm::vec2 velocity);
-
-};
-
-
-
-
-struct PopUp : Creature {
-
-	void logic(float delta);
-	void on_death();
-	PopUp(std::shared_ptr<Texture> tex, glm::vec2 position, glm::vec2 dimensions);
-
-};
-
-
-
-struct AnimationLoop {
-	
-	std::vector<std::shared_ptr<Texture>> tex_list;
-	int frames_per_tex;
-	int tex_iterator;
-
-};
-
-
-
-
-// A ball has position, velocity, gravity, and a sprite
-class Bird : public Creature {
-
-	void logic(float delta);
-	void on_death();
-
-public:
-
-
-	static float x_ease;
-	static float y_ease;
-	static bool w_down;
-	static bool a_down;
-	static bool s_down;
-	static bool d_down;
-
-	static float shoot_cooldown;
-
-	static AnimationLoop loop;
-
-	HealthBar health_bar;
-
-	Bird(glm::vec2 position);
-
-};
-
-
-template<>
-Bird* deserialize(std::string line);
-
-template<>
-Enemy* deserialize(std::string line);
-
-
-
-
-#endif 
-
-
-
+
+#ifndef LEVEL
+#define LEVEL
+
+#include "components.h"
+#include "level_file.h"
+
+#include <mutex>
+
+
+
+
+
+struct Quad
+	: ecs::ComponentHandle<Position>
+	, ecs::ComponentHandle<Sprite>
+{
+	glm::vec2 const tile_scale = glm::vec2(0.1f, 0.1f);
+	Quad(glm::vec2 position, std::shared_ptr<Texture> tex, glm::vec2 dimensions);
+	Quad(glm::vec2 position, AtlasImage image, glm::vec2 dimensions);
+	Quad(glm::vec2 position, AtlasImage image, glm::vec2 dimensions, std::shared_ptr<GPUProgram> program);
+	// Levels delete their quads through this type, and subclasses such as
+	// Wall add components that must be removed too
+	virtual ~Quad() = default;
+};
+
+struct CollisionQuad
+	: Quad
+	, ecs::ComponentHandle<Physics>
+{
+	CollisionQuad(glm::vec2 position, AtlasImage image, glm::vec2 dimensions);
+	CollisionQuad(glm::vec2 position, AtlasImage image, glm::vec2 dimensions, std::shared_ptr<GPUProgram> program);
+};
+
+struct Creature
+	: ecs::ComponentHandle<Position>
+	, ecs::ComponentHandle<Physics>
+	, ecs::ComponentHandle<Sprite>
+	, ecs::ComponentHandle<AI>
+	, ecs::ComponentHandle<Status>
+{
+
+	static std::vector<std::shared_ptr<Creature>> alive;
+	// Runs in parallel with other creatures. See AI for what it may touch.
+	virtual void logic(float delta, AICommands& commands);
+	virtual void on_death();
+	static void logic_trampoline(size_t id, float delta, void* self_ptr, AICommands& commands);
+	Creature();
+	static void track_life(std::shared_ptr<Creature> creature);
+	static void cleanup();
+	virtual ~Creature();
+
+};
+
+
+// Every class that can appear in a level has a static 'keyword', which
+// starts its lines in text levels and tags its records in compiled ones,
+// and specializes these two functions.
+
+// Reads the rest of a text line, after the keyword, into a record. Returns
+// false if the line is malformed.
+template<typename T>
+bool parse(LineTokens& tokens, LevelRecord& record, LevelStrings& strings);
+
+// Creates the object a record describes
+template<typename T>
+T* construct(LevelRecord const& record, LevelStrings const& strings);
+
+// Creates the quads for several records of one class, and appends them to
+// 'quads'. Classes that can share work between their records specialize
+// this, and the rest create each record on its own.
+template<typename T>
+void construct_batch(LevelRecord const* const* records, size_t count, LevelStrings const& strings, std::vector<Quad*>& quads) {
+	for (size_t i = 0; i < count; i++) {
+		quads.push_back(construct<T>(*records[i], strings));
+	}
+}
+
+
+struct Level {
+
+	template<typename Base>
+	struct LevelClass {
+		std::function<bool(LineTokens&, LevelRecord&, LevelStrings&)> parse;
+		std::function<Base*(LevelRecord const&, LevelStrings const&)> construct;
+		// Only set for quads, which levels create in bulk
+		std::function<void(LevelRecord const* const*, size_t, LevelStrings const&, std::vector<Base*>&)> construct_batch;
+	};
+
+	// Keyed by keyword, so a line goes straight to its class. The keys view
+	// the classes' static keywords.
+	static std::unordered_map<std::string_view, LevelClass<Quad>>     quad_classes;
+	static std::unordered_map<std::string_view, LevelClass<Creature>> creature_classes;
+
+	// The records of a level, with the strings they refer to
+	struct Records {
+		LevelStrings             strings;
+		std::vector<LevelRecord> quads;
+		std::vector<LevelRecord> creatures;
+	};
+
+	// How a streamed level keeps quads around a focus point. Quads belong to
+	// the square chunk their centre falls in, and chunks are created and
+	// destroyed whole.
+	struct StreamSettings {
+		// The side of a chunk, in world units
+		float  chunk_size;
+		// Chunks with their centre this close to the focus are loaded. They
+		// are unloaded once they are a chunk further away than that.
+		float  radius;
+		// The most quads kept at once. The furthest chunks are unloaded to
+		// make room for nearer ones.
+		size_t max_quads;
+		// The most quads created by one call to stream(), although a chunk is
+		// always created whole
+		size_t quads_per_step;
+	};
+
+	// Without streaming, all quads are in the first row. With streaming,
+	// there is one row per chunk, which is empty while it is not loaded.
+	std::vector<std::vector<Quad*>> grid;
+
+	// Loads a text level, or a level made by compile(), which is told apart
+	// by its header
+	Level(std::string file_path);
+	// Creates the creatures straight away, but leaves the quads to stream()
+	Level(std::string file_path, StreamSettings settings);
+	~Level();
+
+	// Loads chunks that have come into range of 'focus' and unloads those
+	// that have left it. Records are read on the JobPool, and the quads are
+	// created here, so this must be called from the main thread.
+	void stream(glm::vec2 focus);
+	size_t resident_quads() const;
+
+	// Converts a text level to the binary format described in level_file.h,
+	// which loads without parsing
+	static void compile(std::string text_path, std::string binary_path);
+
+	// Reads a text level into records, without creating anything
+	static void parse_text(std::string const& file_path, Records& records);
+
+	template<typename T>
+	static void register_quad_class() {
+		quad_classes[T::keyword] = { parse<T>, construct<T>, construct_batch<T> };
+	}
+
+	template<typename T>
+	static void register_creature_class() {
+		creature_classes[T::keyword] = { parse<T>, construct<T>, nullptr };
+	}
+
+private:
+
+	enum class ChunkState {
+		unloaded,
+		// Its records are being read on the JobPool
+		loading,
+		// Its records are read, and its quads are waiting to be created
+		waiting,
+		resident,
+	};
+
+	struct Chunk {
+		glm::vec2  center;
+		ChunkState state;
+	};
+
+	struct LoadedChunk {
+		size_t                   chunk;
+		std::vector<LevelRecord> records;
+	};
+
+	// Where the records come from, either parsed from text or in a mapped
+	// compiled file. Load jobs share it, so it outlives the level if they
+	// are still running.
+	struct Source {
+		Records                       parsed;
+		std::unique_ptr<MappedFile>   file;
+		std::unique_ptr<LevelStrings> file_strings;
+
+		LevelStrings const* strings;
+		LevelRecord const*  quads;
+		size_t              quad_count;
+		LevelRecord const*  creatures;
+		size_t              creature_count;
+
+		// The indexes of the quads in each chunk
+		std::vector<std::vector<uint32_t>> chunk_quads;
+
+		std::mutex               loaded_mutex;
+		std::vector<LoadedChunk> loaded;
+	};
+
+	std::shared_ptr<Source>  source;
+	std::vector<LevelClass<Quad> const*> quad_classes_by_tag;
+
+	bool                     streaming;
+	StreamSettings           settings;
+	glm::vec2                chunk_origin;
+	glm::ivec2               chunk_dims;
+	std::vector<Chunk>       chunks;
+	std::vector<LoadedChunk> waiting;
+	size_t                   resident;
+
+	static std::shared_ptr<Source> open(std::string const& file_path);
+	void build_creatures();
+	void partition();
+	void construct_quads(std::vector<LevelRecord const*>& records, std::vector<Quad*>& quads);
+	void unload(size_t chunk);
+	bool evict_beyond(glm::vec2 focus, float distance);
+	
+};
+
+struct HealthBar
+	: ecs::ComponentHandle<Position>
+	, ecs::ComponentHandle<Physics>
+	, ecs::ComponentHandle<Sprite>
+	, ecs::ComponentHandle<AI>
+{
+
+	size_t subject_id;
+
+	static void logic(size_t id, float delta, void* data, AICommands& commands);
+	HealthBar(size_t subject_id);
+
+};
+
+
+
+
+struct Enemy : public Creature {
+
+	static char const* const keyword;
+
+	HealthBar health_bar;
+
+	void logic(float delta, AICommands& commands);
+	Enemy(glm::vec2 position);
+
+};
+
+
+
+struct Bullet : public Creature {
+
+	void logic(float delta, AICommands& commands);
+	Bullet(glm::vec2 position, glm::vec2 velocity);
+
+};
+
+
+
+
+struct PopUp : Creature {
+
+	void logic(float delta, AICommands& commands);
+	void on_death();
+	PopUp(AtlasImage image, glm::vec2 position, glm::vec2 dimensions);
+
+};
+
+
+
+struct AnimationLoop {
+	
+	std::vector<AtlasImage> images;
+	int frames_per_image;
+	int image_iterator;
+
+};
+
+
+
+
+// A ball has position, velocity, gravity, and a sprite
+class Bird : public Creature {
+
+	void logic(float delta, AICommands& commands);
+	void on_death();
+
+public:
+
+
+	static float x_ease;
+	static float y_ease;
+	static bool w_down;
+	static bool a_down;
+	static bool s_down;
+	static bool d_down;
+
+	static float shoot_cooldown;
+
+	static AnimationLoop loop;
+	static AtlasImage    shoot_image;
+
+	static char const* const keyword;
+
+	HealthBar health_bar;
+
+	Bird(glm::vec2 position);
+
+};
+
+
+template<>
+bool parse<Bird>(LineTokens& tokens, LevelRecord& record, LevelStrings& strings);
+template<>
+Bird* construct<Bird>(LevelRecord const& record, LevelStrings const& strings);
+
+template<>
+bool parse<Enemy>(LineTokens& tokens, LevelRecord& record, LevelStrings& strings);
+template<>
+Enemy* construct<Enemy>(LevelRecord const& record, LevelStrings const& strings);
+
+
+
+
+#endif 
+
+
+
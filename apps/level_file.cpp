@@ -0,0 +1,260 @@
+#include "level_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+LevelRecord LevelRecord::blank() {
+	LevelRecord record = {};
+	std::fill(std::begin(record.strings), std::end(record.strings), LevelStrings::none);
+	return record;
+}
+
+glm::vec2 LevelRecord::get_position() const {
+	return glm::vec2(position[0], position[1]);
+}
+
+glm::vec2 LevelRecord::get_scale() const {
+	return glm::vec2(scale[0], scale[1]);
+}
+
+glm::ivec2 LevelRecord::get_dims() const {
+	return glm::ivec2(dims[0], dims[1]);
+}
+
+void LevelRecord::set(glm::vec2 position, glm::vec2 scale, glm::ivec2 dims) {
+	this->position[0] = position.x;
+	this->position[1] = position.y;
+	this->scale[0]    = scale.x;
+	this->scale[1]    = scale.y;
+	this->dims[0]     = dims.x;
+	this->dims[1]     = dims.y;
+}
+
+
+LevelStrings::LevelStrings()
+	: offset_storage(1, 0)
+	, offsets(offset_storage.data())
+	, bytes(byte_storage.data())
+	, count(0)
+{}
+
+LevelStrings::LevelStrings(uint32_t const* offsets, char const* bytes, uint32_t count)
+	: offsets(offsets)
+	, bytes(bytes)
+	, count(count)
+{}
+
+uint32_t LevelStrings::add(std::string_view text) {
+	auto found = lookup.find(text);
+	if (found != lookup.end()) {
+		return found->second;
+	}
+	byte_storage.append(text.data(), text.size());
+	offset_storage.push_back((uint32_t) byte_storage.size());
+	offsets = offset_storage.data();
+	bytes   = byte_storage.data();
+	names.emplace_back(text);
+	lookup.emplace(names.back(), count);
+	return count++;
+}
+
+std::string_view LevelStrings::get(uint32_t index) const {
+	if (index >= count) {
+		throw std::runtime_error("Level string index " + std::to_string(index) + " is out of range.");
+	}
+	return std::string_view(bytes + offsets[index], offsets[index + 1] - offsets[index]);
+}
+
+uint32_t LevelStrings::size() const {
+	return count;
+}
+
+uint32_t const* LevelStrings::offset_data() const {
+	return offsets;
+}
+
+char const* LevelStrings::byte_data() const {
+	return bytes;
+}
+
+
+namespace {
+
+	bool is_space(char c) {
+		return (c == ' ') || (c == '\t') || (c == '\r');
+	}
+
+}
+
+LineTokens::LineTokens(std::string_view line)
+	: rest(line)
+{}
+
+void LineTokens::skip_space() {
+	size_t start = 0;
+	while ((start < rest.size()) && is_space(rest[start])) {
+		start++;
+	}
+	rest.remove_prefix(start);
+}
+
+bool LineTokens::next(std::string_view& word) {
+	skip_space();
+	size_t length = 0;
+	while ((length < rest.size()) && !is_space(rest[length])) {
+		length++;
+	}
+	if (length == 0) {
+		return false;
+	}
+	word = rest.substr(0, length);
+	rest.remove_prefix(length);
+	return true;
+}
+
+bool LineTokens::next(float& value) {
+	skip_space();
+	char const* first = rest.data();
+	char const* last  = rest.data() + rest.size();
+	float parsed;
+	std::from_chars_result result = std::from_chars(first, last, parsed);
+	if ((result.ec != std::errc()) || ((result.ptr != last) && !is_space(*result.ptr))) {
+		return false;
+	}
+	value = parsed;
+	rest.remove_prefix(result.ptr - first);
+	return true;
+}
+
+bool LineTokens::next(int& value) {
+	skip_space();
+	char const* first = rest.data();
+	char const* last  = rest.data() + rest.size();
+	int parsed;
+	std::from_chars_result result = std::from_chars(first, last, parsed);
+	if ((result.ec != std::errc()) || ((result.ptr != last) && !is_space(*result.ptr))) {
+		return false;
+	}
+	value = parsed;
+	rest.remove_prefix(result.ptr - first);
+	return true;
+}
+
+std::string_view LineTokens::remainder() {
+	skip_space();
+	size_t length = rest.size();
+	while ((length > 0) && (rest[length - 1] == '\r')) {
+		length--;
+	}
+	std::string_view result = rest.substr(0, length);
+	rest.remove_prefix(rest.size());
+	return result;
+}
+
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(std::string const& file_path)
+	: view(nullptr)
+	, length(0)
+	, file(INVALID_HANDLE_VALUE)
+	, mapping(nullptr)
+{
+	file = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	LARGE_INTEGER file_size;
+	if ((file == INVALID_HANDLE_VALUE) || !GetFileSizeEx(file, &file_size)) {
+		release();
+		throw std::runtime_error("Failed to open '" + file_path + "'.");
+	}
+	length = (size_t) file_size.QuadPart;
+	// Empty files cannot be mapped, but have nothing to read anyway
+	if (length == 0) {
+		return;
+	}
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping != nullptr) {
+		view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (view == nullptr) {
+		release();
+		throw std::runtime_error("Failed to map '" + file_path + "'.");
+	}
+}
+
+void MappedFile::release() {
+	if (view != nullptr) {
+		UnmapViewOfFile(view);
+		view = nullptr;
+	}
+	if (mapping != nullptr) {
+		CloseHandle(mapping);
+		mapping = nullptr;
+	}
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+}
+
+#else
+
+MappedFile::MappedFile(std::string const& file_path)
+	: view(nullptr)
+	, length(0)
+	, descriptor(-1)
+{
+	descriptor = open(file_path.c_str(), O_RDONLY);
+	struct stat info;
+	if ((descriptor < 0) || (fstat(descriptor, &info) != 0)) {
+		release();
+		throw std::runtime_error("Failed to open '" + file_path + "'.");
+	}
+	length = (size_t) info.st_size;
+	if (length == 0) {
+		return;
+	}
+	void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	if (mapped == MAP_FAILED) {
+		release();
+		throw std::runtime_error("Failed to map '" + file_path + "'.");
+	}
+	view = mapped;
+}
+
+void MappedFile::release() {
+	if (view != nullptr) {
+		munmap(const_cast<void*>(view), length);
+		view = nullptr;
+	}
+	if (descriptor >= 0) {
+		close(descriptor);
+		descriptor = -1;
+	}
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+	release();
+}
+
+void const* MappedFile::data() const {
+	return view;
+}
+
+size_t MappedFile::size() const {
+	return length;
+}
+
+
+uint32_t const LevelFileHeader::current_version;
+uint32_t const LevelStrings::none;
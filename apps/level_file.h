@@ -0,0 +1,129 @@
+#ifndef LEVEL_FILE
+#define LEVEL_FILE
+
+#include "common.h"
+
+#include <charconv>
+
+
+// The layout of a compiled level, as written by Level::compile:
+//
+//   LevelFileHeader
+//   uint32_t    string offsets, one per string plus one past the end
+//   char        string bytes, padded to a multiple of four
+//   LevelRecord quads, then creatures
+//
+// Everything is stored in the byte order of the machine that compiled it,
+// and the loader reads it in place.
+struct LevelFileHeader {
+	static uint32_t const current_version = 1;
+
+	char     magic[4];
+	uint32_t version;
+	uint32_t string_count;
+	uint32_t string_bytes;
+	uint32_t quad_count;
+	uint32_t creature_count;
+};
+
+
+// One line of a level. 'tag' is the string index of the class keyword, and
+// each class decides what the remaining fields mean. Unused strings are
+// set to LevelStrings::none.
+struct LevelRecord {
+	uint32_t tag;
+	float    position[2];
+	float    scale[2];
+	int32_t  dims[2];
+	uint32_t strings[3];
+
+	// A record with zeroed fields and no strings
+	static LevelRecord blank();
+
+	glm::vec2  get_position() const;
+	glm::vec2  get_scale() const;
+	glm::ivec2 get_dims() const;
+	void set(glm::vec2 position, glm::vec2 scale, glm::ivec2 dims);
+};
+
+static_assert(sizeof(LevelRecord) == 40, "LevelRecord is part of the file format.");
+
+
+// The string table of a level. Strings are added while compiling and
+// duplicates share an index. A table can also be a view of strings that
+// live elsewhere, such as in a mapped file.
+class LevelStrings {
+	std::vector<uint32_t> offset_storage;
+	std::string           byte_storage;
+	// The keys view 'names', which never moves its strings, so finding a
+	// string that is already in the table allocates nothing
+	std::deque<std::string> names;
+	std::unordered_map<std::string_view, uint32_t> lookup;
+
+	uint32_t const* offsets;
+	char const*     bytes;
+	uint32_t        count;
+
+public:
+	static uint32_t const none = 0xFFFFFFFFu;
+
+	LevelStrings();
+	LevelStrings(uint32_t const* offsets, char const* bytes, uint32_t count);
+	LevelStrings(LevelStrings const&) = delete;
+	LevelStrings& operator=(LevelStrings const&) = delete;
+
+	uint32_t add(std::string_view text);
+	// Throws for an index past the end of the table
+	std::string_view get(uint32_t index) const;
+	uint32_t size() const;
+	uint32_t const* offset_data() const;
+	char const*     byte_data() const;
+};
+
+
+// Splits one line of a text level into words, without copying. Numbers are
+// read with from_chars, so they ignore the locale and, unlike streams,
+// reject a leading '+'. Spaces, tabs and carriage returns separate words.
+class LineTokens {
+	std::string_view rest;
+
+	void skip_space();
+
+public:
+	explicit LineTokens(std::string_view line);
+
+	// Each returns false, and leaves the value alone, if the next word is
+	// missing or is not of the requested type
+	bool next(std::string_view& word);
+	bool next(float& value);
+	bool next(int& value);
+	// Everything after the next run of spaces, up to the end of the line
+	std::string_view remainder();
+};
+
+
+// A read-only view of a whole file, mapped into memory
+class MappedFile {
+	void const* view;
+	size_t      length;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#else
+	int descriptor;
+#endif
+
+	void release();
+
+public:
+	explicit MappedFile(std::string const& file_path);
+	MappedFile(MappedFile const&) = delete;
+	MappedFile& operator=(MappedFile const&) = delete;
+	~MappedFile();
+
+	void const* data() const;
+	size_t size() const;
+};
+
+
+#endif
@@ -0,0 +1,74 @@
+#include "loop.h"
+
+
+FixedStepLoop::FixedStepLoop(float rate, size_t max_substeps)
+	: step_length(1.f / rate)
+	, max_substeps(max_substeps)
+	, accumulator(0.f)
+	, alpha(0.f)
+	, steps_taken(0)
+	, steps_dropped(0)
+	, step_callback()
+	, render_callback()
+{}
+
+void FixedStepLoop::set_rate(float rate) {
+	step_length = 1.f / rate;
+}
+
+void FixedStepLoop::set_max_substeps(size_t max_substeps) {
+	this->max_substeps = max_substeps;
+}
+
+void FixedStepLoop::on_step(std::function<void(float)> callback) {
+	step_callback = callback;
+}
+
+void FixedStepLoop::on_render(std::function<void(float)> callback) {
+	render_callback = callback;
+}
+
+size_t FixedStepLoop::advance(float elapsed) {
+	accumulator += std::max(elapsed, 0.f);
+	size_t steps = 0;
+	while ((accumulator >= step_length) && (steps < max_substeps)) {
+		if (step_callback) {
+			step_callback(step_length);
+		}
+		accumulator -= step_length;
+		steps++;
+	}
+	// Drop whatever could not be simulated this frame, rather than letting
+	// it pile up and make every later frame slower too
+	if (accumulator >= step_length) {
+		size_t dropped = (size_t) (accumulator / step_length);
+		steps_dropped += dropped;
+		accumulator   -= dropped * step_length;
+	}
+	steps_taken += steps;
+	alpha = accumulator / step_length;
+	if (render_callback) {
+		render_callback(alpha);
+	}
+	return steps;
+}
+
+float FixedStepLoop::rate() const {
+	return 1.f / step_length;
+}
+
+float FixedStepLoop::step() const {
+	return step_length;
+}
+
+float FixedStepLoop::interpolation() const {
+	return alpha;
+}
+
+size_t FixedStepLoop::total_steps() const {
+	return steps_taken;
+}
+
+size_t FixedStepLoop::total_dropped() const {
+	return steps_dropped;
+}
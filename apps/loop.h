@@ -0,0 +1,50 @@
+#ifndef LOOP
+#define LOOP
+
+#include "common.h"
+
+
+// Runs the simulation in steps of a fixed length, no matter how long each
+// frame takes. Frame time is added to an accumulator and whole steps are
+// taken out of it, so a slow frame is caught up with several normal steps
+// instead of one big one. Whatever is left over becomes the interpolation
+// factor handed to the render callback, which lets rendering blend between
+// the last two simulated states.
+//
+// If more than 'max_substeps' steps are due in one frame, the extra time is
+// dropped and the simulation runs slower than real time until it catches up.
+class FixedStepLoop {
+
+	float  step_length;
+	size_t max_substeps;
+	float  accumulator;
+	float  alpha;
+	size_t steps_taken;
+	size_t steps_dropped;
+
+	std::function<void(float)> step_callback;
+	std::function<void(float)> render_callback;
+
+public:
+
+	FixedStepLoop(float rate, size_t max_substeps);
+
+	void set_rate(float rate);
+	void set_max_substeps(size_t max_substeps);
+	void on_step(std::function<void(float)> callback);
+	void on_render(std::function<void(float)> callback);
+
+	// Takes as many steps as 'elapsed' seconds of real time allow, then
+	// renders once. Returns the number of steps taken.
+	size_t advance(float elapsed);
+
+	float  rate() const;
+	float  step() const;
+	float  interpolation() const;
+	size_t total_steps() const;
+	size_t total_dropped() const;
+
+};
+
+
+#endif
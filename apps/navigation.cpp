@@ -0,0 +1,385 @@
+#include "navigation.h"
+#include "jobs.h"
+
+
+namespace {
+
+	// Straight moves come first, so they win ties
+	glm::ivec2 const steps[8]      = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 }, { 1, 1 }, { -1, 1 }, { 1, -1 }, { -1, -1 } };
+	uint32_t   const step_costs[8] = { 10, 10, 10, 10, 14, 14, 14, 14 };
+
+	// Every move costs less than this, so the queue never holds more than
+	// this many distinct costs at once
+	size_t const bucket_count = 16;
+	size_t const row_block    = 16;
+
+}
+
+
+FlowField::FlowField()
+	: scale(1.f)
+	, dims(0, 0)
+	, offset(0, 0)
+	, stride(2)
+	, neighbours()
+	, slack(0)
+	, invalid(true)
+	, buckets(bucket_count)
+	, stats()
+{}
+
+void FlowField::configure(float scale, glm::ivec2 dims, glm::ivec2 offset) {
+	this->scale  = scale;
+	this->dims   = dims;
+	this->offset = offset;
+	stride = (size_t) dims.x + 2;
+	for (int step = 0; step < 8; step++) {
+		neighbours[step] = (int64_t) steps[step].y * (int64_t) stride + steps[step].x;
+	}
+	size_t const count = stride * ((size_t) dims.y + 2);
+	blocked.assign(count, 0);
+	costs.assign(count, unreachable);
+	sources.assign(count, unreachable);
+	block_border();
+	goals.clear();
+	dropped.clear();
+	invalid = true;
+}
+
+void FlowField::block_border() {
+	size_t const rows = (size_t) dims.y + 2;
+	std::fill(blocked.begin(), blocked.begin() + stride, 1);
+	std::fill(blocked.end() - stride, blocked.end(), 1);
+	for (size_t row = 1; row + 1 < rows; row++) {
+		blocked[row * stride]              = 1;
+		blocked[row * stride + stride - 1] = 1;
+	}
+}
+
+void FlowField::clear_obstacles() {
+	std::fill(blocked.begin(), blocked.end(), 0);
+	block_border();
+	invalid = true;
+}
+
+void FlowField::block(glm::vec2 minima, glm::vec2 maxima) {
+	glm::ivec2 lo = glm::ivec2(glm::floor(minima / scale)) - offset;
+	glm::ivec2 hi = glm::ivec2(glm::floor(maxima / scale)) - offset;
+	if ((hi.x < 0) || (hi.y < 0) || (lo.x >= dims.x) || (lo.y >= dims.y)) {
+		return;
+	}
+	lo = glm::max(lo, glm::ivec2(0, 0));
+	hi = glm::min(hi, dims - glm::ivec2(1, 1));
+	for (int y = lo.y; y <= hi.y; y++) {
+		auto row = blocked.begin() + (size_t) (y + 1) * stride + 1;
+		std::fill(row + lo.x, row + hi.x + 1, 1);
+	}
+	invalid = true;
+}
+
+void FlowField::set_slack(int cells) {
+	slack = cells;
+}
+
+// A goal still within the slack of its previous cell keeps that cell, so
+// the field is left as it was. Goals that left their cell are dropped, and
+// their cells cleared by the next update. Dropping accumulates, in case
+// goals are set more than once between updates.
+void FlowField::set_goals(glm::vec2 const* points, size_t count) {
+	placed.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		placed[i] = cell_index(points[i]);
+		if ((i < goals.size()) && within_slack(goals[i], placed[i])) {
+			placed[i] = goals[i];
+		}
+	}
+	if (dropped.size() < std::max(goals.size(), count)) {
+		dropped.resize(std::max(goals.size(), count), 0);
+	}
+	for (size_t i = 0; i < goals.size(); i++) {
+		if ((i >= count) || (placed[i] != goals[i])) {
+			dropped[i] = 1;
+		}
+	}
+	goals.swap(placed);
+}
+
+void FlowField::invalidate() {
+	invalid = true;
+}
+
+int64_t FlowField::cell_index(glm::vec2 point) const {
+	glm::ivec2 cell = glm::ivec2(glm::floor(point / scale)) - offset;
+	if ((cell.x < 0) || (cell.y < 0) || (cell.x >= dims.x) || (cell.y >= dims.y)) {
+		return -1;
+	}
+	return (int64_t) (cell.y + 1) * (int64_t) stride + cell.x + 1;
+}
+
+bool FlowField::within_slack(int64_t placed, int64_t cell) const {
+	if ((placed < 0) || (cell < 0)) {
+		return false;
+	}
+	int64_t const across = std::abs(placed % (int64_t) stride - cell % (int64_t) stride);
+	int64_t const down   = std::abs(placed / (int64_t) stride - cell / (int64_t) stride);
+	return (across <= slack) && (down <= slack);
+}
+
+// Diagonal moves need both of the cells beside them to be free
+inline bool FlowField::can_move(uint32_t cell, int step) const {
+	if (blocked[cell + neighbours[step]]) {
+		return false;
+	}
+	return (step < 4) || (!blocked[cell + steps[step].x] && !blocked[cell + neighbours[step] - steps[step].x]);
+}
+
+// Clears every cell whose cost came from a dropped goal, and queues the
+// cells around them that still have a cost to fill them in again. The
+// cells kept never depend on a cleared one, since a cell's path only passes
+// through cells with the same goal.
+void FlowField::clear_dropped() {
+	if (std::find(dropped.begin(), dropped.end(), 1) == dropped.end()) {
+		return;
+	}
+	size_t const rows        = (size_t) dims.y + 2;
+	size_t const block_count = (rows + row_block - 1) / row_block;
+	cleared.resize(block_count);
+	JobPool::parallel_for(rows, row_block, [this](size_t begin, size_t end) {
+		std::vector<uint32_t>& list = cleared[begin / row_block];
+		list.clear();
+		for (size_t i = begin * stride; i < end * stride; i++) {
+			uint32_t source = sources[i];
+			if ((source != unreachable) && (source < dropped.size()) && dropped[source]) {
+				costs[i]   = unreachable;
+				sources[i] = unreachable;
+				list.push_back((uint32_t) i);
+			}
+		}
+	});
+	// Filling in most of the grid from its edges costs more than starting
+	// over from the goals
+	size_t total = 0;
+	for (size_t block = 0; block < block_count; block++) {
+		total += cleared[block].size();
+	}
+	if (total * 2 > costs.size()) {
+		invalid = true;
+		return;
+	}
+	for (size_t block = 0; block < block_count; block++) {
+		for (uint32_t cell : cleared[block]) {
+			for (int step = 0; step < 8; step++) {
+				uint32_t neighbour = (uint32_t) (cell + neighbours[step]);
+				if ((costs[neighbour] != unreachable) && can_move(cell, step)) {
+					seeds.push_back({ costs[neighbour], neighbour });
+				}
+			}
+		}
+	}
+}
+
+// Dijkstra's algorithm from the seeds, which may start at any cost. Each
+// bucket holds the cells queued at one cost, and moves never cost more than
+// the ring holds, so a bucket is only reused once it has been emptied.
+// Seeds join the ring when the search reaches their cost.
+void FlowField::propagate() {
+	if (seeds.empty()) {
+		return;
+	}
+	std::sort(seeds.begin(), seeds.end());
+	size_t   next_seed = 0;
+	size_t   queued    = 0;
+	uint32_t current   = seeds[0].first;
+	while ((next_seed < seeds.size()) || (queued > 0)) {
+		if ((queued == 0) && (seeds[next_seed].first > current)) {
+			current = seeds[next_seed].first;
+		}
+		std::vector<uint32_t>& bucket = buckets[current % bucket_count];
+		while ((next_seed < seeds.size()) && (seeds[next_seed].first == current)) {
+			bucket.push_back(seeds[next_seed].second);
+			queued++;
+			next_seed++;
+		}
+		for (size_t i = 0; i < bucket.size(); i++) {
+			uint32_t cell = bucket[i];
+			// Cells queued again at a lower cost are left in their old bucket
+			if (costs[cell] != current) {
+				continue;
+			}
+			stats.settled_cells++;
+			for (int step = 0; step < 8; step++) {
+				uint32_t neighbour = (uint32_t) (cell + neighbours[step]);
+				uint32_t cost      = current + step_costs[step];
+				if ((cost < costs[neighbour]) && can_move(cell, step)) {
+					costs[neighbour]   = cost;
+					sources[neighbour] = sources[cell];
+					buckets[cost % bucket_count].push_back(neighbour);
+					queued++;
+				}
+			}
+		}
+		queued -= bucket.size();
+		bucket.clear();
+		current++;
+	}
+	seeds.clear();
+}
+
+void FlowField::update() {
+	stats = FlowStats();
+	if (!invalid) {
+		clear_dropped();
+	}
+	if (invalid) {
+		std::fill(costs.begin(), costs.end(), unreachable);
+		std::fill(sources.begin(), sources.end(), unreachable);
+		stats.rebuilt = true;
+		invalid = false;
+	}
+	std::fill(dropped.begin(), dropped.end(), 0);
+	dropped.resize(goals.size(), 0);
+
+	// Goal cells that lost their cost, or never had one, start the search.
+	// Goals that share a cell share its cost.
+	for (size_t goal = 0; goal < goals.size(); goal++) {
+		int64_t cell = goals[goal];
+		if ((cell < 0) || blocked[cell] || (costs[cell] == 0)) {
+			continue;
+		}
+		costs[cell]   = 0;
+		sources[cell] = (uint32_t) goal;
+		seeds.push_back({ 0, (uint32_t) cell });
+	}
+	propagate();
+}
+
+// Points at the cheapest neighbour. Looking at eight neighbours here is
+// cheaper than storing a direction for every cell, since most cells change
+// cost far more often than an agent looks at them.
+bool FlowField::direction(glm::vec2 point, glm::vec2& direction) const {
+	int64_t cell = cell_index(point);
+	if ((cell < 0) || (costs[cell] == unreachable)) {
+		return false;
+	}
+	uint32_t best   = costs[cell];
+	int      choice = -1;
+	for (int step = 0; step < 8; step++) {
+		uint32_t neighbour = (uint32_t) (cell + neighbours[step]);
+		if ((costs[neighbour] < best) && can_move((uint32_t) cell, step)) {
+			best   = costs[neighbour];
+			choice = step;
+		}
+	}
+	if (choice < 0) {
+		return false;
+	}
+	direction = glm::normalize(glm::vec2(steps[choice]));
+	return true;
+}
+
+uint32_t FlowField::cost(glm::vec2 point) const {
+	int64_t cell = cell_index(point);
+	return (cell < 0) ? unreachable : costs[cell];
+}
+
+FlowStats const& FlowField::last_update() const {
+	return stats;
+}
+
+
+int Navigation::slot_of(Status::Alignment alignment) {
+	return (int) alignment - (int) Status::EVIL;
+}
+
+void Navigation::configure(float cell_size, glm::ivec2 dims, glm::ivec2 offset, float clearance, int goal_slack) {
+	for (FlowField& field : fields) {
+		field.configure(cell_size, dims, offset);
+		field.set_slack(goal_slack);
+	}
+	Navigation::clearance = clearance;
+	obstacles_valid = false;
+}
+
+void Navigation::track(Status::Alignment alignment) {
+	tracked[slot_of(alignment)] = true;
+	obstacles_valid = false;
+}
+
+void Navigation::invalidate_obstacles() {
+	obstacles_valid = false;
+}
+
+void Navigation::gather_obstacles() {
+	for (int slot = 0; slot < 3; slot++) {
+		if (tracked[slot]) {
+			fields[slot].clear_obstacles();
+		}
+	}
+	glm::vec2 const grow(clearance, clearance);
+	for (size_t id : Physics::static_ids) {
+		if (!ecs::has<Physics>(id)) {
+			continue;
+		}
+		Physics& phys = ecs::get<Physics>(id);
+		if (!phys.solid) {
+			continue;
+		}
+		glm::vec2 minima, maxima;
+		phys.bounds(minima, maxima);
+		for (int slot = 0; slot < 3; slot++) {
+			if (tracked[slot]) {
+				fields[slot].block(minima - grow, maxima + grow);
+			}
+		}
+	}
+	obstacle_ids    = Physics::static_ids;
+	obstacles_valid = true;
+}
+
+void Navigation::update() {
+	if (!obstacles_valid || (obstacle_ids != Physics::static_ids)) {
+		gather_obstacles();
+	}
+	Status::Alignment const alignments[] = { Status::EVIL, Status::NEUTRAL, Status::GOOD };
+	std::vector<FlowField*> updating;
+	for (Status::Alignment alignment : alignments) {
+		if (!tracked[slot_of(alignment)]) {
+			continue;
+		}
+		FactionSpan members = FactionIndex::members(alignment);
+		fields[slot_of(alignment)].set_goals(members.positions, members.count);
+		updating.push_back(&fields[slot_of(alignment)]);
+	}
+	// Fields are independent, so several are updated side by side. A single
+	// field keeps the pool for its own passes.
+	if (updating.size() == 1) {
+		updating[0]->update();
+	}
+	else {
+		JobPool::parallel_for(updating.size(), 1, [&updating](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				updating[i]->update();
+			}
+		});
+	}
+}
+
+bool Navigation::direction(glm::vec2 point, Status::Alignment toward, glm::vec2& direction) {
+	if (!tracked[slot_of(toward)]) {
+		return false;
+	}
+	return fields[slot_of(toward)].direction(point, direction);
+}
+
+FlowField& Navigation::field(Status::Alignment alignment) {
+	return fields[slot_of(alignment)];
+}
+
+
+uint32_t const FlowField::unreachable;
+
+FlowField           Navigation::fields[3]       = {};
+bool                Navigation::tracked[3]      = { false, false, false };
+float               Navigation::clearance       = 0.f;
+std::vector<size_t> Navigation::obstacle_ids    = std::vector<size_t>();
+bool                Navigation::obstacles_valid = false;
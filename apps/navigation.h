@@ -0,0 +1,141 @@
+#ifndef NAVIGATION
+#define NAVIGATION
+
+#include "components.h"
+
+
+// Counts for the last FlowField::update
+struct FlowStats {
+	// Whether every cell was worked out again, rather than only the cells
+	// near goals that moved
+	bool   rebuilt;
+	size_t settled_cells;
+};
+
+
+// The way to the nearest of a set of goals from every cell of a grid, so
+// any number of agents can find their way with one lookup each.
+//
+// Costs are the length of the shortest path to a goal in tenths of a cell,
+// moving straight or diagonally between free cells, and never cutting the
+// corner of a blocked cell. They are found with Dijkstra's algorithm, using
+// a small ring of buckets as the queue since every move costs 10 or 14.
+//
+// Each cell remembers which goal its cost comes from. When goals move, only
+// the cells that came from the moved goals are cleared and filled again
+// from their neighbours, so a few goals moving a cell at a time touch a
+// small part of the grid. Clearing cells is split across the JobPool, and
+// changing the obstacles rebuilds everything.
+//
+// A goal that a whole region depends on, such as the only goal in the
+// field, clears that whole region whenever it moves. A goal that stays
+// within 'slack' cells of the cell it was placed in keeps that cell, so a
+// goal moving a little each step only costs an update every few steps.
+//
+// The grid is stored with a border of blocked cells, so looking at a
+// neighbour never needs a bounds check.
+class FlowField {
+
+	float      scale;
+	glm::ivec2 dims;
+	glm::ivec2 offset;
+	size_t     stride;
+	int64_t    neighbours[8];
+	int        slack;
+
+	std::vector<uint8_t>    blocked;
+	std::vector<uint32_t>   costs;
+	std::vector<uint32_t>   sources;
+	// The cell of each goal, by the index it was given to set_goals, or -1
+	// for a goal outside the grid
+	std::vector<int64_t>    goals;
+	std::vector<int64_t>    placed;
+	std::vector<uint8_t>    dropped;
+	bool                    invalid;
+
+	std::vector<std::vector<uint32_t>> buckets;
+	std::vector<std::pair<uint32_t, uint32_t>> seeds;
+	std::vector<std::vector<uint32_t>> cleared;
+
+	FlowStats  stats;
+
+	int64_t cell_index(glm::vec2 point) const;
+	// Whether an agent can move from 'cell' to the neighbour in 'step'
+	bool can_move(uint32_t cell, int step) const;
+	// Whether 'cell' is within the slack of the goal cell 'placed'
+	bool within_slack(int64_t placed, int64_t cell) const;
+	void block_border();
+	void clear_dropped();
+	void propagate();
+
+public:
+
+	static uint32_t const unreachable = 0xFFFFFFFFu;
+
+	FlowField();
+	// Clears the obstacles and goals
+	void configure(float scale, glm::ivec2 dims, glm::ivec2 offset);
+	void clear_obstacles();
+	// Zero, the default, moves a goal whenever it changes cell
+	void set_slack(int cells);
+	// Blocks every cell the box touches
+	void block(glm::vec2 minima, glm::vec2 maxima);
+	// Replaces the goals. Goals are matched to the previous ones by index,
+	// so a goal that keeps its index and its cell costs nothing.
+	void set_goals(glm::vec2 const* points, size_t count);
+	// Forgets everything worked out so far, so the next update starts over
+	void invalidate();
+	// Brings the costs up to date with the obstacles and goals. Must not be
+	// called while the field is being sampled.
+	void update();
+
+	// The unit direction to move from 'point' towards the nearest goal.
+	// Returns false in a goal's cell, in a blocked cell, outside the grid,
+	// or where no goal can be reached.
+	bool direction(glm::vec2 point, glm::vec2& direction) const;
+	// The cost from the cell holding 'point', or 'unreachable'
+	uint32_t cost(glm::vec2 point) const;
+	FlowStats const& last_update() const;
+
+};
+
+
+// Flow fields leading to the members of each faction, for AI to find its
+// way around the level. Only fields that have been asked for with track()
+// are kept up to date.
+//
+// The obstacles are the solid fixed bodies, grown by 'clearance' so agents
+// keep clear of walls. They are gathered again whenever the set of fixed
+// bodies changes, in the same way the broad phase notices. Every field is
+// given the same 'goal_slack', as in FlowField::set_slack.
+class Navigation {
+
+	static FlowField           fields[3];
+	static bool                tracked[3];
+	static float               clearance;
+	static std::vector<size_t> obstacle_ids;
+	static bool                obstacles_valid;
+
+	static int slot_of(Status::Alignment alignment);
+	static void gather_obstacles();
+
+public:
+
+	static void configure(float cell_size, glm::ivec2 dims, glm::ivec2 offset, float clearance, int goal_slack);
+	static void track(Status::Alignment alignment);
+	// For fixed bodies that moved without the set of them changing
+	static void invalidate_obstacles();
+	// Should be called once per step, after FactionIndex::refresh and
+	// before the AI runs
+	static void update();
+
+	// The way from 'point' towards the nearest member of 'toward'. Returns
+	// false wherever FlowField::direction does, or if the field is not
+	// tracked.
+	static bool direction(glm::vec2 point, Status::Alignment toward, glm::vec2& direction);
+	static FlowField& field(Status::Alignment alignment);
+
+};
+
+
+#endif
@@ -0,0 +1,69 @@
+#include "particles.h"
+#include "jobs.h"
+
+#include <cmath>
+
+
+void Particles::spawn(glm::vec2 position, glm::vec2 velocity, float life, AtlasImage image, glm::vec2 scale, float depth) {
+	glm::vec3 start(position, 0.f);
+	storage.insert(next_id++, ParticleBody{ start, start, velocity, life }, ParticleLook{ image, scale, depth });
+}
+
+void Particles::burst(glm::vec2 position, size_t count, float speed, float life, AtlasImage image, glm::vec2 scale, float depth) {
+	float const two_pi = 6.2831853f;
+	for (size_t i = 0; i < count; i++) {
+		float angle = two_pi * (float) i / (float) count;
+		spawn(position, speed * glm::vec2(std::cos(angle), std::sin(angle)), life, image, scale, depth);
+	}
+}
+
+// Each chunk is moved on its own, so the chunks are spread over the JobPool.
+// Particles that ran out of life are only removed afterwards, since removing
+// a row moves the last row into its place.
+void Particles::step(float delta) {
+	spans.clear();
+	storage.for_each_chunk([](size_t count, size_t const* ids, ParticleBody* bodies, ParticleLook* looks) {
+		spans.push_back({ count, bodies });
+	});
+	float const gravity = Physics::gravity;
+	float const drag    = std::pow(Physics::drag, delta);
+	JobPool::parallel_for(spans.size(), 4, [gravity, drag, delta](size_t begin, size_t end) {
+		for (size_t s = begin; s < end; s++) {
+			ParticleBody* bodies = spans[s].bodies;
+			for (size_t i = 0; i < spans[s].count; i++) {
+				ParticleBody& body = bodies[i];
+				body.previous    = body.position;
+				body.velocity.y -= gravity;
+				body.velocity   *= drag;
+				body.position   += glm::vec3(body.velocity * delta, 0.f);
+				body.life       -= delta;
+			}
+		}
+	});
+
+	expired.clear();
+	storage.for_each_chunk([](size_t count, size_t const* ids, ParticleBody* bodies, ParticleLook* looks) {
+		for (size_t i = 0; i < count; i++) {
+			if (bodies[i].life <= 0.f) {
+				expired.push_back(ids[i]);
+			}
+		}
+	});
+	for (size_t id : expired) {
+		storage.remove(id);
+	}
+}
+
+void Particles::clear() {
+	storage.clear();
+}
+
+size_t Particles::size() {
+	return storage.size();
+}
+
+
+Particles::Storage             Particles::storage;
+size_t                         Particles::next_id = 0;
+std::vector<Particles::Span>   Particles::spans;
+std::vector<size_t>            Particles::expired;
@@ -0,0 +1,70 @@
+#ifndef PARTICLES
+#define PARTICLES
+
+#include "components.h"
+#include "glazy_archetype.h"
+
+
+// The part of a particle that every step moves
+struct ParticleBody {
+	glm::vec3 position;
+	// Where the particle was before the latest step, as in Position
+	glm::vec3 previous;
+	glm::vec2 velocity;
+	float     life;
+};
+
+
+// The part of a particle that is only read when drawing
+struct ParticleLook {
+	AtlasImage image;
+	glm::vec2  scale;
+	float      depth;
+};
+
+
+// Short-lived sprites that collide with nothing. Nothing looks a particle up
+// by id, so rather than a Position, Physics and Sprite component each,
+// particles are rows of one Archetype, and stepping them walks the body
+// column chunk by chunk.
+//
+// Particles fall and slow down under the same gravity and drag as Physics
+// bodies, and are removed once their life runs out. Nothing in the game
+// spawns or draws them yet; the headless particles scenario steps them.
+class Particles {
+
+	typedef ecs::Archetype<ParticleBody, ParticleLook> Storage;
+
+	struct Span {
+		size_t        count;
+		ParticleBody* bodies;
+	};
+
+	static Storage             storage;
+	static size_t              next_id;
+	static std::vector<Span>   spans;
+	static std::vector<size_t> expired;
+
+public:
+
+	static void spawn(glm::vec2 position, glm::vec2 velocity, float life, AtlasImage image, glm::vec2 scale, float depth);
+	// Spawns 'count' particles spread evenly around a circle, moving out
+	// from 'position' at 'speed'
+	static void burst(glm::vec2 position, size_t count, float speed, float life, AtlasImage image, glm::vec2 scale, float depth);
+	static void step(float delta);
+	static void clear();
+	static size_t size();
+	// Calls fn(count, ids, ParticleBody*, ParticleLook*) once per chunk
+	template<typename Fn>
+	static void for_each_chunk(Fn&& fn);
+
+};
+
+
+template<typename Fn>
+void Particles::for_each_chunk(Fn&& fn) {
+	storage.for_each_chunk(std::forward<Fn>(fn));
+}
+
+
+#endif
@@ -1,259 +1,329 @@
-
-#include "quad.h"
-#include <glm/gtc/type_ptr.hpp>
-
-Wall::Wall(glm::vec2 pos, std::shared_ptr<Texture> tex, glm::vec2 scale)
-	: CollisionQuad(pos, tex, scale)
-{}
-
-Wall::Wall(glm::vec2 pos, std::shared_ptr<Texture> tex, glm::vec2 scale, std::shared_ptr<GPUProgram> program)
-	: CollisionQuad(pos, tex, scale)
-{
-	Sprite& sprite = ecs::get<Sprite>(id);
-	sprite.program = program;
-}
-
-
-template<>
-Wall *deserialize(std::string text) {
-	std::stringstream stream(text);
-	std::string token;
-	if ((stream >> token) && (token == "wall")) {
-		glm::vec2 pos;
-		glm::vec2 scale;
-		if (!(stream >> pos.x >> pos.y >> scale.x >> scale.y >> token)) {
-			return nullptr;
-		}
-		std::string tex_path = "assets/" + token;
-		std::string vertex, fragment;
-		if (stream >> vertex >> fragment) {
-			std::shared_ptr<GPUProgram> program = ProgramCache::load(vertex, fragment);
-			return new Wall(pos, TextureCache::load(tex_path,false), scale, program);
-		}
-		else {
-			return new Wall(pos, TextureCache::load(tex_path,false), scale);
-		}
-	}
-	return nullptr;
-}
-
-
-
-
-Background::Background(glm::vec2 pos, std::shared_ptr<Texture> tex, glm::vec2 scale)
-	: Quad(pos, tex, scale)
-{}
-
-Background::Background(glm::vec2 pos, std::shared_ptr<Texture> tex, glm::vec2 scale, std::shared_ptr<GPUProgram> program)
-	: Quad(pos, tex, scale)
-{
-	Sprite& sprite = ecs::get<Sprite>(id);
-	sprite.program = program;
-}
-
-template<>
-Background* deserialize(std::string text) {
-	std::stringstream stream(text);
-	std::string token;
-	if ((stream >> token) && (token == "back")) {
-		glm::vec2 pos;
-		glm::vec2 scale;
-		if(!(stream >> pos.x >> pos.y >> scale.x >> scale.y >> token)) {
-			return nullptr;
-		}
-		std::string tex_path = "assets/" + token;
-		std::string vertex, fragment;
-		if (stream >> vertex >> fragment) {
-			std::shared_ptr<GPUProgram> program = ProgramCache::load(vertex, fragment);
-			return new Background(pos, TextureCache::load(tex_path,false), scale, program);
-		}
-		else {
-			return new Background(pos, TextureCache::load(tex_path,false), scale);
-		}
-	}
-	return nullptr;
-}
-
-void TextBox::set_letter(int col, int row, int codepoint) {
-	data[10 + row * dims.x + col] = codepoint;
-}
-	
-GLint TextBox::get_letter(int col, int row) {
-	return data[10 + row * dims.x + col];
-}
-
-
-GLint TextBox::convert_symbol(char const*& iter) {
-	int tail_count = 0;
-	int result = 0;
-	if ( (*iter & 0x80) == 0 ) {
-		result = *iter;
-	}
-	else if ( (*iter & 0xE0) == 0xC0) {
-		tail_count = 1;
-		result = *iter & 0x1F;
-	}
-	else if ((*iter & 0xF0) == 0xE0) {
-		tail_count = 2;
-		result = *iter & 0x0F;
-	}
-	else if ((*iter & 0xF8) == 0xF0) {
-		tail_count = 3;
-		result = *iter & 0x07;
-	}
-	else {
-		throw std::runtime_error("Unicode conversion failure.");
-	}
-	iter++;
-	for (int i = 0; i < tail_count; i++) {
-		if ((*iter & 0xC0) == 0x80) {
-			result <<= 6;
-			result |= *iter & 0x3F;
-		}
-		else {
-			throw std::runtime_error("Unicode conversion failure.");
-		}
-		iter++;
-	}
-	return result;
-}
-
-void TextBox::handle_wrap(int &col, int&row) {
-	if ((col != 0) || (row == 0)) {
-		return;
-	}
-	if (row >= dims.y) {
-		return;
-	}
-	int start_col = dims.x-1;
-	int start_row = row-1;
-	if (get_letter(start_col,start_row) == ' ') {
-		return;
-	}
-	while ((start_col >= 0) && (get_letter(start_col,start_row) != ' ')) {
-		start_col--;
-	}
-	if (start_col == -1) {
-		return;
-	}
-	start_col++;
-	int transfer_count = dims.x - start_col;
-	for (int i = 0; i < transfer_count; i++) {
-		set_letter(i,row,get_letter(start_col+i,start_row));
-		set_letter(start_col + i, start_row, ' ');
-	}
-	col += transfer_count;
-}
-
-void TextBox::convert_text(bool wrap) {
-	data.resize(10 + dims.x * dims.y,' ');
-	memcpy(data.data(),   glm::value_ptr(forecolor), sizeof(GLfloat) * 4);
-	memcpy(data.data()+4, glm::value_ptr(backcolor), sizeof(GLfloat) * 4);
-	data[8] = dims.x;
-	data[9] = dims.y;
-	int row = 0;
-	int col = 0;
-	char const* iter = text.data();
-	char const* end = text.data() + text.size();
-	while (iter != end) {
-		int codepoint = convert_symbol(iter);
-		if (codepoint == '\n') {
-			col+= dims.x;
-		}
-		else if (codepoint == '\t') {
-			col += 4;
-		}
-		else {
-			if (col >= dims.x) {
-				col = 0;
-				row++;
-			}
-			if (row >= dims.y) {
-				break;
-			}
-			if (wrap) {
-				handle_wrap(col, row);
-			}
-			if ((codepoint != ' ') || (col != 0)) {
-				set_letter(col,row,codepoint);
-				col++;
-			}
-		}
-	}
-}
-
-void TextBox::setup() {
-	if (is_setup) {
-		return;
-	}
-	is_setup = true;
-	std::shared_ptr<GPUProgram> program = ProgramCache::load("shaders/text.vert","shaders/text.frag");
-	glUniformBlockBinding(*program,0,0);
-}
-
-TextBox::TextBox(glm::vec2 pos, glm::vec2 scale, glm::ivec2 dims, std::string text)
-	: Background(pos, TextureCache::load("assets/unifont.png",false), scale)
-	, text(text)
-	, dims(dims)
-	, modified(true)
-	, forecolor(0,0,0,1)
-	, backcolor(1,1,1,1)
-{
-	Sprite& sprite = ecs::get<Sprite>(id);
-	setup();
-	sprite.program = ProgramCache::load("shaders/text.vert","shaders/text.frag");
-	convert_text(true);
-	sprite.uniform_callback = [this](std::shared_ptr<GPUProgram> program) {
-		safety::entry_guard("Textbox Uniform Callback");
-		if (modified) {
-			buff.set_data(data,GL_STATIC_DRAW);
-			modified = false;
-		}
-		glBindBuffer(GL_UNIFORM_BUFFER, buff);
-		glBindBufferBase(GL_UNIFORM_BUFFER, 0, buff);
-		safety::exit_guard("Textbox Uniform Callback");
-	};
-}
-
-void TextBox::set_text(std::string text, bool wrap) {
-	safety::entry_guard("TextBox::set_text");
-	this->text = text;
-	convert_text(true);
-	modified = true;
-	safety::exit_guard("TextBox::set_text");
-}
-
-void TextBox::set_foreground(glm::vec4 color) {
-	forecolor = color;
-	modified = true;
-}
-
-void TextBox::set_background(glm::vec4 color) {
-	backcolor = color;
-	modified = true;
-}
-
-
-template<>
-TextBox* deserialize(std::string text) {
-	std::stringstream stream(text);
-	std::string token;
-	if ((stream >> token) && (token == "text")) {
-		glm::vec2 pos;
-		glm::vec2 scale;
-		glm::ivec2 dims;
-		std::string token;
-		if(!(stream >> pos.x >> pos.y >> scale.x >> scale.y >> dims.x >> dims.y >> token)) {
-			return nullptr;
-		}
-		std::string text;
-		std::getline(stream, text);
-		text = token + text;
-		return new TextBox(pos, scale, dims, text);
-	}
-	return nullptr;
-}
-
-bool TextBox::is_setup = false;
-
-
+
+#include "quad.h"
+#include <glm/gtc/type_ptr.hpp>
+
+Wall::Wall(glm::vec2 pos, AtlasImage image, glm::vec2 scale)
+	: CollisionQuad(pos, image, scale)
+{}
+
+Wall::Wall(glm::vec2 pos, AtlasImage image, glm::vec2 scale, std::shared_ptr<GPUProgram> program)
+	: CollisionQuad(pos, image, scale, program)
+{}
+
+
+namespace {
+
+	// Walls and backgrounds share one layout: position, scale, a texture in
+	// assets/, and optionally a vertex and fragment shader
+	bool parse_tiled(LineTokens& tokens, LevelRecord& record, LevelStrings& strings) {
+		glm::vec2 pos;
+		glm::vec2 scale;
+		std::string_view texture;
+		if (!(tokens.next(pos.x) && tokens.next(pos.y) && tokens.next(scale.x) && tokens.next(scale.y) && tokens.next(texture))) {
+			return false;
+		}
+		record.set(pos, scale, glm::ivec2(0, 0));
+		std::string tex_path = "assets/";
+		tex_path += texture;
+		record.strings[0] = strings.add(tex_path);
+		std::string_view vertex, fragment;
+		if (tokens.next(vertex) && tokens.next(fragment)) {
+			record.strings[1] = strings.add(vertex);
+			record.strings[2] = strings.add(fragment);
+		}
+		return true;
+	}
+
+	template<typename T>
+	T* construct_tiled(LevelRecord const& record, LevelStrings const& strings) {
+		AtlasImage image = TextureAtlas::load(strings.get(record.strings[0]));
+		if (record.strings[1] != LevelStrings::none) {
+			std::shared_ptr<GPUProgram> program = ProgramCache::load(strings.get(record.strings[1]), strings.get(record.strings[2]));
+			return new T(record.get_position(), image, record.get_scale(), program);
+		}
+		return new T(record.get_position(), image, record.get_scale());
+	}
+
+	// Images and programs are looked up once per distinct string in the
+	// batch, instead of by name for every record. The quads are then
+	// created in one pass with their component sets already large enough.
+	// Creating a quad adds to the component sets, so that pass stays on one
+	// thread.
+	template<typename T, typename... Components>
+	void construct_tiled_batch(LevelRecord const* const* records, size_t count, LevelStrings const& strings, std::vector<Quad*>& quads) {
+		std::vector<AtlasImage> images(strings.size());
+		std::vector<uint8_t>    loaded(strings.size(), 0);
+		std::unordered_map<uint64_t, std::shared_ptr<GPUProgram>> programs;
+		for (size_t i = 0; i < count; i++) {
+			LevelRecord const& record = *records[i];
+			// get() throws for indexes outside the table
+			std::string_view texture = strings.get(record.strings[0]);
+			if (!loaded[record.strings[0]]) {
+				images[record.strings[0]] = TextureAtlas::load(texture);
+				loaded[record.strings[0]] = 1;
+			}
+			uint64_t key = ((uint64_t) record.strings[1] << 32) | record.strings[2];
+			if ((record.strings[1] != LevelStrings::none) && (programs.find(key) == programs.end())) {
+				programs[key] = ProgramCache::load(strings.get(record.strings[1]), strings.get(record.strings[2]));
+			}
+		}
+		std::shared_ptr<GPUProgram> default_program = Sprite::get_default_program();
+
+		reserve_components<Components...>(count);
+		quads.reserve(quads.size() + count);
+		for (size_t i = 0; i < count; i++) {
+			LevelRecord const& record = *records[i];
+			std::shared_ptr<GPUProgram> const* program = &default_program;
+			if (record.strings[1] != LevelStrings::none) {
+				program = &programs.find(((uint64_t) record.strings[1] << 32) | record.strings[2])->second;
+			}
+			quads.push_back(new T(record.get_position(), images[record.strings[0]], record.get_scale(), *program));
+		}
+	}
+
+}
+
+
+template<>
+bool parse<Wall>(LineTokens& tokens, LevelRecord& record, LevelStrings& strings) {
+	return parse_tiled(tokens, record, strings);
+}
+
+template<>
+Wall* construct<Wall>(LevelRecord const& record, LevelStrings const& strings) {
+	return construct_tiled<Wall>(record, strings);
+}
+
+template<>
+void construct_batch<Wall>(LevelRecord const* const* records, size_t count, LevelStrings const& strings, std::vector<Quad*>& quads) {
+	construct_tiled_batch<Wall, Position, Sprite, Physics>(records, count, strings, quads);
+}
+
+
+
+
+Background::Background(glm::vec2 pos, std::shared_ptr<Texture> tex, glm::vec2 scale)
+	: Quad(pos, tex, scale)
+{}
+
+Background::Background(glm::vec2 pos, AtlasImage image, glm::vec2 scale)
+	: Quad(pos, image, scale)
+{}
+
+Background::Background(glm::vec2 pos, AtlasImage image, glm::vec2 scale, std::shared_ptr<GPUProgram> program)
+	: Quad(pos, image, scale, program)
+{}
+
+template<>
+bool parse<Background>(LineTokens& tokens, LevelRecord& record, LevelStrings& strings) {
+	return parse_tiled(tokens, record, strings);
+}
+
+template<>
+Background* construct<Background>(LevelRecord const& record, LevelStrings const& strings) {
+	return construct_tiled<Background>(record, strings);
+}
+
+template<>
+void construct_batch<Background>(LevelRecord const* const* records, size_t count, LevelStrings const& strings, std::vector<Quad*>& quads) {
+	construct_tiled_batch<Background, Position, Sprite>(records, count, strings, quads);
+}
+
+void TextBox::set_letter(int col, int row, int codepoint) {
+	data[10 + row * dims.x + col] = codepoint;
+}
+	
+GLint TextBox::get_letter(int col, int row) {
+	return data[10 + row * dims.x + col];
+}
+
+
+GLint TextBox::convert_symbol(char const*& iter) {
+	int tail_count = 0;
+	int result = 0;
+	if ( (*iter & 0x80) == 0 ) {
+		result = *iter;
+	}
+	else if ( (*iter & 0xE0) == 0xC0) {
+		tail_count = 1;
+		result = *iter & 0x1F;
+	}
+	else if ((*iter & 0xF0) == 0xE0) {
+		tail_count = 2;
+		result = *iter & 0x0F;
+	}
+	else if ((*iter & 0xF8) == 0xF0) {
+		tail_count = 3;
+		result = *iter & 0x07;
+	}
+	else {
+		throw std::runtime_error("Unicode conversion failure.");
+	}
+	iter++;
+	for (int i = 0; i < tail_count; i++) {
+		if ((*iter & 0xC0) == 0x80) {
+			result <<= 6;
+			result |= *iter & 0x3F;
+		}
+		else {
+			throw std::runtime_error("Unicode conversion failure.");
+		}
+		iter++;
+	}
+	return result;
+}
+
+void TextBox::handle_wrap(int &col, int&row) {
+	if ((col != 0) || (row == 0)) {
+		return;
+	}
+	if (row >= dims.y) {
+		return;
+	}
+	int start_col = dims.x-1;
+	int start_row = row-1;
+	if (get_letter(start_col,start_row) == ' ') {
+		return;
+	}
+	while ((start_col >= 0) && (get_letter(start_col,start_row) != ' ')) {
+		start_col--;
+	}
+	if (start_col == -1) {
+		return;
+	}
+	start_col++;
+	int transfer_count = dims.x - start_col;
+	for (int i = 0; i < transfer_count; i++) {
+		set_letter(i,row,get_letter(start_col+i,start_row));
+		set_letter(start_col + i, start_row, ' ');
+	}
+	col += transfer_count;
+}
+
+void TextBox::convert_text(bool wrap) {
+	data.resize(10 + dims.x * dims.y,' ');
+	memcpy(data.data(),   glm::value_ptr(forecolor), sizeof(GLfloat) * 4);
+	memcpy(data.data()+4, glm::value_ptr(backcolor), sizeof(GLfloat) * 4);
+	data[8] = dims.x;
+	data[9] = dims.y;
+	int row = 0;
+	int col = 0;
+	char const* iter = text.data();
+	char const* end = text.data() + text.size();
+	while (iter != end) {
+		int codepoint = convert_symbol(iter);
+		if (codepoint == '\n') {
+			col+= dims.x;
+		}
+		else if (codepoint == '\t') {
+			col += 4;
+		}
+		else {
+			if (col >= dims.x) {
+				col = 0;
+				row++;
+			}
+			if (row >= dims.y) {
+				break;
+			}
+			if (wrap) {
+				handle_wrap(col, row);
+			}
+			if ((codepoint != ' ') || (col != 0)) {
+				set_letter(col,row,codepoint);
+				col++;
+			}
+		}
+	}
+}
+
+void TextBox::setup() {
+	if (is_setup) {
+		return;
+	}
+	is_setup = true;
+#ifndef GLAZY_HEADLESS
+	std::shared_ptr<GPUProgram> program = ProgramCache::load("shaders/text.vert","shaders/text.frag");
+	glUniformBlockBinding(*program,0,0);
+#endif
+}
+
+TextBox::TextBox(glm::vec2 pos, glm::vec2 scale, glm::ivec2 dims, std::string text)
+	: Background(pos, TextureCache::load("assets/unifont.png",false), scale)
+	, text(text)
+	, dims(dims)
+	, modified(true)
+	, forecolor(0,0,0,1)
+	, backcolor(1,1,1,1)
+{
+	Sprite& sprite = ecs::get<Sprite>(id);
+	setup();
+	sprite.program = ProgramCache::load("shaders/text.vert","shaders/text.frag");
+	convert_text(true);
+	sprite.uniform_callback = [this](std::shared_ptr<GPUProgram> program) {
+		safety::entry_guard("Textbox Uniform Callback");
+		// The buffer is made on first draw, so text boxes can exist without
+		// a GL context
+		if (!buff) {
+			buff = std::make_shared<Buffer<GLint>>();
+			modified = true;
+		}
+		if (modified) {
+			buff->set_data(data,GL_STATIC_DRAW);
+			modified = false;
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, *buff);
+		glBindBufferBase(GL_UNIFORM_BUFFER, 0, *buff);
+		safety::exit_guard("Textbox Uniform Callback");
+	};
+}
+
+void TextBox::set_text(std::string text, bool wrap) {
+	safety::entry_guard("TextBox::set_text");
+	this->text = text;
+	convert_text(true);
+	modified = true;
+	safety::exit_guard("TextBox::set_text");
+}
+
+void TextBox::set_foreground(glm::vec4 color) {
+	forecolor = color;
+	modified = true;
+}
+
+void TextBox::set_background(glm::vec4 color) {
+	backcolor = color;
+	modified = true;
+}
+
+
+// The text runs to the end of the line, spaces included
+template<>
+bool parse<TextBox>(LineTokens& tokens, LevelRecord& record, LevelStrings& strings) {
+	glm::vec2 pos;
+	glm::vec2 scale;
+	glm::ivec2 dims;
+	if (!(tokens.next(pos.x) && tokens.next(pos.y) && tokens.next(scale.x) && tokens.next(scale.y) && tokens.next(dims.x) && tokens.next(dims.y))) {
+		return false;
+	}
+	std::string_view text = tokens.remainder();
+	if (text.empty()) {
+		return false;
+	}
+	record.set(pos, scale, dims);
+	record.strings[0] = strings.add(text);
+	return true;
+}
+
+template<>
+TextBox* construct<TextBox>(LevelRecord const& record, LevelStrings const& strings) {
+	return new TextBox(record.get_position(), record.get_scale(), record.get_dims(), std::string(strings.get(record.strings[0])));
+}
+
+bool TextBox::is_setup = false;
+
+char const* const Wall::keyword       = "wall";
+char const* const Background::keyword = "back";
+char const* const TextBox::keyword    = "text";
+
+
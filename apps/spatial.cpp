@@ -0,0 +1,157 @@
+#include "spatial.h"
+
+
+void SpatialIndex::configure(float cell_size) {
+	SpatialIndex::cell_size = cell_size;
+}
+
+SpatialIndex::Layer& SpatialIndex::layer_of(Status::Alignment alignment) {
+	return layers[(int) alignment - (int) Status::EVIL];
+}
+
+void SpatialIndex::rebuild() {
+	Status::Alignment const alignments[] = { Status::EVIL, Status::NEUTRAL, Status::GOOD };
+	for (Status::Alignment alignment : alignments) {
+		build(layer_of(alignment), FactionIndex::members(alignment));
+	}
+}
+
+// Fits the grid to the faction's members and sorts them into it. Each
+// member is a point, so it lands in exactly one cell.
+void SpatialIndex::build(Layer& layer, FactionSpan members) {
+	size_t const count = members.count;
+	layer.entries.clear();
+	if (count == 0) {
+		layer.map.configure(cell_size, { 0, 0 }, { 0, 0 });
+		return;
+	}
+	glm::vec2 low  = members.positions[0];
+	glm::vec2 high = members.positions[0];
+	for (size_t i = 0; i < count; i++) {
+		low  = glm::min(low,  members.positions[i]);
+		high = glm::max(high, members.positions[i]);
+	}
+	// A few cells per member is plenty, and keeps far-flung members from
+	// making a huge, mostly empty grid
+	double const cell_limit = std::max<double>(4.0 * count, 64.0);
+	float scale = cell_size;
+	glm::ivec2 offset, dims;
+	for (;;) {
+		offset = glm::ivec2(glm::floor(low / scale));
+		dims   = glm::ivec2(glm::floor(high / scale)) - offset + glm::ivec2(1, 1);
+		if ((double) dims.x * dims.y <= cell_limit) {
+			break;
+		}
+		scale *= 2.f;
+	}
+	layer.map.configure(scale, dims, offset);
+
+	layer.cells.resize(count);
+	layer.included.assign(count, 1);
+	for (size_t i = 0; i < count; i++) {
+		glm::ivec2 cell = glm::ivec2(glm::floor(members.positions[i] / scale));
+		layer.cells[i] = CellRect{ cell, cell };
+	}
+	layer.map.rebuild(layer.cells, layer.included, 0, count);
+	layer.entries.resize(layer.map.entries.size());
+	for (size_t k = 0; k < layer.map.entries.size(); k++) {
+		uint32_t member = layer.map.entries[k];
+		layer.entries[k] = Entry{ members.positions[member], members.ids[member] };
+	}
+}
+
+// Searches rings of cells outwards from the point's cell. Every entity in
+// ring r is at least r-1 cells away, so the search stops once that is
+// further than the best distance found. A point outside the grid starts
+// from the nearest cell inside it. Moving a point onto the grid never makes
+// it further from anything in the grid, so the same bound holds.
+bool SpatialIndex::nearest(glm::vec2 point, Status::Alignment alignment, float max_distance, SpatialHit& hit) {
+	Layer const& layer = layer_of(alignment);
+	if (layer.entries.empty()) {
+		return false;
+	}
+	CollisionMap const& map = layer.map;
+	glm::ivec2 const center = glm::clamp(
+		glm::ivec2(glm::floor(point / map.scale)) - map.offset,
+		glm::ivec2(0, 0),
+		map.dims - glm::ivec2(1, 1)
+	);
+	int const last_ring = std::max(
+		std::max(center.x, map.dims.x - 1 - center.x),
+		std::max(center.y, map.dims.y - 1 - center.y)
+	);
+
+	bool  found = false;
+	float best  = max_distance;
+	auto  visit = [&](int x, int y) {
+		if ((x < 0) || (x >= map.dims.x) || (y < 0) || (y >= map.dims.y)) {
+			return;
+		}
+		CellSpan bucket = map.bucket_at(map.offset + glm::ivec2(x, y));
+		Entry const* first = layer.entries.data() + (bucket.begin() - map.entries.data());
+		Entry const* last  = first + bucket.size();
+		for (Entry const* entry = first; entry != last; entry++) {
+			float distance = glm::distance(point, entry->position);
+			bool closer = found ? ((distance < best) || ((distance == best) && (entry->id < hit.id))) : (distance <= best);
+			if (closer) {
+				hit   = SpatialHit{ entry->id, entry->position, distance };
+				best  = distance;
+				found = true;
+			}
+		}
+	};
+	for (int ring = 0; ring <= last_ring; ring++) {
+		if ((ring > 0) && ((float) (ring - 1) * map.scale > best)) {
+			break;
+		}
+		for (int y = center.y - ring; y <= center.y + ring; y++) {
+			if ((y == center.y - ring) || (y == center.y + ring)) {
+				for (int x = center.x - ring; x <= center.x + ring; x++) {
+					visit(x, y);
+				}
+			}
+			else {
+				visit(center.x - ring, y);
+				visit(center.x + ring, y);
+			}
+		}
+	}
+	return found;
+}
+
+void SpatialIndex::within(glm::vec2 point, float radius, Status::Alignment alignment, std::vector<SpatialHit>& hits) {
+	Layer const& layer = layer_of(alignment);
+	if (layer.entries.empty()) {
+		return;
+	}
+	CollisionMap const& map = layer.map;
+	glm::ivec2 const grid_max = map.dims - glm::ivec2(1, 1);
+	glm::ivec2 lo = glm::ivec2(glm::floor((point - radius) / map.scale)) - map.offset;
+	glm::ivec2 hi = glm::ivec2(glm::floor((point + radius) / map.scale)) - map.offset;
+	if ((hi.x < 0) || (hi.y < 0) || (lo.x > grid_max.x) || (lo.y > grid_max.y)) {
+		return;
+	}
+	lo = glm::max(lo, glm::ivec2(0, 0));
+	hi = glm::min(hi, grid_max);
+	for (int y = lo.y; y <= hi.y; y++) {
+		for (int x = lo.x; x <= hi.x; x++) {
+			CellSpan bucket = map.bucket_at(map.offset + glm::ivec2(x, y));
+			Entry const* first = layer.entries.data() + (bucket.begin() - map.entries.data());
+			Entry const* last  = first + bucket.size();
+			for (Entry const* entry = first; entry != last; entry++) {
+				float distance = glm::distance(point, entry->position);
+				if (distance <= radius) {
+					hits.push_back(SpatialHit{ entry->id, entry->position, distance });
+				}
+			}
+		}
+	}
+}
+
+size_t SpatialIndex::size(Status::Alignment alignment) {
+	return layer_of(alignment).entries.size();
+}
+
+
+float               SpatialIndex::cell_size = 0.25f;
+SpatialIndex::Layer SpatialIndex::layers[3] = {};
@@ -0,0 +1,68 @@
+#ifndef SPATIAL
+#define SPATIAL
+
+#include "components.h"
+
+
+// One entity found by a spatial query
+struct SpatialHit {
+	size_t    id;
+	glm::vec2 position;
+	float     distance;
+};
+
+
+// Answers nearest-neighbour and radius queries about the members of each
+// faction, such as AI looking for something to chase.
+//
+// Each alignment has its own layer: a CollisionMap over the members' cells,
+// built with the same counting sort as the broad phase, and the members'
+// positions packed in cell order, so a query only reads the cells it needs
+// and only the alignment it asked for. The layers are rebuilt once a step
+// by rebuild(), from the positions in FactionIndex, and answer from those
+// positions until the next rebuild.
+//
+// A layer's grid is fitted to the entities it holds, so it has no world
+// bounds. Cells are 'cell_size' wide unless that would make the grid much
+// larger than the number of entities, in which case they are widened.
+class SpatialIndex {
+
+	struct Entry {
+		glm::vec2 position;
+		size_t    id;
+	};
+
+	struct Layer {
+		CollisionMap          map;
+		std::vector<CellRect> cells;
+		std::vector<uint8_t>  included;
+		// Packed in cell order
+		std::vector<Entry>    entries;
+	};
+
+	static float cell_size;
+	static Layer layers[3];
+
+	static Layer& layer_of(Status::Alignment alignment);
+	static void build(Layer& layer, FactionSpan members);
+
+public:
+
+	static void configure(float cell_size);
+	// Should be called once per step, after FactionIndex::refresh and
+	// before anything queries the index
+	static void rebuild();
+
+	// Finds the closest entity of the given alignment no further than
+	// 'max_distance' away. Equally close entities are told apart by id.
+	// Returns false if there is none.
+	static bool nearest(glm::vec2 point, Status::Alignment alignment, float max_distance, SpatialHit& hit);
+	// Appends every entity of the given alignment within 'radius', in no
+	// particular order
+	static void within(glm::vec2 point, float radius, Status::Alignment alignment, std::vector<SpatialHit>& hits);
+	static size_t size(Status::Alignment alignment);
+
+};
+
+
+#endif
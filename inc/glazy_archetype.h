@@ -0,0 +1,239 @@
+#ifndef GLAZY_ARCHETYPE
+#define GLAZY_ARCHETYPE
+
+#include "glazy_ecs.h"
+#include "glazy_sparse_set.h"
+
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace glazy {
+
+	namespace ecs {
+
+		namespace detail {
+
+			template<typename T, typename... Ts>
+			struct index_of;
+
+			template<typename T, typename... Ts>
+			struct index_of<T, T, Ts...> : std::integral_constant<size_t, 0> {};
+
+			template<typename T, typename U, typename... Ts>
+			struct index_of<T, U, Ts...> : std::integral_constant<size_t, 1 + index_of<T, Ts...>::value> {};
+
+		}
+
+
+		// An Archetype is an alternative to ComponentSet storage for entities
+		// that all share the same signature, such as Position+Physics+Sprite+AI+Status.
+		// Rows are kept densely packed in fixed-capacity chunks, and each column of a
+		// chunk is its own contiguous array (SoA), so a system that only needs a
+		// couple of columns walks them linearly instead of doing a lookup per entity.
+		//
+		// Columns can be whole components or hot fields split out of a component
+		// (for instance glm::vec2 velocity and glm::vec2 bbox_dims for physics).
+		// Each column type must appear at most once in the signature.
+		template<typename... Columns>
+		class Archetype {
+
+		public:
+
+			static size_t const chunk_capacity = 256;
+
+			class Chunk {
+
+				template<typename T>
+				struct Column {
+					alignas(T) unsigned char bytes[sizeof(T) * chunk_capacity];
+				};
+
+				size_t count;
+				size_t ids[chunk_capacity];
+				std::tuple<Column<Columns>...> columns;
+
+				friend class Archetype;
+
+			public:
+
+				Chunk() : count(0) {}
+
+				size_t size() const {
+					return count;
+				}
+
+				size_t const* entities() const {
+					return ids;
+				}
+
+				template<typename T>
+				T* column() {
+					auto& col = std::get<detail::index_of<T, Columns...>::value>(columns);
+					return reinterpret_cast<T*>(col.bytes);
+				}
+
+			};
+
+		private:
+
+			std::vector<std::unique_ptr<Chunk>> chunks;
+			SparseSet<size_t> rows;
+			size_t row_count;
+
+			Chunk& chunk_of(size_t row) {
+				return *chunks[row / chunk_capacity];
+			}
+
+			size_t row_of(size_t id) const {
+				size_t const* row = rows.find(id);
+				if (row == nullptr) {
+					std::string message = "Entity ";
+					message += std::to_string(id) + " is not stored in this archetype.";
+					throw std::runtime_error(message);
+				}
+				return *row;
+			}
+
+			template<typename T>
+			static void relocate(Chunk& dst, size_t dst_slot, Chunk& src, size_t src_slot) {
+				T* dst_ptr = dst.template column<T>() + dst_slot;
+				T* src_ptr = src.template column<T>() + src_slot;
+				dst_ptr->~T();
+				new (dst_ptr) T(std::move(*src_ptr));
+				src_ptr->~T();
+			}
+
+			template<typename T>
+			static void destroy(Chunk& chunk, size_t slot) {
+				(chunk.template column<T>() + slot)->~T();
+			}
+
+		public:
+
+			Archetype() : row_count(0) {}
+
+			Archetype(Archetype const&) = delete;
+			Archetype& operator=(Archetype const&) = delete;
+
+			~Archetype() {
+				clear();
+			}
+
+			size_t size() const {
+				return row_count;
+			}
+
+			bool has(size_t id) const {
+				return rows.has(id);
+			}
+
+			// Makes sure that at least 'count' rows fit without allocating new chunks
+			void reserve(size_t count) {
+				size_t needed = (count + chunk_capacity - 1) / chunk_capacity;
+				while (chunks.size() < needed) {
+					chunks.emplace_back(new Chunk);
+				}
+				rows.reserve(count);
+			}
+
+			// Adds a row for the given entity, with one value per column, in the
+			// same order as the archetype's signature
+			template<typename... Args>
+			void insert(size_t id, Args&&... values) {
+				static_assert(sizeof...(Args) == sizeof...(Columns), "Archetype::insert needs one value per column.");
+				if (has(id)) {
+					std::string message = "Entity ";
+					message += std::to_string(id) + " is already stored in this archetype.";
+					throw std::runtime_error(message);
+				}
+				reserve(row_count + 1);
+				Chunk& chunk = chunk_of(row_count);
+				size_t slot = chunk.count;
+				(void) std::initializer_list<int>{
+					(new (chunk.template column<Columns>() + slot) Columns(std::forward<Args>(values)), 0)...
+				};
+				chunk.ids[slot] = id;
+				chunk.count++;
+				rows.emplace(id, row_count);
+				row_count++;
+			}
+
+			// Removes the entity's row, moving the last row into the hole so that
+			// every chunk but the last stays full
+			void remove(size_t id) {
+				size_t row  = row_of(id);
+				size_t last = row_count - 1;
+				Chunk& chunk      = chunk_of(row);
+				Chunk& last_chunk = chunk_of(last);
+				size_t slot      = row  % chunk_capacity;
+				size_t last_slot = last % chunk_capacity;
+				if (row != last) {
+					(void) std::initializer_list<int>{
+						(relocate<Columns>(chunk, slot, last_chunk, last_slot), 0)...
+					};
+					size_t moved_id = last_chunk.ids[last_slot];
+					chunk.ids[slot] = moved_id;
+					rows.get(moved_id) = row;
+				}
+				else {
+					(void) std::initializer_list<int>{ (destroy<Columns>(chunk, slot), 0)... };
+				}
+				last_chunk.count--;
+				rows.remove(id);
+				row_count--;
+			}
+
+			void clear() {
+				for (auto& chunk : chunks) {
+					for (size_t slot = 0; slot < chunk->count; slot++) {
+						(void) std::initializer_list<int>{ (destroy<Columns>(*chunk, slot), 0)... };
+					}
+					chunk->count = 0;
+				}
+				rows.clear();
+				row_count = 0;
+			}
+
+			template<typename T>
+			T& get(size_t id) {
+				size_t row = row_of(id);
+				return chunk_of(row).template column<T>()[row % chunk_capacity];
+			}
+
+			// Calls fn(count, ids, Columns*...) once per non-empty chunk. This is the
+			// intended way to write hot systems against an archetype.
+			template<typename Fn>
+			void for_each_chunk(Fn&& fn) {
+				for (auto& chunk : chunks) {
+					if (chunk->count == 0) {
+						break;
+					}
+					fn(chunk->count, chunk->ids, chunk->template column<Columns>()...);
+				}
+			}
+
+			// Calls fn(id, Columns&...) for every row, in storage order
+			template<typename Fn>
+			void for_each(Fn&& fn) {
+				for_each_chunk([&fn](size_t count, size_t const* ids, Columns*... cols) {
+					for (size_t i = 0; i < count; i++) {
+						fn(ids[i], cols[i]...);
+					}
+				});
+			}
+
+		};
+
+	}
+
+}
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef GLAZY_SPARSE_SET
+#define GLAZY_SPARSE_SET
+
+#include "glazy_ecs.h"
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace glazy {
+
+	namespace ecs {
+
+		// A handle remembers which incarnation of an entity's slot it was made
+		// from, so it stops resolving once that entity has been removed, even if
+		// the same id is later reused.
+		struct Handle {
+			size_t   id;
+			uint32_t generation;
+		};
+
+
+		// A paged sparse set maps entity ids (as handed out by Entity::id_counter)
+		// to a densely packed array of values. Lookups are two loads (page, then
+		// slot) and never search, while iteration walks the packed array.
+		// Removal swaps the last value into the hole, so dense order is not stable.
+		template<typename T>
+		class SparseSet {
+
+		public:
+
+			static size_t const page_size = 4096;
+
+		private:
+
+			static uint32_t const absent = 0xFFFFFFFFu;
+
+			struct Slot {
+				uint32_t dense;
+				uint32_t generation;
+			};
+
+			std::vector<std::unique_ptr<Slot[]>> pages;
+			std::vector<size_t> dense_ids;
+			std::vector<T>      dense_values;
+
+			Slot* slot_at(size_t id) const {
+				size_t page = id / page_size;
+				if ((page >= pages.size()) || (!pages[page])) {
+					return nullptr;
+				}
+				return &pages[page][id % page_size];
+			}
+
+			Slot& make_slot(size_t id) {
+				size_t page = id / page_size;
+				if (page >= pages.size()) {
+					pages.resize(page + 1);
+				}
+				if (!pages[page]) {
+					pages[page].reset(new Slot[page_size]);
+					for (size_t i = 0; i < page_size; i++) {
+						pages[page][i] = Slot{ absent, 0 };
+					}
+				}
+				return pages[page][id % page_size];
+			}
+
+			static void missing(size_t id) {
+				std::string message = "Entity ";
+				message += std::to_string(id) + " has no entry in sparse set.";
+				throw std::runtime_error(message);
+			}
+
+		public:
+
+			size_t size() const {
+				return dense_values.size();
+			}
+
+			bool empty() const {
+				return dense_values.empty();
+			}
+
+			void reserve(size_t count) {
+				dense_ids.reserve(count);
+				dense_values.reserve(count);
+			}
+
+			bool has(size_t id) const {
+				Slot* slot = slot_at(id);
+				return (slot != nullptr) && (slot->dense != absent);
+			}
+
+			// Returns nullptr if the entity has no entry
+			T* find(size_t id) {
+				Slot* slot = slot_at(id);
+				if ((slot == nullptr) || (slot->dense == absent)) {
+					return nullptr;
+				}
+				return &dense_values[slot->dense];
+			}
+
+			T const* find(size_t id) const {
+				Slot* slot = slot_at(id);
+				if ((slot == nullptr) || (slot->dense == absent)) {
+					return nullptr;
+				}
+				return &dense_values[slot->dense];
+			}
+
+			T& get(size_t id) {
+				T* result = find(id);
+				if (result == nullptr) {
+					missing(id);
+				}
+				return *result;
+			}
+
+			// Position of the entity's value in the packed array
+			size_t index_of(size_t id) const {
+				Slot* slot = slot_at(id);
+				if ((slot == nullptr) || (slot->dense == absent)) {
+					missing(id);
+				}
+				return slot->dense;
+			}
+
+			Handle handle(size_t id) const {
+				Slot* slot = slot_at(id);
+				if ((slot == nullptr) || (slot->dense == absent)) {
+					missing(id);
+				}
+				return Handle{ id, slot->generation };
+			}
+
+			bool valid(Handle handle) const {
+				Slot* slot = slot_at(handle.id);
+				return (slot != nullptr) && (slot->dense != absent) && (slot->generation == handle.generation);
+			}
+
+			// Returns nullptr if the handle's entity has since been removed
+			T* resolve(Handle handle) {
+				if (!valid(handle)) {
+					return nullptr;
+				}
+				return &dense_values[slot_at(handle.id)->dense];
+			}
+
+			template<typename... Args>
+			T& emplace(size_t id, Args&&... args) {
+				Slot& slot = make_slot(id);
+				if (slot.dense != absent) {
+					std::string message = "Entity ";
+					message += std::to_string(id) + " already has an entry in sparse set.";
+					throw std::runtime_error(message);
+				}
+				slot.dense = static_cast<uint32_t>(dense_values.size());
+				dense_ids.push_back(id);
+				dense_values.emplace_back(std::forward<Args>(args)...);
+				return dense_values.back();
+			}
+
+			void remove(size_t id) {
+				Slot* slot = slot_at(id);
+				if ((slot == nullptr) || (slot->dense == absent)) {
+					return;
+				}
+				uint32_t hole = slot->dense;
+				uint32_t last = static_cast<uint32_t>(dense_values.size() - 1);
+				if (hole != last) {
+					dense_values[hole] = std::move(dense_values[last]);
+					dense_ids[hole]    = dense_ids[last];
+					slot_at(dense_ids[hole])->dense = hole;
+				}
+				dense_values.pop_back();
+				dense_ids.pop_back();
+				slot->dense = absent;
+				slot->generation++;
+			}
+
+			// Drops every entry but keeps allocated pages, so refilling the set
+			// with the same ids does not touch the allocator
+			void clear() {
+				for (size_t id : dense_ids) {
+					Slot* slot = slot_at(id);
+					slot->dense = absent;
+					slot->generation++;
+				}
+				dense_ids.clear();
+				dense_values.clear();
+			}
+
+			size_t const* ids() const {
+				return dense_ids.data();
+			}
+
+			T* data() {
+				return dense_values.data();
+			}
+
+			typename std::vector<T>::iterator begin() {
+				return dense_values.begin();
+			}
+
+			typename std::vector<T>::iterator end() {
+				return dense_values.end();
+			}
+
+		};
+
+	}
+
+}
+
+#endif
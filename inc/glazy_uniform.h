@@ -0,0 +1,179 @@
+#ifndef GLAZY_UNIFORM
+#define GLAZY_UNIFORM
+
+#include "glazy_common.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace glazy {
+
+	namespace uniform {
+
+		// The GL entry points used by uniform tables. They can be replaced, so
+		// tables can be built and benchmarked without a GL context.
+		struct Functions {
+			void  (*get_program)(GLuint program, GLenum name, GLint* value);
+			void  (*get_active_uniform)(GLuint program, GLuint index, GLsizei buffer_size, GLsizei* length, GLint* size, GLenum* type, GLchar* name);
+			GLint (*get_location)(GLuint program, GLchar const* name);
+			// Sets 'count' elements of the uniform at 'location', where 'type'
+			// is the uniform's type as reported by get_active_uniform
+			void  (*upload)(GLint location, GLenum type, GLsizei count, void const* data);
+		};
+
+		// The functions in use, which start out as the GL ones
+		extern Functions functions;
+		Functions gl_functions();
+
+		// The GL type a uniform must be declared with to be set from a T.
+		// Booleans and samplers are set from GLint.
+		template<typename T> struct TypeOf;
+		template<> struct TypeOf<GLfloat>     { static GLenum const value = GL_FLOAT;             };
+		template<> struct TypeOf<glm::vec2>   { static GLenum const value = GL_FLOAT_VEC2;        };
+		template<> struct TypeOf<glm::vec3>   { static GLenum const value = GL_FLOAT_VEC3;        };
+		template<> struct TypeOf<glm::vec4>   { static GLenum const value = GL_FLOAT_VEC4;        };
+		template<> struct TypeOf<GLint>       { static GLenum const value = GL_INT;               };
+		template<> struct TypeOf<glm::ivec2>  { static GLenum const value = GL_INT_VEC2;          };
+		template<> struct TypeOf<glm::ivec3>  { static GLenum const value = GL_INT_VEC3;          };
+		template<> struct TypeOf<glm::ivec4>  { static GLenum const value = GL_INT_VEC4;          };
+		template<> struct TypeOf<GLuint>      { static GLenum const value = GL_UNSIGNED_INT;      };
+		template<> struct TypeOf<glm::uvec2>  { static GLenum const value = GL_UNSIGNED_INT_VEC2; };
+		template<> struct TypeOf<glm::uvec3>  { static GLenum const value = GL_UNSIGNED_INT_VEC3; };
+		template<> struct TypeOf<glm::uvec4>  { static GLenum const value = GL_UNSIGNED_INT_VEC4; };
+		template<> struct TypeOf<glm::mat2>   { static GLenum const value = GL_FLOAT_MAT2;        };
+		template<> struct TypeOf<glm::mat3>   { static GLenum const value = GL_FLOAT_MAT3;        };
+		template<> struct TypeOf<glm::mat4>   { static GLenum const value = GL_FLOAT_MAT4;        };
+		template<> struct TypeOf<glm::mat2x3> { static GLenum const value = GL_FLOAT_MAT2x3;      };
+		template<> struct TypeOf<glm::mat2x4> { static GLenum const value = GL_FLOAT_MAT2x4;      };
+		template<> struct TypeOf<glm::mat3x2> { static GLenum const value = GL_FLOAT_MAT3x2;      };
+		template<> struct TypeOf<glm::mat3x4> { static GLenum const value = GL_FLOAT_MAT3x4;      };
+		template<> struct TypeOf<glm::mat4x2> { static GLenum const value = GL_FLOAT_MAT4x2;      };
+		template<> struct TypeOf<glm::mat4x3> { static GLenum const value = GL_FLOAT_MAT4x3;      };
+		template<> struct TypeOf<GLdouble>    { static GLenum const value = GL_DOUBLE;            };
+
+	}
+
+
+	// The active uniforms of one linked program, read once when it is built.
+	// Names are kept in a flat open-addressed hash table, so a lookup is a
+	// hash and usually one string compare, with no GL call.
+	//
+	// The table also remembers the last value set for each uniform and skips
+	// uploads that would not change it. Since uniform values belong to the
+	// program, this stays correct across program switches, as long as every
+	// write goes through the table. After setting a uniform some other way,
+	// such as through GPUAccessor, call forget().
+	//
+	// Uploads go to the bound program, so it must be bound when setting values.
+	class UniformTable {
+
+	public:
+
+		static uint32_t const absent = 0xFFFFFFFFu;
+
+		struct Entry {
+			std::string name;
+			uint32_t    hash;
+			GLint       location;
+			GLenum      type;
+			GLint       count;
+			size_t      offset;
+			size_t      bytes;
+			bool        cached;
+		};
+
+	private:
+
+		GLuint program;
+		std::vector<Entry>    entries;
+		std::vector<uint32_t> slots;
+		std::vector<unsigned char> values;
+
+		static std::unordered_map<GLuint, std::unique_ptr<UniformTable>> tables;
+		static size_t upload_count;
+		static size_t skip_count;
+
+		static uint32_t hash(char const* name);
+		void insert(uint32_t index);
+
+	public:
+
+		explicit UniformTable(GLuint program);
+
+		// Reads the uniforms of a newly linked program and registers the table
+		static UniformTable& build(GLuint program);
+		// Returns the registered table, building it on first use
+		static UniformTable& of(GLuint program);
+		static void release(GLuint program);
+
+		// Returns 'absent' if the program has no active uniform by that name.
+		// Arrays can be found with or without a trailing "[0]".
+		uint32_t find(char const* name) const;
+		Entry const& entry(uint32_t index) const;
+		size_t size() const;
+
+		// Throws if a value of the given type cannot be set to the uniform
+		void check_type(uint32_t index, GLenum type) const;
+
+		// Uploads 'bytes' of data to the first element of the uniform, unless
+		// it already holds them. Returns whether an upload happened.
+		bool set(uint32_t index, void const* data, size_t bytes);
+		void forget();
+
+		static size_t uploads();
+		static size_t skipped();
+
+	};
+
+
+	// A uniform resolved once, so setting it involves no name lookup. A handle
+	// to a uniform the program does not have, for instance one the compiler
+	// optimized out, is left invalid and ignores values, like location -1.
+	template<typename T>
+	class UniformHandle {
+
+		UniformTable* table;
+		uint32_t      index;
+
+	public:
+
+		UniformHandle()
+			: table(nullptr)
+			, index(UniformTable::absent)
+		{}
+
+		UniformHandle(UniformTable& table, char const* name)
+			: table(&table)
+			, index(table.find(name))
+		{
+			if (index != UniformTable::absent) {
+				table.check_type(index, uniform::TypeOf<T>::value);
+			}
+		}
+
+		bool valid() const {
+			return index != UniformTable::absent;
+		}
+
+		// Returns whether the value had to be uploaded
+		bool set(T const& value) {
+			if (!valid()) {
+				return false;
+			}
+			return table->set(index, &value, sizeof(T));
+		}
+
+		UniformHandle& operator=(T const& value) {
+			set(value);
+			return *this;
+		}
+
+	};
+
+}
+
+#endif
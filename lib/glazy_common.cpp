@@ -1,160 +1,174 @@
-
-
-#include "glazy_common.h"
-
-
-namespace glazy {
-
-	namespace flags {
-		extern bool debug = true;
-	}
-
-	namespace file {
-		size_t file_size(std::ifstream& file) {
-			file.seekg(0, std::ios::end);
-			size_t result = static_cast<size_t>(file.tellg());
-			file.seekg(0, std::ios::beg);
-			return result;
-		}
-
-		std::string read_file_to_string(std::string file_path) {
-			std::ifstream file(file_path);
-			size_t size = file_size(file);
-			std::string result;
-			result.resize(size);
-			result.assign((std::istreambuf_iterator<char>(file)),
-				std::istreambuf_iterator<char>());
-			return result;
-		}
-	}
-
-
-	namespace safety {
-		void auto_throw(char const * context) {
-			GLenum err = glGetError();
-			if (err != GL_NO_ERROR) {
-				std::string message = std::string(context) + " - OpenGL Error Codes: ";
-				bool first = true;
-				while (err != GL_NO_ERROR) {
-					if (!first) {
-						message += ", ";
-					}
-					message += std::to_string(err);
-					err = glGetError();
-				}
-				throw std::runtime_error(message);
-			}
-		}
-			
-		void auto_throw(std::string const & context) {
-			auto_throw(context.c_str());
-		}
-
-		void entry_guard(char const * fn_name) {
-			GLenum err = glGetError();
-			if (err != GL_NO_ERROR) {
-				std::string context = "Encountered OpenGL error from before '";
-				context += std::string(fn_name) + "' was called.";
-				std::string message = context + " - OpenGL Error Codes: ";
-				bool first = true;
-				while (err != GL_NO_ERROR) {
-					if (!first) {
-						message += ", ";
-					}
-					message += std::to_string(err);
-					err = glGetError();
-				}
-				throw std::runtime_error(message);
-			}
-		}
-		
-		void entry_guard(std::string const& fn_name) {
-			entry_guard(fn_name.c_str());
-		}
-
-		void exit_guard(char const * fn_name) {
-			GLenum err = glGetError();
-			if (err != GL_NO_ERROR) {
-				std::string context = "Encountered OpenGL error during evaluation of '";
-				context += std::string(fn_name) + "'.";
-				std::string message = context + " - OpenGL Error Codes: ";
-				bool first = true;
-				while (err != GL_NO_ERROR) {
-					if (!first) {
-						message += ", ";
-					}
-					message += std::to_string(err);
-					err = glGetError();
-				}
-				throw std::runtime_error(message);
-			}
-		}
-		
-		void exit_guard(std::string const& fn_name) {
-			exit_guard(fn_name.c_str());
-		}
-	}
-
-
-
-	namespace context {
-
-		void error_callback(int error_code, char const* desc) {
-			throw std::runtime_error(desc);
-		}
-
-		GLFWwindow* setup(glm::ivec2 position, glm::ivec2 dimensions, const char* title, std::vector<WindowHint> hints) {
-			if (glfwInit() == GLFW_FALSE) {
-				throw std::runtime_error("Failed to initialize GLFW.");
-			}
-
-			glfwSetErrorCallback(error_callback);
-
-			std::vector<WindowHint> platform_hints;
-
-			#ifdef __APPLE__
-			// Hints derived from GLFW documentation: https://www.glfw.org/faq.html#41__how_do_i_create_an_opengl_30_context
-			// Versions updated to 4.1, since that seemed to work for students in previous terms
-			platform_hints = {
-				{GLFW_CONTEXT_VERSION_MAJOR, 4},
-				{GLFW_CONTEXT_VERSION_MINOR, 1},
-				{GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE},
-				{GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE}
-			};
-			#else
-			platform_hints = {
-				{GLFW_CONTEXT_VERSION_MAJOR, 4},
-				{GLFW_CONTEXT_VERSION_MINOR, 1},
-				{GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE},
-			};
-			#endif
-
-			for (auto&& hint : platform_hints) {
-				glfwWindowHint(hint.hint, hint.value);
-			}
-
-			for (auto&& hint : hints) {
-				glfwWindowHint(hint.hint, hint.value);
-			}
-
-			GLFWwindow* result = glfwCreateWindow(dimensions.x, dimensions.y, title, nullptr, nullptr);
-
-			if (result == nullptr) {
-				glfwTerminate();
-				throw std::runtime_error("Failed to create window.");
-			}
-			
-			glfwSetWindowPos(result, position.x, position.y);
-
-			glfwMakeContextCurrent(result);
-			glfwSwapInterval(1);
-			if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-				throw std::runtime_error("Failed to initialize OpenGL context.");
-			}
-			return result;
-		}
-	}
-
-}
-
-
+
+
+#include "glazy_common.h"
+
+
+namespace glazy {
+
+	namespace flags {
+		extern bool debug = true;
+	}
+
+	namespace file {
+		size_t file_size(std::ifstream& file) {
+			file.seekg(0, std::ios::end);
+			size_t result = static_cast<size_t>(file.tellg());
+			file.seekg(0, std::ios::beg);
+			return result;
+		}
+
+		std::string read_file_to_string(std::string file_path) {
+			std::ifstream file(file_path);
+			size_t size = file_size(file);
+			std::string result;
+			result.resize(size);
+			result.assign((std::istreambuf_iterator<char>(file)),
+				std::istreambuf_iterator<char>());
+			return result;
+		}
+	}
+
+
+	namespace safety {
+
+		// Headless builds have no context to ask, so they never see errors
+		static GLenum next_error() {
+			#ifdef GLAZY_HEADLESS
+			return GL_NO_ERROR;
+			#else
+			return glGetError();
+			#endif
+		}
+
+		void auto_throw(char const * context) {
+			GLenum err = next_error();
+			if (err != GL_NO_ERROR) {
+				std::string message = std::string(context) + " - OpenGL Error Codes: ";
+				bool first = true;
+				while (err != GL_NO_ERROR) {
+					if (!first) {
+						message += ", ";
+					}
+					message += std::to_string(err);
+					err = next_error();
+				}
+				throw std::runtime_error(message);
+			}
+		}
+			
+		void auto_throw(std::string const & context) {
+			auto_throw(context.c_str());
+		}
+
+		void entry_guard(char const * fn_name) {
+			GLenum err = next_error();
+			if (err != GL_NO_ERROR) {
+				std::string context = "Encountered OpenGL error from before '";
+				context += std::string(fn_name) + "' was called.";
+				std::string message = context + " - OpenGL Error Codes: ";
+				bool first = true;
+				while (err != GL_NO_ERROR) {
+					if (!first) {
+						message += ", ";
+					}
+					message += std::to_string(err);
+					err = next_error();
+				}
+				throw std::runtime_error(message);
+			}
+		}
+		
+		void entry_guard(std::string const& fn_name) {
+			entry_guard(fn_name.c_str());
+		}
+
+		void exit_guard(char const * fn_name) {
+			GLenum err = next_error();
+			if (err != GL_NO_ERROR) {
+				std::string context = "Encountered OpenGL error during evaluation of '";
+				context += std::string(fn_name) + "'.";
+				std::string message = context + " - OpenGL Error Codes: ";
+				bool first = true;
+				while (err != GL_NO_ERROR) {
+					if (!first) {
+						message += ", ";
+					}
+					message += std::to_string(err);
+					err = next_error();
+				}
+				throw std::runtime_error(message);
+			}
+		}
+		
+		void exit_guard(std::string const& fn_name) {
+			exit_guard(fn_name.c_str());
+		}
+	}
+
+
+
+	// Window and context creation is left out of headless builds, which do
+	// not link against GLFW
+	#ifndef GLAZY_HEADLESS
+	namespace context {
+
+		void error_callback(int error_code, char const* desc) {
+			throw std::runtime_error(desc);
+		}
+
+		GLFWwindow* setup(glm::ivec2 position, glm::ivec2 dimensions, const char* title, std::vector<WindowHint> hints) {
+			if (glfwInit() == GLFW_FALSE) {
+				throw std::runtime_error("Failed to initialize GLFW.");
+			}
+
+			glfwSetErrorCallback(error_callback);
+
+			std::vector<WindowHint> platform_hints;
+
+			#ifdef __APPLE__
+			// Hints derived from GLFW documentation: https://www.glfw.org/faq.html#41__how_do_i_create_an_opengl_30_context
+			// Versions updated to 4.1, since that seemed to work for students in previous terms
+			platform_hints = {
+				{GLFW_CONTEXT_VERSION_MAJOR, 4},
+				{GLFW_CONTEXT_VERSION_MINOR, 1},
+				{GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE},
+				{GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE}
+			};
+			#else
+			platform_hints = {
+				{GLFW_CONTEXT_VERSION_MAJOR, 4},
+				{GLFW_CONTEXT_VERSION_MINOR, 1},
+				{GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE},
+			};
+			#endif
+
+			for (auto&& hint : platform_hints) {
+				glfwWindowHint(hint.hint, hint.value);
+			}
+
+			for (auto&& hint : hints) {
+				glfwWindowHint(hint.hint, hint.value);
+			}
+
+			GLFWwindow* result = glfwCreateWindow(dimensions.x, dimensions.y, title, nullptr, nullptr);
+
+			if (result == nullptr) {
+				glfwTerminate();
+				throw std::runtime_error("Failed to create window.");
+			}
+			
+			glfwSetWindowPos(result, position.x, position.y);
+
+			glfwMakeContextCurrent(result);
+			glfwSwapInterval(1);
+			if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+				throw std::runtime_error("Failed to initialize OpenGL context.");
+			}
+			return result;
+		}
+	}
+	#endif
+
+}
+
+
@@ -0,0 +1,266 @@
+#include "glazy_uniform.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+namespace glazy {
+
+	namespace uniform {
+
+		namespace {
+
+			void gl_get_program(GLuint program, GLenum name, GLint* value) {
+				glGetProgramiv(program, name, value);
+			}
+
+			void gl_get_active_uniform(GLuint program, GLuint index, GLsizei buffer_size, GLsizei* length, GLint* size, GLenum* type, GLchar* name) {
+				glGetActiveUniform(program, index, buffer_size, length, size, type, name);
+			}
+
+			GLint gl_get_location(GLuint program, GLchar const* name) {
+				return glGetUniformLocation(program, name);
+			}
+
+			void gl_upload(GLint location, GLenum type, GLsizei count, void const* data) {
+				GLfloat  const* f = static_cast<GLfloat  const*>(data);
+				GLint    const* i = static_cast<GLint    const*>(data);
+				GLuint   const* u = static_cast<GLuint   const*>(data);
+				GLdouble const* d = static_cast<GLdouble const*>(data);
+				switch (type) {
+				case GL_FLOAT:             glUniform1fv(location, count, f); break;
+				case GL_FLOAT_VEC2:        glUniform2fv(location, count, f); break;
+				case GL_FLOAT_VEC3:        glUniform3fv(location, count, f); break;
+				case GL_FLOAT_VEC4:        glUniform4fv(location, count, f); break;
+				case GL_INT_VEC2:
+				case GL_BOOL_VEC2:         glUniform2iv(location, count, i); break;
+				case GL_INT_VEC3:
+				case GL_BOOL_VEC3:         glUniform3iv(location, count, i); break;
+				case GL_INT_VEC4:
+				case GL_BOOL_VEC4:         glUniform4iv(location, count, i); break;
+				case GL_UNSIGNED_INT:      glUniform1uiv(location, count, u); break;
+				case GL_UNSIGNED_INT_VEC2: glUniform2uiv(location, count, u); break;
+				case GL_UNSIGNED_INT_VEC3: glUniform3uiv(location, count, u); break;
+				case GL_UNSIGNED_INT_VEC4: glUniform4uiv(location, count, u); break;
+				case GL_FLOAT_MAT2:        glUniformMatrix2fv(location, count, false, f); break;
+				case GL_FLOAT_MAT3:        glUniformMatrix3fv(location, count, false, f); break;
+				case GL_FLOAT_MAT4:        glUniformMatrix4fv(location, count, false, f); break;
+				case GL_FLOAT_MAT2x3:      glUniformMatrix2x3fv(location, count, false, f); break;
+				case GL_FLOAT_MAT2x4:      glUniformMatrix2x4fv(location, count, false, f); break;
+				case GL_FLOAT_MAT3x2:      glUniformMatrix3x2fv(location, count, false, f); break;
+				case GL_FLOAT_MAT3x4:      glUniformMatrix3x4fv(location, count, false, f); break;
+				case GL_FLOAT_MAT4x2:      glUniformMatrix4x2fv(location, count, false, f); break;
+				case GL_FLOAT_MAT4x3:      glUniformMatrix4x3fv(location, count, false, f); break;
+				case GL_DOUBLE:            glUniform1dv(location, count, d); break;
+				// Everything else is an integer, a boolean or a sampler. Double
+				// vectors and matrices have no TypeOf, so they never get here.
+				default:                   glUniform1iv(location, count, i); break;
+				}
+			}
+
+			// Whether a uniform of this type is set with glUniform1i, which
+			// covers booleans and every sampler type
+			bool set_as_int(GLenum type) {
+				switch (type) {
+				case GL_FLOAT:         case GL_FLOAT_VEC2:        case GL_FLOAT_VEC3:        case GL_FLOAT_VEC4:
+				case GL_INT_VEC2:      case GL_INT_VEC3:          case GL_INT_VEC4:
+				case GL_BOOL_VEC2:     case GL_BOOL_VEC3:         case GL_BOOL_VEC4:
+				case GL_UNSIGNED_INT:  case GL_UNSIGNED_INT_VEC2: case GL_UNSIGNED_INT_VEC3: case GL_UNSIGNED_INT_VEC4:
+				case GL_FLOAT_MAT2:    case GL_FLOAT_MAT3:        case GL_FLOAT_MAT4:
+				case GL_FLOAT_MAT2x3:  case GL_FLOAT_MAT2x4:      case GL_FLOAT_MAT3x2:
+				case GL_FLOAT_MAT3x4:  case GL_FLOAT_MAT4x2:      case GL_FLOAT_MAT4x3:
+				case GL_DOUBLE:        case GL_DOUBLE_VEC2:       case GL_DOUBLE_VEC3:       case GL_DOUBLE_VEC4:
+				case GL_DOUBLE_MAT2:   case GL_DOUBLE_MAT3:       case GL_DOUBLE_MAT4:
+				case GL_DOUBLE_MAT2x3: case GL_DOUBLE_MAT2x4:     case GL_DOUBLE_MAT3x2:
+				case GL_DOUBLE_MAT3x4: case GL_DOUBLE_MAT4x2:     case GL_DOUBLE_MAT4x3:
+					return false;
+				default:
+					return true;
+				}
+			}
+
+			// The size of one element of a uniform, as laid out on the CPU side
+			size_t element_bytes(GLenum type) {
+				switch (type) {
+				case GL_FLOAT_VEC2:   case GL_INT_VEC2: case GL_BOOL_VEC2: case GL_UNSIGNED_INT_VEC2: return  8;
+				case GL_FLOAT_VEC3:   case GL_INT_VEC3: case GL_BOOL_VEC3: case GL_UNSIGNED_INT_VEC3: return 12;
+				case GL_FLOAT_VEC4:   case GL_INT_VEC4: case GL_BOOL_VEC4: case GL_UNSIGNED_INT_VEC4: return 16;
+				case GL_FLOAT_MAT2:   return 16;
+				case GL_FLOAT_MAT3:   return 36;
+				case GL_FLOAT_MAT4:   return 64;
+				case GL_FLOAT_MAT2x3: case GL_FLOAT_MAT3x2: return 24;
+				case GL_FLOAT_MAT2x4: case GL_FLOAT_MAT4x2: return 32;
+				case GL_FLOAT_MAT3x4: case GL_FLOAT_MAT4x3: return 48;
+				case GL_DOUBLE:       return  8;
+				default:              return  4;
+				}
+			}
+
+		}
+
+		Functions gl_functions() {
+			return Functions{ gl_get_program, gl_get_active_uniform, gl_get_location, gl_upload };
+		}
+
+		Functions functions = gl_functions();
+
+	}
+
+
+	// FNV-1a, which is plenty for a few dozen short names
+	uint32_t UniformTable::hash(char const* name) {
+		uint32_t result = 2166136261u;
+		for (; *name; name++) {
+			result ^= static_cast<unsigned char>(*name);
+			result *= 16777619u;
+		}
+		return result;
+	}
+
+	void UniformTable::insert(uint32_t index) {
+		size_t mask = slots.size() - 1;
+		size_t slot = entries[index].hash & mask;
+		while (slots[slot] != absent) {
+			slot = (slot + 1) & mask;
+		}
+		slots[slot] = index;
+	}
+
+	UniformTable::UniformTable(GLuint program)
+		: program(program)
+	{
+		safety::entry_guard("UniformTable::UniformTable");
+		GLint active     = 0;
+		GLint max_length = 0;
+		uniform::functions.get_program(program, GL_ACTIVE_UNIFORMS, &active);
+		uniform::functions.get_program(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+		std::vector<GLchar> name_buffer((size_t) std::max(max_length, 1) + 1, '\0');
+		for (GLint i = 0; i < active; i++) {
+			GLsizei length = 0;
+			GLint   count  = 0;
+			GLenum  type   = 0;
+			uniform::functions.get_active_uniform(program, (GLuint) i, (GLsizei) name_buffer.size(), &length, &count, &type, name_buffer.data());
+			std::string name(name_buffer.data(), (size_t) length);
+			// Uniforms in blocks have no location of their own
+			GLint location = uniform::functions.get_location(program, name.c_str());
+			if (location < 0) {
+				continue;
+			}
+			if ((name.size() > 3) && (name.compare(name.size() - 3, 3, "[0]") == 0)) {
+				name.resize(name.size() - 3);
+			}
+			Entry entry;
+			entry.name     = name;
+			entry.hash     = hash(name.c_str());
+			entry.location = location;
+			entry.type     = type;
+			entry.count    = count;
+			entry.offset   = values.size();
+			entry.bytes    = uniform::element_bytes(type);
+			entry.cached   = false;
+			values.resize(values.size() + entry.bytes);
+			entries.push_back(entry);
+		}
+		// Keeping the table at most half full keeps probe runs short
+		size_t capacity = 8;
+		while (capacity < entries.size() * 2) {
+			capacity *= 2;
+		}
+		slots.assign(capacity, absent);
+		for (uint32_t i = 0; i < entries.size(); i++) {
+			insert(i);
+		}
+		safety::exit_guard("UniformTable::UniformTable");
+	}
+
+	UniformTable& UniformTable::build(GLuint program) {
+		std::unique_ptr<UniformTable>& table = tables[program];
+		table.reset(new UniformTable(program));
+		return *table;
+	}
+
+	UniformTable& UniformTable::of(GLuint program) {
+		auto found = tables.find(program);
+		if (found != tables.end()) {
+			return *found->second;
+		}
+		return build(program);
+	}
+
+	void UniformTable::release(GLuint program) {
+		tables.erase(program);
+	}
+
+	uint32_t UniformTable::find(char const* name) const {
+		uint32_t code = hash(name);
+		size_t mask = slots.size() - 1;
+		for (size_t slot = code & mask; slots[slot] != absent; slot = (slot + 1) & mask) {
+			Entry const& entry = entries[slots[slot]];
+			if ((entry.hash == code) && (entry.name == name)) {
+				return slots[slot];
+			}
+		}
+		size_t length = strlen(name);
+		if ((length > 3) && (strcmp(name + length - 3, "[0]") == 0)) {
+			return find(std::string(name, length - 3).c_str());
+		}
+		return absent;
+	}
+
+	UniformTable::Entry const& UniformTable::entry(uint32_t index) const {
+		return entries[index];
+	}
+
+	size_t UniformTable::size() const {
+		return entries.size();
+	}
+
+	void UniformTable::check_type(uint32_t index, GLenum type) const {
+		Entry const& entry = entries[index];
+		bool matches = (entry.type == type) || ((type == GL_INT) && uniform::set_as_int(entry.type));
+		if (!matches) {
+			std::string message = "Uniform '";
+			message += entry.name + "' cannot be set from a value of GL type ";
+			message += std::to_string(type) + ".";
+			throw std::runtime_error(message);
+		}
+	}
+
+	bool UniformTable::set(uint32_t index, void const* data, size_t bytes) {
+		Entry& entry = entries[index];
+		unsigned char* cache = values.data() + entry.offset;
+		bytes = std::min(bytes, entry.bytes);
+		if (entry.cached && (memcmp(cache, data, bytes) == 0)) {
+			skip_count++;
+			return false;
+		}
+		memcpy(cache, data, bytes);
+		entry.cached = true;
+		uniform::functions.upload(entry.location, entry.type, 1, data);
+		upload_count++;
+		return true;
+	}
+
+	void UniformTable::forget() {
+		for (Entry& entry : entries) {
+			entry.cached = false;
+		}
+	}
+
+	size_t UniformTable::uploads() {
+		return upload_count;
+	}
+
+	size_t UniformTable::skipped() {
+		return skip_count;
+	}
+
+
+	uint32_t const UniformTable::absent;
+
+	std::unordered_map<GLuint, std::unique_ptr<UniformTable>> UniformTable::tables;
+	size_t UniformTable::upload_count = 0;
+	size_t UniformTable::skip_count   = 0;
+
+}
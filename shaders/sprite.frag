@@ -1,16 +1,24 @@
-#version 410
-
-in  vec2 vuv;
-
-out vec4 pColor;
-
-uniform sampler2D tex;
-
-void main() {
-	vec4 color = texture(tex,vuv).rgba;
-	if(color.a < 0.99){
-		discard;
-	}
-	pColor = color;
-}
-
+#version 410
+
+in  vec2 vuv;
+flat in float vlayer;
+
+out vec4 pColor;
+
+uniform sampler2D      tex;
+uniform sampler2DArray atlas;
+
+void main() {
+	// Sprites with a negative layer have a texture of their own
+	vec4 color;
+	if(vlayer < 0.0){
+		color = texture(tex,vuv).rgba;
+	} else {
+		color = texture(atlas,vec3(vuv,vlayer)).rgba;
+	}
+	if(color.a < 0.99){
+		discard;
+	}
+	pColor = color;
+}
+
@@ -1,22 +1,26 @@
-#version 410
-
-layout(location = 0) in  vec3  pos;
-layout(location = 1) in  vec2  uv;
-
-out vec2  vuv;
-
-uniform vec2  scale;
-uniform vec2  offset;
-uniform vec2  cam_pos;
-uniform float depth;
-
-void main() {
-	vec3 position = pos;
-	position.xy *= scale;
-	position.xy += offset;
-	position.xy -= cam_pos;
-	position.z = depth;
-	vuv = uv;
-	gl_Position = vec4(position,1);
-}
-
+#version 410
+
+layout(location = 0) in  vec3  pos;
+layout(location = 1) in  vec2  uv;
+
+// Per-instance attributes, one set per sprite
+layout(location = 2) in  vec2  offset;
+layout(location = 3) in  vec2  scale;
+layout(location = 4) in  vec4  uv_rect;
+layout(location = 5) in  float depth;
+layout(location = 6) in  float layer;
+
+out vec2  vuv;
+
+uniform vec2  cam_pos;
+
+void main() {
+	vec3 position = pos;
+	position.xy *= scale;
+	position.xy += offset;
+	position.xy -= cam_pos;
+	position.z = depth;
+	vuv = uv_rect.xy + uv * uv_rect.zw;
+	gl_Position = vec4(position,1);
+}
+
@@ -1,16 +1,26 @@
-#version 410
-
-in  vec2 vuv;
-in  vec2 vpos;
-
-out vec4 pColor;
-
-uniform sampler2D tex;
-
-void main() {
-	vec4 color = texture(tex,vpos*10.0f).rgba;
-	if(color.a < 0.99){
-		discard;
-	}
-	pColor = color;
-}
+#version 410
+
+in  vec2 vuv;
+in  vec2 vpos;
+flat in vec4  vrect;
+flat in float vlayer;
+
+out vec4 pColor;
+
+uniform sampler2D      tex;
+uniform sampler2DArray atlas;
+
+void main() {
+	// The atlas cannot wrap, so tiles repeat within their own region of it
+	vec4 color;
+	if(vlayer < 0.0){
+		color = texture(tex,vpos*10.0f).rgba;
+	} else {
+		vec2 tiled = vrect.xy + fract(vpos*10.0f) * vrect.zw;
+		color = texture(atlas,vec3(tiled,vlayer)).rgba;
+	}
+	if(color.a < 0.99){
+		discard;
+	}
+	pColor = color;
+}